@@ -37,6 +37,7 @@ config switches:
 //#include <avr/iox16e5.h>
 #include <avr/io.h>
 #include <util/delay.h>
+#include <avr/sleep.h>
 #include <stdbool.h>
 //#include <avr/eeprom.h>
 
@@ -44,6 +45,8 @@ config switches:
 #include "stepper.h"
 #include "switches.h"
 #include "led.h"
+#include "perf.h"
+#include "planner.h"
 #include "twostep_parser.h"
 
 
@@ -91,16 +94,24 @@ static void init_conf_switches()
 int main(void)
 {
     init_external_crystal();
+    perf_init();
     stepper_init();
+    planner_init();
     switches_init();
     uart_init(BAUD_115200);
     init_conf_switches();
     led_init();
 
+    // The main loop sleeps between interrupts, everything keeps running in
+    // IDLE.
+    set_sleep_mode(SLEEP_MODE_IDLE);
+
     _delay_ms(10);
 
     while(1) {
         twostep_parser_parse();
+        planner_update();
+        uart_wait();
     }
 
     return 0;
@@ -0,0 +1,175 @@
+/*
+perf.c - Measures how long the stepper interrupts take and how busy the
+interrupts keep the CPU.
+Copyright (C) 2013 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This file is part of the TwoStep firmware.
+
+Lasershark is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Lasershark is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "perf.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+
+// The idle percentage is worked out every 256 TCD5 overflows, 2^24 cycles.
+#define PERF_WINDOW_SHIFT 24
+
+static volatile uint16_t perf_min;
+static volatile uint16_t perf_max;
+static volatile uint32_t perf_sum;
+static volatile uint32_t perf_count;
+static volatile uint32_t perf_late; // Steps that were due before they could be scheduled
+static volatile uint16_t perf_latency_max; // Step timer ticks from a compare to its interrupt
+static volatile uint16_t perf_wake_latency_max; // The same for compares that woke the CPU up
+volatile uint32_t perf_busy;
+volatile bool perf_busy_seen;
+volatile uint8_t perf_window;
+volatile bool perf_asleep;
+static volatile uint8_t perf_idle; // Percentage of the last window spent outside the interrupts, 100 while none run
+
+
+// Called at the end of a stepper interrupt with what perf_start() returned
+// at its start.
+void perf_isr_end(uint16_t start)
+{
+    uint16_t cycles = TCD5.CNT - start;
+
+    if (cycles < perf_min) {
+        perf_min = cycles;
+    }
+    if (cycles > perf_max) {
+        perf_max = cycles;
+    }
+    if (perf_sum > UINT32_MAX - cycles) {
+        // Halving both keeps the mean.
+        perf_sum >>= 1;
+        perf_count >>= 1;
+    }
+    perf_sum += cycles;
+    perf_count++;
+    perf_isr_busy(start);
+}
+
+
+// Called when a step could not be scheduled in time.
+void perf_isr_late()
+{
+    if (perf_late != UINT32_MAX) {
+        perf_late++;
+    }
+}
+
+
+// Called at the start of a step interrupt with the step timer ticks since its
+// compare matched. The first interrupt after perf_sleep() woke the CPU up,
+// its latency goes to the wake-up maximum instead.
+void perf_isr_latency(uint16_t ticks)
+{
+    if (perf_asleep) {
+        if (ticks > perf_wake_latency_max) {
+            perf_wake_latency_max = ticks;
+        }
+    } else if (ticks > perf_latency_max) {
+        perf_latency_max = ticks;
+    }
+}
+
+
+// Closes the window every 256 overflows. One without any other interrupt
+// stops the overflows until perf_isr_busy() sees the next one.
+ISR(TCD5_OVF_vect)
+{
+    uint16_t start = perf_start();
+    uint32_t busy;
+    // Clear interrupt flag
+    TCD5.INTFLAGS = TC5_OVFIF_bm;
+
+    if (++perf_window == 0) {
+        busy = perf_busy;
+        perf_busy = 0;
+        if (busy >= (1UL << PERF_WINDOW_SHIFT)) {
+            perf_idle = 0;
+        } else {
+            perf_idle = 100 - ((busy * 100) >> PERF_WINDOW_SHIFT);
+        }
+        if (!perf_busy_seen) {
+            TCD5.INTCTRLA = TC45_OVFINTLVL_OFF_gc;
+        }
+        perf_busy_seen = false;
+    }
+    perf_asleep = false;
+    perf_busy += (uint16_t)(TCD5.CNT - start);
+}
+
+
+bool perf_get_stats(uint16_t *min, uint16_t *max, uint16_t *mean, uint32_t *late, uint8_t *idle)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *min = perf_count ? perf_min : 0;
+        *max = perf_max;
+        *mean = perf_count ? perf_sum / perf_count : 0;
+        *late = perf_late;
+        *idle = perf_idle;
+    }
+
+    return true;
+}
+
+
+// Longest step interrupt latency while running and longest one of a step
+// interrupt that woke the CPU up, in CPU cycles. The step timer runs at 1/8th
+// of the CPU clock, so both are multiples of 8.
+bool perf_get_latency(uint16_t *max, uint16_t *wake_max)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *max = (perf_latency_max > (UINT16_MAX >> 3)) ? UINT16_MAX : perf_latency_max << 3;
+        *wake_max = (perf_wake_latency_max > (UINT16_MAX >> 3)) ? UINT16_MAX : perf_wake_latency_max << 3;
+    }
+
+    return true;
+}
+
+
+bool perf_reset_stats()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        perf_min = UINT16_MAX;
+        perf_max = 0;
+        perf_sum = 0;
+        perf_count = 0;
+        perf_late = 0;
+        perf_latency_max = 0;
+        perf_wake_latency_max = 0;
+    }
+
+    return true;
+}
+
+
+void perf_init()
+{
+    perf_reset_stats();
+    perf_busy = 0;
+    perf_window = 0;
+    perf_idle = 100;
+
+    // Free running at the CPU clock, 32Mhz
+    TCD5.PER = 0xffff;
+    TCD5.CTRLA = TC45_CLKSEL_DIV1_gc;
+
+    // Overflows close the idle windows, perf_isr_busy() turns them on.
+    TCD5.INTCTRLA = TC45_OVFINTLVL_OFF_gc;
+}
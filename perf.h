@@ -0,0 +1,94 @@
+/*
+perf.h - Measures how long the stepper interrupts take and how busy the
+interrupts keep the CPU.
+Copyright (C) 2013 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This file is part of the TwoStep firmware.
+
+Lasershark is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Lasershark is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PERF_H_
+#define PERF_H_
+
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// TCD5 runs free at the CPU clock, so differences of its count are cycles.
+static inline uint16_t perf_start()
+{
+    return TCD5.CNT;
+}
+
+// Interrupt cycles in the current idle window, whether an interrupt other
+// than the TCD5 overflow ran in it and its overflow count. Only touched
+// through perf_isr_busy() outside of perf.c.
+extern volatile uint32_t perf_busy;
+extern volatile bool perf_busy_seen;
+extern volatile uint8_t perf_window;
+// Set right before the CPU sleeps, cleared once it is awake again.
+extern volatile bool perf_asleep;
+
+
+// Called with interrupts off right before the CPU sleeps, so the latency of
+// a step interrupt that wakes it up is kept apart, see perf_isr_latency().
+static inline void perf_sleep()
+{
+    perf_asleep = true;
+}
+
+
+// Called right after the CPU woke up. Interrupts that were already pending
+// then still count as waking it.
+static inline void perf_wake()
+{
+    perf_asleep = false;
+}
+
+
+// Called at the end of the stepper interrupts with what perf_start() returned
+// at their start, counts them against the idle time. The other interrupts
+// only call it when built with PERF_ISR_BUSY, timing a short one can double
+// what it costs. The TCD5 overflow that closes the windows only runs while
+// other interrupts do, so it doesn't wake the CPU up every 2 ms when nothing
+// else happens. The first interrupt after that opens a new window. Inline, so
+// the interrupts don't have to save the registers a call clobbers.
+static inline void perf_isr_busy(uint16_t start)
+{
+    if (!(TCD5.INTCTRLA & TC45_OVFINTLVL_gm)) {
+        perf_window = 0;
+        perf_busy = 0;
+        TCD5.INTFLAGS = TC5_OVFIF_bm;
+        TCD5.INTCTRLA = TC45_OVFINTLVL_LO_gc;
+    }
+    perf_busy_seen = true;
+    perf_asleep = false;
+    perf_busy += (uint16_t)(TCD5.CNT - start);
+}
+
+void perf_isr_end(uint16_t start);
+void perf_isr_late();
+void perf_isr_latency(uint16_t ticks);
+
+bool perf_get_stats(uint16_t *min, uint16_t *max, uint16_t *mean, uint32_t *late, uint8_t *idle);
+bool perf_get_latency(uint16_t *max, uint16_t *wake_max);
+bool perf_reset_stats();
+
+void perf_init();
+
+
+#endif
@@ -0,0 +1,325 @@
+/*
+planner.c - Look-ahead planner for coordinated two axis segments.
+Copyright (C) 2013 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This file is part of the TwoStep firmware.
+
+Lasershark is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Lasershark is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "planner.h"
+#include <limits.h>
+#include <stddef.h>
+#include <util/atomic.h>
+
+
+// Unit vectors are Q14.
+#define PLANNER_UNIT 16384L
+
+
+// A segment waiting to be run. The entry and exit speeds (steps/s along the
+// path) are the ones its move was built with.
+struct planner_block {
+    struct stepper_segment seg;
+    int32_t dx;
+    int32_t dy;
+    uint32_t len;
+    uint16_t nominal;
+    uint16_t max_entry;
+    uint16_t accel;
+    uint16_t entry;
+    uint16_t exit;
+    bool built;
+};
+
+static struct planner_block planner_buf[PLANNER_BUF_LEN];
+static volatile uint8_t planner_tail; // Next block to run
+static volatile uint8_t planner_count;
+
+// Exit speed of the running segment, the next block has to enter at it.
+static volatile uint16_t planner_locked_exit;
+static volatile bool planner_dirty;
+
+// Direction and speed of the last block added, for the junction speed.
+static int16_t planner_prev_ux;
+static int16_t planner_prev_uy;
+static uint16_t planner_prev_nominal;
+
+
+static inline uint8_t planner_index(uint8_t i)
+{
+    return i >= PLANNER_BUF_LEN ? i - PLANNER_BUF_LEN : i;
+}
+
+
+// Helper method. Returns the speed reached from speed after accelerating
+// over len steps, sqrt(speed^2 + 2 * accel * len).
+static uint16_t planner_reach(uint16_t speed, uint16_t accel, uint32_t len)
+{
+    uint32_t speed_sq = (uint32_t)speed * speed;
+    uint16_t res = USHRT_MAX;
+
+    if (accel != 0 && len < (UINT32_MAX - speed_sq) / ((uint32_t)accel << 1)) {
+        res = stepper_isqrt(speed_sq + ((uint32_t)accel << 1) * len);
+    }
+
+    return res;
+}
+
+
+// Helper method. Returns the fastest speed to take the corner between the
+// last block and one going along (ux, uy) at, using the junction deviation
+// method: v^2 = accel * deviation * sin(t/2) / (1 - sin(t/2)), t being the
+// angle between the two paths (180 degrees when going straight on).
+static uint16_t planner_junction_speed(int16_t ux, int16_t uy, uint16_t nominal, uint16_t accel)
+{
+    int32_t dot = ((int32_t)planner_prev_ux * ux + (int32_t)planner_prev_uy * uy) / PLANNER_UNIT;
+    uint32_t sin_half;
+    uint32_t ratio;
+    uint32_t speed_sq;
+    uint16_t res = nominal < planner_prev_nominal ? nominal : planner_prev_nominal;
+
+    // sin(t/2) = sqrt((1 - cos(t)) / 2), cos(t) being -dot.
+    sin_half = stepper_isqrt((uint32_t)((PLANNER_UNIT + dot) >> 1) << 14);
+
+    if (accel != 0 && sin_half < PLANNER_UNIT - 16) {
+        ratio = (sin_half << 14) / (PLANNER_UNIT - sin_half);
+        if (ratio < (1UL << 18)) {
+            speed_sq = ((uint32_t)accel * PLANNER_JUNCTION_DEVIATION) * (ratio >> 6) >> 8;
+            if (speed_sq < (uint32_t)res * res) {
+                res = stepper_isqrt(speed_sq);
+            }
+        }
+    }
+
+    return res;
+}
+
+
+bool planner_add_line(int32_t dx, int32_t dy, uint16_t speed)
+{
+    bool res = planner_count < PLANNER_BUF_LEN;
+    struct planner_block *block;
+    uint32_t adx = dx < 0 ? -(uint32_t)dx : (uint32_t)dx;
+    uint32_t ady = dy < 0 ? -(uint32_t)dy : (uint32_t)dy;
+    uint32_t len;
+    uint16_t accel[STEPPER_MAX_STEPPER_NUM];
+    uint16_t decel;
+    int16_t ux;
+    int16_t uy;
+    uint8_t shift = 0;
+    uint8_t geared;
+    int16_t gear_num;
+    uint16_t gear_den;
+
+    if (speed < STEPPER_MAX_SPEED_MIN || (dx == 0 && dy == 0)) {
+        res = false;
+    }
+
+    if (stepper_get_gearing(&geared, &gear_num, &gear_den) && geared) {
+        // Stepper 2 follows stepper 1, it can't take part in a path.
+        res = false;
+    }
+
+    if (res) {
+        block = &planner_buf[planner_index(planner_tail + planner_count)];
+
+        // Scaled down so the squares can't overflow.
+        while ((adx >> shift) > 0x7fff || (ady >> shift) > 0x7fff) {
+            shift++;
+        }
+        len = stepper_isqrt((adx >> shift) * (adx >> shift) + (ady >> shift) * (ady >> shift));
+        ux = (int32_t)(adx >> shift) * PLANNER_UNIT / len;
+        uy = (int32_t)(ady >> shift) * PLANNER_UNIT / len;
+        ux = dx < 0 ? -ux : ux;
+        uy = dy < 0 ? -uy : uy;
+
+        // The path accelerates no faster than the slower axis.
+        stepper_get_accel(1, &accel[0], &decel);
+        stepper_get_accel(2, &accel[1], &decel);
+        block->accel = accel[0] < accel[1] ? accel[0] : accel[1];
+
+        block->dx = dx;
+        block->dy = dy;
+        block->len = len << shift;
+        block->nominal = speed;
+        block->max_entry = planner_count ? planner_junction_speed(ux, uy, speed, block->accel) : 0;
+        block->built = false;
+
+        planner_prev_ux = ux;
+        planner_prev_uy = uy;
+        planner_prev_nominal = speed;
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            planner_count++;
+        }
+        planner_dirty = true;
+    }
+
+    return res;
+}
+
+
+bool planner_get_free(uint8_t *free)
+{
+    *free = PLANNER_BUF_LEN - planner_count;
+    return true;
+}
+
+
+void planner_flush()
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        planner_count = 0;
+        planner_locked_exit = 0;
+        planner_dirty = false;
+    }
+}
+
+
+// Called from the main loop. Replans the entry speeds of the blocks that
+// have not started yet and rebuilds the moves of those that changed. The
+// first block has to enter at the exit speed of the running segment.
+//
+// A built block either exits at 0 or is followed by a built block entering
+// at its exit, so whatever the ISR hands out always has somewhere to go. A
+// block given a faster exit is written together with its successor, which
+// stops at its end until it is rebuilt itself, unless it can't stop within
+// its length.
+void planner_update()
+{
+    uint16_t entry[PLANNER_BUF_LEN];
+    struct stepper_segment seg;
+    struct stepper_segment next_seg;
+    struct planner_block *block;
+    struct planner_block *next;
+    struct planner_block *after;
+    uint8_t tail;
+    uint8_t count;
+    uint16_t exit;
+    uint16_t next_exit;
+    uint16_t speed;
+    bool pair;
+    bool retry = planner_dirty;
+    uint8_t k;
+
+    while (retry) {
+        retry = false;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            planner_dirty = false;
+            tail = planner_tail;
+            count = planner_count;
+            entry[0] = planner_locked_exit;
+        }
+
+        // Backward pass, every block has to be able to slow down to the
+        // entry of the next one. The last block stops.
+        exit = 0;
+        for (k = count - 1; k > 0 && k < PLANNER_BUF_LEN; k--) {
+            block = &planner_buf[planner_index(tail + k)];
+            speed = planner_reach(exit, block->accel, block->len);
+            entry[k] = speed < block->max_entry ? speed : block->max_entry;
+            exit = entry[k];
+        }
+
+        // Forward pass, every block has to be able to reach the entry of the
+        // next one.
+        for (k = 0; k + 1 < count; k++) {
+            block = &planner_buf[planner_index(tail + k)];
+            speed = planner_reach(entry[k], block->accel, block->len);
+            if (speed < entry[k+1]) {
+                entry[k+1] = speed;
+            }
+        }
+
+        for (k = 0; k < count && !retry; k++) {
+            block = &planner_buf[planner_index(tail + k)];
+            exit = (k + 1 < count) ? entry[k+1] : 0;
+            if (block->built && block->entry == entry[k] && block->exit == exit) {
+                continue;
+            }
+
+            stepper_segment_init(&seg, block->dx, block->dy, block->len, entry[k], block->nominal, exit, block->accel);
+
+            next = &planner_buf[planner_index(tail + k + 1)];
+            pair = exit != 0 && !(next->built && next->entry == exit);
+            if (pair) {
+                // The planned exit only holds if the block after is built
+                // to take it.
+                next_exit = 0;
+                if (k + 2 < count) {
+                    after = &planner_buf[planner_index(tail + k + 2)];
+                    if ((after->built && after->entry == entry[k+2]) || planner_reach(0, next->accel, next->len) < exit) {
+                        next_exit = entry[k+2];
+                    }
+                }
+                stepper_segment_init(&next_seg, next->dx, next->dy, next->len, exit, next->nominal, next_exit, next->accel);
+            }
+
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                if (planner_tail != tail) {
+                    // A block was started meanwhile, plan again from there.
+                    retry = true;
+                } else {
+                    block->seg = seg;
+                    block->entry = entry[k];
+                    block->exit = exit;
+                    block->built = true;
+                    if (pair) {
+                        next->seg = next_seg;
+                        next->entry = exit;
+                        next->exit = next_exit;
+                        next->built = true;
+                    }
+                }
+            }
+        }
+    }
+
+    if (planner_count) {
+        stepper_start_segments();
+    }
+}
+
+
+// Called from the stepper ISR when a segment ends. Returns the next segment
+// to run, or NULL if there is none ready. A block is only handed out if it
+// enters at the exit of the segment that ended, see planner_update().
+const struct stepper_segment *planner_next()
+{
+    const struct stepper_segment *res = NULL;
+    struct planner_block *block = &planner_buf[planner_tail];
+
+    if (planner_count && block->built && block->entry == planner_locked_exit) {
+        res = &block->seg;
+        planner_locked_exit = block->exit;
+        planner_tail = planner_index(planner_tail + 1);
+        planner_count--;
+    } else {
+        // The steppers stop, anything left has to start from standstill.
+        planner_locked_exit = 0;
+        planner_dirty = true;
+    }
+
+    return res;
+}
+
+
+void planner_init()
+{
+    planner_tail = 0;
+    planner_count = 0;
+    planner_locked_exit = 0;
+    planner_dirty = false;
+}
@@ -0,0 +1,47 @@
+/*
+planner.h - Look-ahead planner for coordinated two axis segments.
+Copyright (C) 2013 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This file is part of the TwoStep firmware.
+
+Lasershark is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Lasershark is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef PLANNER_H_
+#define PLANNER_H_
+
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "stepper.h"
+
+
+#define PLANNER_BUF_LEN 6
+
+// How far the path may deviate from a sharp corner, in steps. Larger values
+// make corners faster.
+#define PLANNER_JUNCTION_DEVIATION 4
+
+
+bool planner_add_line(int32_t dx, int32_t dy, uint16_t speed);
+bool planner_get_free(uint8_t *free);
+void planner_flush();
+
+void planner_update();
+const struct stepper_segment *planner_next();
+
+void planner_init();
+
+
+#endif
@@ -0,0 +1,50 @@
+// Generated by ramp_table.py, do not edit.
+
+#ifndef RAMP_TABLE_H_
+#define RAMP_TABLE_H_
+
+
+#include <avr/pgmspace.h>
+#include <stdint.h>
+
+
+#define RAMP_TABLE_LEN 16
+#define RAMP_TABLE_SEG_BITS 5
+#define RAMP_TABLE_SEGS 32
+#define RAMP_TABLE_SHIFT 5
+#define RAMP_PRESET_NUM 8
+
+static const uint16_t ramp_table[RAMP_TABLE_LEN] PROGMEM = {
+    32768, 13573, 10415,  8780,  7735,  6993,  6431,  5986,
+     5622,  5318,  5058,  4833,  4635,  4460,  4303,  4162,
+};
+
+// Segment ends of 1 / sqrt(1 + t) and 1 / sqrt(2 * (1 + t)), 0 <= t <= 1.
+static const uint16_t ramp_table_octave[2][RAMP_TABLE_SEGS + 1] PROGMEM = {
+    {
+        32768, 32268, 31790, 31332, 30894, 30474, 30070, 29682,
+        29309, 28949, 28602, 28268, 27945, 27632, 27330, 27038,
+        26755, 26481, 26214, 25956, 25705, 25462, 25225, 24994,
+        24770, 24552, 24339, 24132, 23930, 23733, 23541, 23354,
+        23170,
+    },
+    {
+        23170, 22817, 22479, 22155, 21845, 21548, 21263, 20988,
+        20724, 20470, 20225, 19988, 19760, 19539, 19326, 19119,
+        18919, 18725, 18536, 18354, 18176, 18004, 17837, 17674,
+        17515, 17361, 17211, 17064, 16921, 16782, 16646, 16514,
+        16384,
+    },
+};
+
+// Acceleration of each preset in steps/s^2, and its delay scale.
+static const uint16_t ramp_preset_accel[RAMP_PRESET_NUM] PROGMEM = {
+    500, 1000, 2000, 4000, 8000, 16000, 32000, 64000,
+};
+
+static const uint16_t ramp_preset_scale[RAMP_PRESET_NUM] PROGMEM = {
+    63246, 44721, 31623, 22361, 15811, 11180, 7906, 5590,
+};
+
+
+#endif
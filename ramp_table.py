@@ -0,0 +1,148 @@
+#!/usr/bin/env python
+#
+# ramp_table.py - Generates ramp_table.h, the acceleration delay table.
+# Copyright (C) 2013 Jeffrey Nelson <nelsonjm@macpod.net>
+#
+# This file is part of the TwoStep firmware.
+#
+# Lasershark is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 2 of the License, or
+# (at your option) any later version.
+#
+# Lasershark is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
+#
+# Run before each build, see twostep_firmware.cbp. Step n of a ramp from
+# standstill at accel steps/s^2 takes
+#
+#   c(n) = f * sqrt(2 / accel) * (sqrt(n + 1) - sqrt(n))
+#
+# timer ticks. Each preset holds f * sqrt(2 / accel) / 4 as its scale. The
+# first RAMP_TABLE_LEN steps come from a table of sqrt(n + 1) - sqrt(n) as
+# Q1.15. Past those sqrt(n + 1) - sqrt(n) is 1 / sqrt(2 * x) with
+# x = 2 * n + 1, to within 1e-5. Writing x as 2^k * (1 + t), that is
+# 2^-((k + 1) / 2) / sqrt(1 + t) for an odd k, and the same over sqrt(2)
+# for an even one. The octave table holds both over 0 <= t <= 1 in
+# 2^SEG_BITS segments, the firmware picks the segment by the bits after the
+# leading one of x and interpolates between its ends with the 7 bits after
+# those. The table value
+# times the scale, shifted right by RAMP_TABLE_SHIFT plus the octave, is
+# c(n) as a Q24.8 delay.
+
+import math
+import os
+
+TIMER_FREQ = 4000000
+TABLE_LEN = 16
+TABLE_ONE = 1 << 15
+SEG_BITS = 5
+SEGS = 1 << SEG_BITS
+SHIFT = 5
+PRESETS = [500 << k for k in range(8)]
+
+# Largest error of a delay from the table against the exact c(n), checked
+# below in the integer math of stepper_ramp_table_delay().
+MAX_ERROR = 0.001
+
+path = os.path.join(os.path.dirname(os.path.abspath(__file__)), 'ramp_table.h')
+
+table = [int(round(TABLE_ONE * (math.sqrt(n + 1) - math.sqrt(n)))) for n in range(TABLE_LEN)]
+octave = [[int(round(TABLE_ONE / math.sqrt((1 + odd) * (1.0 + float(j) / SEGS)))) for j in range(SEGS + 1)]
+          for odd in range(2)]
+scales = [int(round(TIMER_FREQ * math.sqrt(2.0 / a) / 4)) for a in PRESETS]
+assert max(scales) <= 0xffff
+# The interpolation is done in 16 bits.
+assert max(o[j] - o[j + 1] for o in octave for j in range(SEGS)) * 0x7f <= 0xffff
+
+
+def delay(scale, n):
+    # Same integer math as stepper_ramp_table_delay().
+    if n < TABLE_LEN:
+        return (table[n] * scale) >> SHIFT
+    x = 2 * n + 1
+    shift = SHIFT + 16
+    odd = 0
+    for bits in (16, 8, 4, 2):
+        if x < 1 << (32 - bits):
+            x <<= bits
+            shift -= bits >> 1
+    if x < 1 << 31:
+        x <<= 1
+        shift -= 1
+        odd = 1
+    j = (x >> (31 - SEG_BITS)) & (SEGS - 1)
+    frac = (x >> (24 - SEG_BITS)) & 0x7f
+    a = octave[odd][j]
+    b = octave[odd][j + 1]
+    return ((a - (((a - b) * frac) >> 7)) * scale) >> shift
+
+
+def check():
+    steps = list(range(4096)) + [int(1.01 ** k) for k in range(2160)] + [(1 << 31) - 1]
+    for scale in scales:
+        for n in steps:
+            exact = scale * 4 * 256 * (math.sqrt(n + 1) - math.sqrt(n))
+            # The last few delays are small enough that 1/256 tick matters.
+            assert abs(delay(scale, n) - exact) <= max(MAX_ERROR * exact, 2), (scale, n)
+
+
+check()
+
+out = []
+out.append('// Generated by ramp_table.py, do not edit.')
+out.append('')
+out.append('#ifndef RAMP_TABLE_H_')
+out.append('#define RAMP_TABLE_H_')
+out.append('')
+out.append('')
+out.append('#include <avr/pgmspace.h>')
+out.append('#include <stdint.h>')
+out.append('')
+out.append('')
+out.append('#define RAMP_TABLE_LEN %d' % TABLE_LEN)
+out.append('#define RAMP_TABLE_SEG_BITS %d' % SEG_BITS)
+out.append('#define RAMP_TABLE_SEGS %d' % SEGS)
+out.append('#define RAMP_TABLE_SHIFT %d' % SHIFT)
+out.append('#define RAMP_PRESET_NUM %d' % len(PRESETS))
+out.append('')
+out.append('static const uint16_t ramp_table[RAMP_TABLE_LEN] PROGMEM = {')
+for k in range(0, TABLE_LEN, 8):
+    out.append('    ' + ' '.join('%5d,' % v for v in table[k:k + 8]))
+out.append('};')
+out.append('')
+out.append('// Segment ends of 1 / sqrt(1 + t) and 1 / sqrt(2 * (1 + t)), 0 <= t <= 1.')
+out.append('static const uint16_t ramp_table_octave[2][RAMP_TABLE_SEGS + 1] PROGMEM = {')
+for odd in range(2):
+    out.append('    {')
+    for k in range(0, SEGS + 1, 8):
+        out.append('        ' + ' '.join('%5d,' % v for v in octave[odd][k:k + 8]))
+    out.append('    },')
+out.append('};')
+out.append('')
+out.append('// Acceleration of each preset in steps/s^2, and its delay scale.')
+out.append('static const uint16_t ramp_preset_accel[RAMP_PRESET_NUM] PROGMEM = {')
+out.append('    ' + ' '.join('%d,' % a for a in PRESETS))
+out.append('};')
+out.append('')
+out.append('static const uint16_t ramp_preset_scale[RAMP_PRESET_NUM] PROGMEM = {')
+out.append('    ' + ' '.join('%d,' % s for s in scales))
+out.append('};')
+out.append('')
+out.append('')
+out.append('#endif')
+
+text = '\n'.join(out) + '\n'
+old = None
+if os.path.exists(path):
+    with open(path) as f:
+        old = f.read()
+if text != old:
+    # Only touched when it changes, so it doesn't force a rebuild.
+    with open(path, 'w') as f:
+        f.write(text)
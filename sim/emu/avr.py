@@ -0,0 +1,525 @@
+"""Minimal AVR XMEGA core for cycle counting of linked clang-AVR firmware.
+
+Cycle costs follow the AVRxm column of the AVR instruction set manual,
+with the extra cycle for loads from internal SRAM.
+"""
+import os, struct, subprocess
+
+SRAM_START = 0x2000
+SRAM_END = 0x2800
+
+
+class Elf:
+    def __init__(self, path):
+        data = open(path, 'rb').read()
+        self.flash = bytearray(0x20000)
+        self.sram_init = {}
+        shoff = struct.unpack_from('<I', data, 0x20)[0]
+        shentsize, shnum, shstrndx = struct.unpack_from('<HHH', data, 0x2e)
+        secs = []
+        for i in range(shnum):
+            name, typ, flags, addr, off, size = struct.unpack_from('<IIIIII', data, shoff + i * shentsize)
+            secs.append((name, typ, flags, addr, off, size))
+        strtab_off = secs[shstrndx][4]
+        def nm(o):
+            e = data.index(b'\0', strtab_off + o)
+            return data[strtab_off + o:e].decode()
+        self.syms = {}
+        for name, typ, flags, addr, off, size in secs:
+            n = nm(name)
+            if n == '.text':
+                self.flash[addr:addr + size] = data[off:off + size]
+            elif n == '.data':
+                # What __do_copy_data would copy at start-up.
+                for k in range(size):
+                    self.sram_init[(addr & 0xffff) + k] = data[off + k]
+        out = subprocess.run([os.environ.get('LLVM_NM', 'llvm-nm'), path], capture_output=True, text=True).stdout
+        for l in out.splitlines():
+            p = l.split()
+            if len(p) == 3:
+                self.syms[p[2]] = int(p[0], 16)
+
+
+def s8(v):
+    return v - 256 if v & 0x80 else v
+
+
+class AVR:
+    def __init__(self, elf):
+        self.elf = elf
+        self.fl = elf.flash
+        self.r = [0] * 32
+        self.mem = bytearray(0x10000)
+        self.pc = 0
+        self.cyc = 0
+        self.sreg = 0
+        self.sp = SRAM_END - 1
+        self.min_sp = self.sp
+        self.decode_cache = {}
+        self.read_hooks = {}
+        self.write_hooks = {}
+        self.calls = {}   # word address -> python function (stubbed calls)
+        for port in (0x600, 0x640, 0x660, 0x7E0):
+            self._port(port)
+        self.mem[0x608] = 0xf0  # switches released
+        for a, v in elf.sram_init.items():
+            self.mem[a] = v
+
+    def _port(self, base):
+        def setf(reg, op):
+            def w(v):
+                cur = self.mem[base + reg]
+                self.mem[base + reg] = op(cur, v) & 0xff
+            return w
+        self.write_hooks[base + 1] = setf(0, lambda c, v: c | v)
+        self.write_hooks[base + 2] = setf(0, lambda c, v: c & ~v)
+        self.write_hooks[base + 3] = setf(0, lambda c, v: c ^ v)
+        self.write_hooks[base + 5] = setf(4, lambda c, v: c | v)
+        self.write_hooks[base + 6] = setf(4, lambda c, v: c & ~v)
+        self.write_hooks[base + 7] = setf(4, lambda c, v: c ^ v)
+
+    # data space
+    def rd(self, a):
+        a &= 0xffff
+        if a == 0x3d:
+            return self.sp & 0xff
+        if a == 0x3e:
+            return self.sp >> 8
+        if a == 0x3f:
+            return self.sreg
+        h = self.read_hooks.get(a)
+        if h:
+            return h()
+        return self.mem[a]
+
+    def wr(self, a, v):
+        a &= 0xffff
+        v &= 0xff
+        if a == 0x3d:
+            self.sp = (self.sp & 0xff00) | v
+            return
+        if a == 0x3e:
+            self.sp = (self.sp & 0xff) | (v << 8)
+            return
+        if a == 0x3f:
+            self.sreg = v
+            return
+        h = self.write_hooks.get(a)
+        if h:
+            h(v)
+            return
+        self.mem[a] = v
+
+    def push(self, v):
+        self.mem[self.sp] = v & 0xff
+        self.sp -= 1
+        if self.sp < self.min_sp:
+            self.min_sp = self.sp
+
+    def pop(self):
+        self.sp += 1
+        return self.mem[self.sp]
+
+    def word(self, pc):
+        return self.fl[2 * pc] | (self.fl[2 * pc + 1] << 8)
+
+    # flags
+    C, Z, N, V, S, H, T, I = 1, 2, 4, 8, 16, 32, 64, 128
+
+    def setf(self, f, on):
+        if on:
+            self.sreg |= f
+        else:
+            self.sreg &= ~f
+
+    def flg(self, f):
+        return 1 if self.sreg & f else 0
+
+    def nzs(self, res, v):
+        n = (res >> 7) & 1
+        self.setf(self.N, n)
+        self.setf(self.Z, res == 0)
+        self.setf(self.V, v)
+        self.setf(self.S, n ^ v)
+
+    def add(self, d, r, c):
+        res = (d + r + c) & 0xff
+        self.setf(self.H, ((d & 0xf) + (r & 0xf) + c) > 0xf)
+        self.setf(self.C, d + r + c > 0xff)
+        v = ((d ^ res) & (r ^ res) & 0x80) != 0
+        self.nzs(res, v)
+        return res
+
+    def sub(self, d, r, c, keepz=False):
+        res = (d - r - c) & 0xff
+        self.setf(self.H, ((d & 0xf) - (r & 0xf) - c) < 0)
+        self.setf(self.C, d - r - c < 0)
+        v = ((d ^ r) & (d ^ res) & 0x80) != 0
+        z = self.sreg & self.Z
+        self.nzs(res, v)
+        if keepz:
+            self.setf(self.Z, res == 0 and z)
+        return res
+
+    def logic(self, res):
+        self.nzs(res, 0)
+        return res
+
+    def skiplen(self, pc):
+        w = self.word(pc)
+        if (w & 0xfe0e) in (0x940c, 0x940e) or (w & 0xfc0f) in (0x9000, 0x9200):
+            return 2
+        return 1
+
+    def call_fn(self, addr_bytes, regs=None, limit=10 ** 8):
+        """Calls a function at a byte address, returns cycles taken."""
+        if regs:
+            for k, v in regs.items():
+                self.r[k] = v & 0xff
+        ret = 0x1fffe // 2
+        self.push(ret & 0xff)
+        self.push(ret >> 8)
+        self.pc = addr_bytes // 2
+        start = self.cyc
+        self.run_until(ret, limit)
+        return self.cyc - start
+
+    def isr(self, name):
+        """Runs an interrupt handler, with the 5 cycle response; returns cycles."""
+        c = self.call_fn(self.elf.syms[name])
+        return c + 5  # call_fn charges no CALL, the RETI is counted
+
+    def run_until(self, ret, limit):
+        n = 0
+        while self.pc != ret:
+            self.step()
+            n += 1
+            if n > limit:
+                raise RuntimeError('limit at pc %x' % (2 * self.pc))
+
+    def step(self):
+        pc = self.pc
+        w = self.word(pc)
+        r = self.r
+        cyc = 1
+        npc = pc + 1
+        hi4 = w >> 12
+        d5 = (w >> 4) & 0x1f
+        r5 = (w & 0xf) | ((w >> 5) & 0x10)
+        if w == 0:
+            pass  # nop
+        elif (w & 0xff00) == 0x0100:  # movw
+            d = ((w >> 4) & 0xf) * 2
+            s = (w & 0xf) * 2
+            r[d], r[d + 1] = r[s], r[s + 1]
+        elif (w & 0xff00) == 0x0200:  # muls
+            d = 16 + ((w >> 4) & 0xf)
+            s = 16 + (w & 0xf)
+            res = (s8(r[d]) * s8(r[s])) & 0xffff
+            r[0], r[1] = res & 0xff, res >> 8
+            self.setf(self.C, res & 0x8000)
+            self.setf(self.Z, res == 0)
+            cyc = 2
+        elif (w & 0xff88) == 0x0300:  # mulsu
+            d = 16 + ((w >> 4) & 7)
+            s = 16 + (w & 7)
+            res = (s8(r[d]) * r[s]) & 0xffff
+            r[0], r[1] = res & 0xff, res >> 8
+            self.setf(self.C, res & 0x8000)
+            self.setf(self.Z, res == 0)
+            cyc = 2
+        elif (w & 0xff00) == 0x0300:  # fmul family
+            d = 16 + ((w >> 4) & 7)
+            s = 16 + (w & 7)
+            k = w & 0x88
+            a, b = r[d], r[s]
+            if k == 0x80:
+                a, b = s8(a), s8(b)
+            elif k == 0x88:
+                a = s8(a)
+            res = (a * b) & 0xffff
+            self.setf(self.C, res & 0x8000)
+            res = (res << 1) & 0xffff
+            r[0], r[1] = res & 0xff, res >> 8
+            self.setf(self.Z, res == 0)
+            cyc = 2
+        elif (w & 0xfc00) == 0x0400:  # cpc
+            self.sub(r[d5], r[r5], self.flg(self.C), True)
+        elif (w & 0xfc00) == 0x0800:  # sbc
+            r[d5] = self.sub(r[d5], r[r5], self.flg(self.C), True)
+        elif (w & 0xfc00) == 0x0c00:  # add
+            r[d5] = self.add(r[d5], r[r5], 0)
+        elif (w & 0xfc00) == 0x1000:  # cpse
+            if r[d5] == r[r5]:
+                k = self.skiplen(pc + 1)
+                npc += k
+                cyc += k
+        elif (w & 0xfc00) == 0x1400:  # cp
+            self.sub(r[d5], r[r5], 0)
+        elif (w & 0xfc00) == 0x1800:  # sub
+            r[d5] = self.sub(r[d5], r[r5], 0)
+        elif (w & 0xfc00) == 0x1c00:  # adc
+            r[d5] = self.add(r[d5], r[r5], self.flg(self.C))
+        elif (w & 0xfc00) == 0x2000:  # and
+            r[d5] = self.logic(r[d5] & r[r5])
+        elif (w & 0xfc00) == 0x2400:  # eor
+            r[d5] = self.logic(r[d5] ^ r[r5])
+        elif (w & 0xfc00) == 0x2800:  # or
+            r[d5] = self.logic(r[d5] | r[r5])
+        elif (w & 0xfc00) == 0x2c00:  # mov
+            r[d5] = r[r5]
+        elif hi4 in (3, 4, 5, 6, 7, 0xe):
+            d = 16 + ((w >> 4) & 0xf)
+            k = ((w >> 4) & 0xf0) | (w & 0xf)
+            if hi4 == 3:
+                self.sub(r[d], k, 0)
+            elif hi4 == 4:
+                r[d] = self.sub(r[d], k, self.flg(self.C), True)
+            elif hi4 == 5:
+                r[d] = self.sub(r[d], k, 0)
+            elif hi4 == 6:
+                r[d] = self.logic(r[d] | k)
+            elif hi4 == 7:
+                r[d] = self.logic(r[d] & k)
+            else:
+                r[d] = k
+        elif (w & 0xd000) == 0x8000:  # ldd/std y/z + q
+            q = (w & 7) | ((w >> 7) & 0x18) | ((w >> 8) & 0x20)
+            base = 28 if w & 8 else 30
+            a = (r[base] | (r[base + 1] << 8)) + q
+            if w & 0x200:
+                self.wr(a, r[d5])
+                cyc = 1 if q == 0 else 2
+            else:
+                r[d5] = self.rd(a)
+                cyc = (1 if q == 0 else 2) + (1 if a >= SRAM_START else 0)
+        elif (w & 0xfc00) == 0x9000 or (w & 0xfc00) == 0x9200:
+            store = w & 0x200
+            op = w & 0xf
+            if op == 0:  # lds/sts
+                a = self.word(pc + 1)
+                npc += 1
+                if store:
+                    self.wr(a, r[d5])
+                    cyc = 2
+                else:
+                    r[d5] = self.rd(a)
+                    cyc = 2 + (1 if a >= SRAM_START else 0)
+            elif op in (4, 5, 6, 7) and not store:  # lpm/elpm z
+                z = r[30] | (r[31] << 8)
+                if op in (6, 7):
+                    z |= self.mem[0x3b] << 16
+                r[d5] = self.fl[z]
+                if op in (5, 7):
+                    z += 1
+                    r[30], r[31] = z & 0xff, (z >> 8) & 0xff
+                    if op == 7:
+                        self.mem[0x3b] = (z >> 16) & 0xff
+                cyc = 3
+            elif op == 0xf:  # push/pop
+                if store:
+                    self.push(r[d5])
+                    cyc = 1
+                else:
+                    r[d5] = self.pop()
+                    cyc = 2
+            else:
+                if op in (1, 2):
+                    base = 30
+                elif op in (9, 0xa):
+                    base = 28
+                elif op in (0xc, 0xd, 0xe):
+                    base = 26
+                else:
+                    base = 28
+                a = r[base] | (r[base + 1] << 8)
+                if op in (2, 0xa, 0xe):
+                    a = (a - 1) & 0xffff
+                if store:
+                    self.wr(a, r[d5])
+                    cyc = 1 if op in (0xc, 0xd, 1, 9) else 2
+                else:
+                    r[d5] = self.rd(a)
+                    cyc = (1 if op in (0xc, 0xd, 1, 9) else 2) + (1 if a >= SRAM_START else 0)
+                if op in (1, 9, 0xd):
+                    a = (a + 1) & 0xffff
+                if op in (1, 2, 9, 0xa, 0xd, 0xe):
+                    r[base], r[base + 1] = a & 0xff, a >> 8
+        elif (w & 0xfe08) == 0x9400 and (w & 0xf) < 8 or (w & 0xfe0f) == 0x940a:
+            op = w & 0xf
+            v = r[d5]
+            if op == 0:  # com
+                res = (~v) & 0xff
+                self.nzs(res, 0)
+                self.setf(self.C, 1)
+            elif op == 1:  # neg
+                res = (-v) & 0xff
+                self.setf(self.H, ((res | v) & 8) != 0)
+                self.setf(self.C, res != 0)
+                self.nzs(res, res == 0x80)
+            elif op == 2:  # swap
+                res = ((v << 4) | (v >> 4)) & 0xff
+            elif op == 3:  # inc
+                res = (v + 1) & 0xff
+                self.nzs(res, v == 0x7f)
+            elif op == 5:  # asr
+                res = (v >> 1) | (v & 0x80)
+                c = v & 1
+                self.setf(self.C, c)
+                n = res >> 7
+                self.nzs(res, n ^ c)
+            elif op == 6:  # lsr
+                res = v >> 1
+                c = v & 1
+                self.setf(self.C, c)
+                self.nzs(res, c)
+            elif op == 7:  # ror
+                res = (v >> 1) | (self.flg(self.C) << 7)
+                c = v & 1
+                self.setf(self.C, c)
+                n = res >> 7
+                self.nzs(res, n ^ c)
+            elif op == 0xa:  # dec
+                res = (v - 1) & 0xff
+                self.nzs(res, v == 0x80)
+            else:
+                raise RuntimeError('op %04x at %x' % (w, 2 * pc))
+            r[d5] = res
+        elif (w & 0xff8f) == 0x9408:  # bset
+            self.sreg |= 1 << ((w >> 4) & 7)
+        elif (w & 0xff8f) == 0x9488:  # bclr
+            self.sreg &= ~(1 << ((w >> 4) & 7))
+        elif w == 0x9508:  # ret
+            hi = self.pop()
+            lo = self.pop()
+            npc = (hi << 8) | lo
+            cyc = 4
+        elif w == 0x9518:  # reti
+            hi = self.pop()
+            lo = self.pop()
+            npc = (hi << 8) | lo
+            cyc = 4
+        elif w in (0x9588, 0x95a8, 0x9598):  # sleep, wdr, break
+            pass
+        elif w == 0x95c8:  # lpm r0
+            z = r[30] | (r[31] << 8)
+            r[0] = self.fl[z]
+            cyc = 3
+        elif w == 0x9409:  # ijmp
+            npc = r[30] | (r[31] << 8)
+            cyc = 2
+        elif w == 0x9509:  # icall
+            ret = pc + 1
+            self.push(ret & 0xff)
+            self.push(ret >> 8)
+            npc = r[30] | (r[31] << 8)
+            cyc = 2
+        elif (w & 0xfe0e) == 0x940c:  # jmp
+            npc = ((((w >> 3) & 0x3e) | (w & 1)) << 16) | self.word(pc + 1)
+            cyc = 3
+        elif (w & 0xfe0e) == 0x940e:  # call
+            tgt = ((((w >> 3) & 0x3e) | (w & 1)) << 16) | self.word(pc + 1)
+            ret = pc + 2
+            if tgt in self.calls:
+                cyc = self.calls[tgt](self)
+            else:
+                self.push(ret & 0xff)
+                self.push(ret >> 8)
+                npc = tgt
+                cyc = 3
+        elif (w & 0xff00) == 0x9600:  # adiw
+            d = 24 + ((w >> 3) & 6)
+            k = ((w >> 2) & 0x30) | (w & 0xf)
+            v = r[d] | (r[d + 1] << 8)
+            res = (v + k) & 0xffff
+            r[d], r[d + 1] = res & 0xff, res >> 8
+            self.setf(self.C, v + k > 0xffff)
+            self.setf(self.Z, res == 0)
+            n = res >> 15
+            vv = (~v & res & 0x8000) != 0
+            self.setf(self.N, n)
+            self.setf(self.V, vv)
+            self.setf(self.S, n ^ vv)
+            cyc = 2
+        elif (w & 0xff00) == 0x9700:  # sbiw
+            d = 24 + ((w >> 3) & 6)
+            k = ((w >> 2) & 0x30) | (w & 0xf)
+            v = r[d] | (r[d + 1] << 8)
+            res = (v - k) & 0xffff
+            r[d], r[d + 1] = res & 0xff, res >> 8
+            self.setf(self.C, v < k)
+            self.setf(self.Z, res == 0)
+            n = res >> 15
+            vv = (v & ~res & 0x8000) != 0
+            self.setf(self.N, n)
+            self.setf(self.V, vv)
+            self.setf(self.S, n ^ vv)
+            cyc = 2
+        elif (w & 0xfc00) == 0x9800:  # cbi sbic sbi sbis
+            a = (w >> 3) & 0x1f
+            b = w & 7
+            op = (w >> 8) & 3
+            if op == 0:
+                self.wr(a, self.rd(a) & ~(1 << b))
+            elif op == 2:
+                self.wr(a, self.rd(a) | (1 << b))
+            else:
+                bit = (self.rd(a) >> b) & 1
+                cyc = 2
+                if bit == (op == 3):
+                    k = self.skiplen(pc + 1)
+                    npc += k
+                    cyc += k
+        elif (w & 0xfc00) == 0x9c00:  # mul
+            res = r[d5] * r[r5]
+            r[0], r[1] = res & 0xff, res >> 8
+            self.setf(self.C, res & 0x8000)
+            self.setf(self.Z, res == 0)
+            cyc = 2
+        elif (w & 0xf800) == 0xb000:  # in
+            a = (w & 0xf) | ((w >> 5) & 0x30)
+            r[d5] = self.rd(a)
+        elif (w & 0xf800) == 0xb800:  # out
+            a = (w & 0xf) | ((w >> 5) & 0x30)
+            self.wr(a, r[d5])
+        elif hi4 == 0xc:  # rjmp
+            k = w & 0xfff
+            if k & 0x800:
+                k -= 0x1000
+            npc = pc + 1 + k
+            cyc = 2
+        elif hi4 == 0xd:  # rcall
+            k = w & 0xfff
+            if k & 0x800:
+                k -= 0x1000
+            ret = pc + 1
+            self.push(ret & 0xff)
+            self.push(ret >> 8)
+            npc = pc + 1 + k
+            cyc = 2
+        elif (w & 0xf800) == 0xf000:  # brbs / brbc
+            k = (w >> 3) & 0x7f
+            if k & 0x40:
+                k -= 0x80
+            bit = (self.sreg >> (w & 7)) & 1
+            if bit == (0 if w & 0x400 else 1):
+                npc = pc + 1 + k
+                cyc = 2
+        elif (w & 0xfe08) == 0xf800:  # bld
+            b = w & 7
+            if self.sreg & self.T:
+                r[d5] |= 1 << b
+            else:
+                r[d5] &= ~(1 << b)
+        elif (w & 0xfe08) == 0xfa00:  # bst
+            self.setf(self.T, (r[d5] >> (w & 7)) & 1)
+        elif (w & 0xfc08) == 0xfc00:  # sbrc / sbrs
+            bit = (r[d5] >> (w & 7)) & 1
+            if bit == (1 if w & 0x200 else 0):
+                k = self.skiplen(pc + 1)
+                npc += k
+                cyc += k
+        else:
+            raise RuntimeError('unknown %04x at %x' % (w, 2 * pc))
+        self.pc = npc
+        self.cyc += cyc
@@ -0,0 +1,88 @@
+"""footprint.py [tree] : compiler warnings, flash and SRAM use and the stack
+depth of main and each interrupt, from the call graph of the clang-AVR
+build. Calls through pointers are not followed and show up as <icall>."""
+import glob, os, re, subprocess, sys, tempfile
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from fw import cc, build, tree_arg, NAMES, EMU
+
+FLASH = 16384
+SRAM = 2048
+
+tree = tree_arg()
+od = tempfile.mkdtemp()
+su = {}
+calls = {}
+for f in sorted(glob.glob(os.path.join(tree, '*.c'))):
+    b = os.path.join(od, os.path.basename(f)[:-2])
+    warnings = cc(f, b + '.o', ['-stack-usage-file', b + '.su'])
+    if warnings:
+        sys.stdout.write(warnings)
+    cc(f, b + '.s', ['-S'])
+    for l in open(b + '.su'):
+        p = l.split('\t')
+        su[p[0].split(':')[-1]] = int(p[1])
+    cur = None
+    for l in open(b + '.s'):
+        m = re.match(r'^([A-Za-z_]\w*):', l)
+        if m:
+            cur = m.group(1)
+            calls.setdefault(cur, set())
+            continue
+        m = re.match(r'\s+r?call\s+([\w.$]+)', l)
+        if m and cur:
+            calls[cur].add(m.group(1).replace('$local', ''))
+        if re.match(r'\s+e?icall', l) and cur:
+            calls[cur].add('<icall>')
+
+elf = build(tree, os.path.join(od, 'fw.elf'))
+sizes = {}
+for l in subprocess.run([os.environ.get('LLVM_SIZE', 'llvm-size'), '-A', elf],
+                        capture_output=True, text=True).stdout.splitlines():
+    p = l.split()
+    if len(p) >= 2 and p[0].startswith('.'):
+        sizes[p[0]] = int(p[1])
+# Constant tables outside PROGMEM live in SRAM on the AVR, copied at start-up
+# like .data, but this link script leaves them in .text.
+rodata = 0
+for o in glob.glob(os.path.join(od, '*.o')):
+    for l in subprocess.run([os.environ.get('LLVM_SIZE', 'llvm-size'), '-A', o],
+                            capture_output=True, text=True).stdout.splitlines():
+        p = l.split()
+        if len(p) >= 2 and p[0].startswith('.rodata'):
+            rodata += int(p[1])
+
+memo = {}
+
+
+def depth(fn, stack=()):
+    """Deepest stack below fn in bytes, and the call chain to it."""
+    if fn in stack:
+        return (0, [fn + '(recursion)'])
+    if fn in memo:
+        return memo[fn]
+    best = (0, [])
+    for c in calls.get(fn, ()):
+        d, p = depth(c, stack + (fn,))
+        d += 2  # return address
+        if d > best[0]:
+            best = (d, p)
+    r = (su.get(fn, 0) + best[0], [fn] + best[1])
+    memo[fn] = r
+    return r
+
+
+data = sizes.get('.data', 0)
+bss = sizes.get('.bss', 0)
+print('flash: %d of %d bytes, text %d, data %d' % (sizes.get('.text', 0) + data, FLASH, sizes.get('.text', 0), data))
+print('static SRAM: %d bytes, bss %d, data %d, rodata %d' % (bss + data + rodata, bss, data, rodata))
+main, chain = depth('main')
+print('stack main: %d  %s' % (main, ' > '.join(chain)))
+isr = 0
+for v in sorted(set(calls) & set(NAMES), key=lambda v: int(v.split('_')[-1])):
+    # The interrupt pushes its return address before the handler runs.
+    d, chain = depth(v)
+    d += 2
+    isr = max(isr, d)
+    print('stack %s: %d  %s' % (NAMES[v], d, ' > '.join(chain)))
+print('SRAM spare: %d bytes, main plus the deepest interrupt, they never nest' %
+      (SRAM - bss - data - rodata - main - isr))
@@ -0,0 +1,184 @@
+"""Builds the firmware of a tree with clang-AVR and runs it on the core in avr.py.
+
+The compiler is clang's -cc1 front end with the AVR target, $CLANG or clang
+on the path, the linker $LLD or ld.lld and the assembler $LLVM_MC or llvm-mc.
+The code is clang's, not avr-gcc's, so cycle counts and sizes are estimates
+of what the Code::Blocks build gives.
+"""
+import os, re, subprocess, glob, tempfile, sys
+from avr import Elf, AVR
+
+EMU = os.path.dirname(os.path.abspath(__file__))
+CLANG = os.environ.get('CLANG', 'clang')
+LLD = os.environ.get('LLD', 'ld.lld')
+LLVM_MC = os.environ.get('LLVM_MC', 'llvm-mc')
+
+CFLAGS = ['-triple', 'avr', '-target-cpu', 'atxmega16e5', '-emit-obj', '-Os', '-ffreestanding',
+          '-nostdsysteminc', '-nobuiltininc', '-I', os.path.join(EMU, 'include'),
+          '-DF_CPU=32000000UL', '-std=gnu99', '-fgnu89-inline', '-Wall', '-Wextra', '-fno-builtin',
+          '-ffunction-sections', '-fdata-sections']
+
+TCC4 = 0x800
+TCD5 = 0x940
+
+# Interrupt vectors by their avr-libc names, TCC4_CCA_vect and so on.
+VECTORS = dict(re.findall(r'#define (\w+_vect) (__vector_\d+)', open(os.path.join(EMU, 'include', 'avr', 'io.h')).read()))
+NAMES = dict((v, k) for k, v in VECTORS.items())
+
+
+def cc(src, obj, cflags=()):
+    """Compiles one C file, returns the warnings."""
+    p = subprocess.run([CLANG, '-cc1'] + CFLAGS + list(cflags) + ['-o', obj, src],
+                       capture_output=True, text=True)
+    if p.returncode:
+        sys.stderr.write(p.stderr)
+        raise RuntimeError('%s does not build' % src)
+    return p.stderr
+
+
+def build(tree, out, cflags=()):
+    """Builds tree into the ELF out, with any extra compiler flags."""
+    od = tempfile.mkdtemp()
+    objs = []
+    for f in sorted(glob.glob(os.path.join(tree, '*.c'))) + [os.path.join(EMU, 'libc.c')]:
+        o = os.path.join(od, os.path.basename(f)[:-2] + '.o')
+        cc(f, o, cflags)
+        objs.append(o)
+    rt = os.path.join(od, 'rt.o')
+    subprocess.run([LLVM_MC, '-triple', 'avr', '-mcpu', 'atxmega16e5', '-filetype', 'obj',
+                    '-o', rt, os.path.join(EMU, 'rt.S')], check=True)
+    subprocess.run([LLD, '-T', os.path.join(EMU, 'link.ld'), '--no-gc-sections', '-e', 'main',
+                    '-o', out] + objs + [rt], check=True)
+    return out
+
+
+class Machine(AVR):
+    """The core with the timers the firmware reads. TCC4 counts at CPU/8 and
+    TCD5 at the CPU clock, both from the cycle count. The interrupts run one
+    after the other, never nested, the way the firmware sets them up."""
+
+    def __init__(self, path):
+        AVR.__init__(self, Elf(path))
+        self.t_abs = 0
+        self.cyc_ref = 0
+        self.latch = {}
+        self.read_hooks[TCC4 + 0x20] = lambda: self._cnt_lo(TCC4, self.tcc4_cnt())
+        self.read_hooks[TCC4 + 0x21] = lambda: self.latch.get(TCC4, 0)
+        self.write_hooks[TCC4 + 0x20] = lambda v: self._cnt_wr(0, v)
+        self.write_hooks[TCC4 + 0x21] = lambda v: self._cnt_wr(1, v)
+        self.read_hooks[TCD5 + 0x20] = lambda: self._cnt_lo(TCD5, self.cyc & 0xffff)
+        self.read_hooks[TCD5 + 0x21] = lambda: self.latch.get(TCD5, 0)
+        self.mem[0x305] = 3      # DAC data registers empty
+        self.mem[0x9c1] = 0x60   # USART TX empty
+        self.mem[0x51] = 0xff    # oscillators ready
+        self.isr_cycles = {}
+        self.t_total = 0
+        self.t_last = 0
+
+    def _cnt_lo(self, tc, v):
+        self.latch[tc] = (v >> 8) & 0xff
+        return v & 0xff
+
+    def _cnt_wr(self, hi, v):
+        cur = self.tcc4_cnt()
+        if hi:
+            cur = (self.mem[TCC4 + 0x0f] | (v << 8))
+        else:
+            self.mem[TCC4 + 0x0f] = v
+            return
+        self.t_abs = cur
+        self.cyc_ref = self.cyc
+
+    def tcc4_cnt(self):
+        if self.mem[TCC4] & 0x0f:
+            return (self.t_abs + (self.cyc - self.cyc_ref) // 8) & 0xffff
+        return self.t_abs & 0xffff
+
+    def call(self, name, *args):
+        """Calls a C function, args as (value, bytes) pairs or ints (1 byte)."""
+        regs = {}
+        reg = 26
+        for a in args:
+            v, n = (a, 1) if isinstance(a, int) else a
+            reg -= (n + 1) & ~1
+            for k in range(n):
+                regs[reg + k] = (v >> (8 * k)) & 0xff
+        self.call_fn(self.elf.syms[name], regs)
+        return self.r[24] | (self.r[25] << 8)
+
+    def word16(self, a):
+        return self.mem[a] | (self.mem[a + 1] << 8)
+
+    def next_compare(self):
+        """The enabled TCC4 compare that comes next, as (ticks to it, vector)."""
+        ib = self.mem[TCC4 + 7]
+        now = self.tcc4_cnt()
+        best = None
+        for ch, vec in ((0, VECTORS['TCC4_CCA_vect']), (1, VECTORS['TCC4_CCB_vect']), (2, VECTORS['TCC4_CCC_vect'])):
+            if ib & (3 << (2 * ch)):
+                cc = self.word16(TCC4 + 0x28 + 2 * ch)
+                d = (cc - now) & 0xffff
+                if d >= 0x8000:
+                    # Came due while another ISR ran, pending.
+                    d = 0
+                if best is None or d < best[0]:
+                    best = (d, vec)
+        return best
+
+    def run_isrs(self, max_events=10 ** 6, hook=None):
+        """Runs the TCC4 compare interrupts in the order they come due, each
+        one's cycles into isr_cycles, until none is enabled. A compare that
+        came due while another ran is taken right after it."""
+        n = 0
+        while n < max_events:
+            nc = self.next_compare()
+            if nc is None:
+                break
+            d, vec = nc
+            now = self.tcc4_cnt()
+            self.t_total += ((now - self.t_last) & 0xffff) + d
+            self.t_abs = now + d
+            self.t_last = self.t_abs & 0xffff
+            self.cyc_ref = self.cyc
+            c = self.isr(vec)
+            self.isr_cycles.setdefault(vec, []).append(c)
+            if hook:
+                hook(self, vec, c)
+            n += 1
+        return n
+
+
+def boot(path):
+    """Loads an ELF and runs the init functions the way main() does, but
+    not the UART."""
+    m = Machine(path)
+    for f in ('perf_init', 'stepper_init', 'planner_init', 'switches_init'):
+        if f in m.elf.syms:
+            m.call(f)
+    return m
+
+
+def summary(vals):
+    """One line of cycle counts, min to max."""
+    vals = sorted(vals)
+    if not vals:
+        return 'none'
+    return 'n=%d min=%d median=%d p99=%d max=%d' % (len(vals), vals[0], vals[len(vals) // 2],
+                                                   vals[min(len(vals) - 1, len(vals) * 99 // 100)], vals[-1])
+
+
+def signed(v, n):
+    """A signed argument of n bytes for Machine.call()."""
+    return (v & ((1 << (8 * n)) - 1), n)
+
+
+def tree_arg(k=1):
+    """The tree named by argument k, by default the checkout sim/ is in."""
+    if len(sys.argv) > k:
+        return sys.argv[k]
+    return os.path.join(EMU, '..', '..')
+
+
+def build_tree(tree, cflags=()):
+    """Builds tree into a temporary ELF and returns its path."""
+    return build(tree, os.path.join(tempfile.mkdtemp(), 'fw.elf'), cflags)
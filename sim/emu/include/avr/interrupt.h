@@ -0,0 +1,6 @@
+#ifndef _AVR_INTERRUPT_H_
+#define _AVR_INTERRUPT_H_
+#define sei() __asm__ __volatile__ ("sei" ::: "memory")
+#define cli() __asm__ __volatile__ ("cli" ::: "memory")
+#define ISR(vector) void vector(void) __attribute__((signal, used)); void vector(void)
+#endif
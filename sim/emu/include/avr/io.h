@@ -0,0 +1,117 @@
+#ifndef _AVR_IO_H_
+#define _AVR_IO_H_
+/* ATxmega16E5 subset for the clang AVR backend: register layouts and
+   addresses as in avr-libc's iox16e5.h, only what the firmware uses. */
+#include <stdint.h>
+#define _SFR_MEM8(a) (*(volatile uint8_t *)(a))
+#define SREG _SFR_MEM8(0x3F)
+#define SPL _SFR_MEM8(0x3D)
+#define SPH _SFR_MEM8(0x3E)
+#define CCP _SFR_MEM8(0x34)
+#define RAMSTART 0x2000
+#define RAMEND 0x27FF
+typedef volatile uint8_t register8_t;
+typedef volatile uint16_t register16_t;
+typedef struct { register8_t CTRL, PSCTRL, LOCK, RTCCTRL; } CLK_t;
+typedef struct { register8_t CTRL; } SLEEP_t;
+typedef struct { register8_t CTRL, STATUS, XOSCCTRL, XOSCFAIL, RC32KCAL, PLLCTRL, DFLLCTRL, RC8MCAL; } OSC_t;
+typedef struct { register8_t STATUS, INTPRI, CTRL; } PMIC_t;
+typedef struct { register8_t CTRLA, CTRLB, CTRLC, EVCTRL, reserved_4, STATUS, reserved_6, reserved_7,
+    CH0GAINCAL, CH0OFFSETCAL, CH1GAINCAL, CH1OFFSETCAL, reserved_c[12]; register16_t CH0DATA, CH1DATA; } DAC_t;
+typedef struct { register8_t DIR, DIRSET, DIRCLR, DIRTGL, OUT, OUTSET, OUTCLR, OUTTGL, IN, INTCTRL, INTMASK,
+    reserved_b, INTFLAGS, reserved_d, REMAP, reserved_f, PIN0CTRL, PIN1CTRL, PIN2CTRL, PIN3CTRL, PIN4CTRL,
+    PIN5CTRL, PIN6CTRL, PIN7CTRL; } PORT_t;
+typedef struct { register8_t CTRLA, CTRLB, CTRLC, CTRLD, CTRLE, CTRLF, INTCTRLA, INTCTRLB, CTRLGCLR, CTRLGSET,
+    CTRLHCLR, CTRLHSET, INTFLAGS, reserved_d, reserved_e, TEMP, reserved_10[16]; register16_t CNT, reserved_22,
+    reserved_24, PER, CCA, CCB, CCC, CCD, reserved_30[3], PERBUF, CCABUF, CCBBUF, CCCBUF, CCDBUF; } TC4_t;
+typedef TC4_t TC5_t;
+typedef struct { register8_t DATA, STATUS, reserved_2, CTRLA, CTRLB, CTRLC, CTRLD, BAUDCTRLA, BAUDCTRLB; } USART_t;
+#define CLK (*(CLK_t *)0x0040)
+#define SLEEP (*(SLEEP_t *)0x0048)
+#define OSC (*(OSC_t *)0x0050)
+#define PMIC (*(PMIC_t *)0x00A0)
+#define DACA (*(DAC_t *)0x0300)
+#define PORTA (*(PORT_t *)0x0600)
+#define PORTC (*(PORT_t *)0x0640)
+#define PORTD (*(PORT_t *)0x0660)
+#define TCC4 (*(TC4_t *)0x0800)
+#define TCC5 (*(TC5_t *)0x0840)
+#define TCD5 (*(TC5_t *)0x0940)
+#define USARTD0 (*(USART_t *)0x09C0)
+#define PIN0_bm 0x01
+#define PIN1_bm 0x02
+#define PIN2_bm 0x04
+#define PIN3_bm 0x08
+#define PIN4_bm 0x10
+#define PIN5_bm 0x20
+#define PIN6_bm 0x40
+#define PIN7_bm 0x80
+#define CCP_IOREG_gc 0xD8
+#define CLK_SCLKSEL_gm 0x07
+#define CLK_SCLKSEL_PLL_gc 0x04
+#define OSC_RC2MEN_bm 0x01
+#define OSC_RC32MEN_bm 0x02
+#define OSC_RC32KEN_bm 0x04
+#define OSC_XOSCEN_bm 0x08
+#define OSC_PLLEN_bm 0x10
+#define OSC_XOSCRDY_bm 0x08
+#define OSC_PLLRDY_bm 0x10
+#define OSC_FRQRANGE_12TO16_gc 0xC0
+#define OSC_XOSCSEL_XTAL_16KCLK_gc 0x0B
+#define OSC_PLLSRC_XOSC_gc 0xC0
+#define OSC_PLLFAC_gm 0x1F
+#define OSC_PLLFAC_gp 0
+#define PMIC_LOLVLEN_bm 0x01
+#define DAC_ENABLE_bm 0x01
+#define DAC_CH0EN_bm 0x04
+#define DAC_CH1EN_bm 0x08
+#define DAC_CHSEL_DUAL_gc 0x40
+#define DAC_REFSEL_AVCC_gc 0x08
+#define DAC_CH0DRE_bm 0x01
+#define DAC_CH1DRE_bm 0x02
+#define PORT_OPC_PULLUP_gc 0x18
+#define PORT_ISC_BOTHEDGES_gc 0x00
+#define PORT_INTLVL_LO_gc 0x01
+#define PORT_USART0_bm 0x10
+#define TC45_CLKSEL_OFF_gc 0x00
+#define TC45_CLKSEL_DIV1_gc 0x01
+#define TC45_CLKSEL_DIV8_gc 0x04
+#define TC45_CLKSEL_DIV64_gc 0x05
+#define TC45_CLKSEL_gm 0x0F
+#define TC45_OVFINTLVL_LO_gc 0x01
+#define TC45_OVFINTLVL_OFF_gc 0x00
+#define TC45_OVFINTLVL_gm 0x03
+#define TC45_CCAINTLVL_LO_gc 0x01
+#define TC45_CCAINTLVL_gm 0x03
+#define TC45_CCBINTLVL_LO_gc 0x04
+#define TC45_CCBINTLVL_gm 0x0C
+#define TC45_CCCINTLVL_LO_gc 0x10
+#define TC45_CCCINTLVL_gm 0x30
+#define TC4_OVFIF_bm 0x01
+#define TC4_CCAIF_bm 0x10
+#define TC4_CCBIF_bm 0x20
+#define TC4_CCCIF_bm 0x40
+#define TC5_OVFIF_bm 0x01
+#define USART_RXCIF_bm 0x80
+#define USART_TXCIF_bm 0x40
+#define USART_RXCINTLVL_gm 0x30
+#define USART_RXCINTLVL_LO_gc 0x10
+#define USART_RXEN_bm 0x10
+#define USART_TXEN_bm 0x08
+#define USART_CHSIZE_8BIT_gc 0x03
+#define USART_PMODE_DISABLED_gc 0x00
+#define USART_BSEL_gm 0xFF
+#define USART_BSCALE_gm 0xF0
+#define USART_BSCALE_gp 4
+#define SLEEP_SEN_bm 0x01
+#define SLEEP_SMODE_gm 0x0E
+#define SLEEP_SMODE_IDLE_gc 0x00
+#define TCC4_OVF_vect __vector_12
+#define TCC4_CCA_vect __vector_14
+#define TCC4_CCB_vect __vector_15
+#define TCC4_CCC_vect __vector_16
+#define TCC5_OVF_vect __vector_18
+#define PORTA_INT_vect __vector_29
+#define TCD5_OVF_vect __vector_35
+#define USARTD0_RXC_vect __vector_39
+#endif
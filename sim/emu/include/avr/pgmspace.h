@@ -0,0 +1,11 @@
+#ifndef _AVR_PGMSPACE_H_
+#define _AVR_PGMSPACE_H_
+#include <stdint.h>
+#define PROGMEM __attribute__((section(".progmem.data")))
+static inline uint16_t pgm_read_word(const void *addr)
+{
+    uint16_t res;
+    __asm__ __volatile__ ("lpm %A0, Z+\n\tlpm %B0, Z" : "=r" (res), "+z" (addr));
+    return res;
+}
+#endif
@@ -0,0 +1,9 @@
+#ifndef _AVR_SLEEP_H_
+#define _AVR_SLEEP_H_
+#include <avr/io.h>
+#define SLEEP_MODE_IDLE SLEEP_SMODE_IDLE_gc
+#define set_sleep_mode(m) (SLEEP.CTRL = (SLEEP.CTRL & ~SLEEP_SMODE_gm) | (m))
+#define sleep_enable() (SLEEP.CTRL |= SLEEP_SEN_bm)
+#define sleep_disable() (SLEEP.CTRL &= ~SLEEP_SEN_bm)
+#define sleep_cpu() __asm__ __volatile__ ("sleep" ::: "memory")
+#endif
@@ -0,0 +1,12 @@
+#ifndef _LIMITS_H
+#define _LIMITS_H
+#define CHAR_BIT 8
+#define INT_MAX 32767
+#define INT_MIN (-32767-1)
+#define UINT_MAX 65535U
+#define USHRT_MAX 65535U
+#define SHRT_MAX 32767
+#define LONG_MAX 2147483647L
+#define LONG_MIN (-2147483647L-1)
+#define ULONG_MAX 4294967295UL
+#endif
@@ -0,0 +1,6 @@
+#ifndef _STDDEF_H
+#define _STDDEF_H
+typedef unsigned int size_t; typedef int ptrdiff_t;
+#define NULL ((void *)0)
+#define offsetof(t, m) __builtin_offsetof(t, m)
+#endif
@@ -0,0 +1,8 @@
+#ifndef _UTIL_ATOMIC_H_
+#define _UTIL_ATOMIC_H_
+#include <avr/io.h>
+static __inline__ uint8_t __iCliRetVal(void) { __asm__ __volatile__ ("cli" ::: "memory"); return 1; }
+static __inline__ void __iRestore(const uint8_t *s) { SREG = *s; __asm__ __volatile__ ("" ::: "memory"); }
+#define ATOMIC_RESTORESTATE uint8_t sreg_save __attribute__((__cleanup__(__iRestore), __unused__)) = SREG
+#define ATOMIC_BLOCK(type) for (type, __ToDo = __iCliRetVal(); __ToDo; __ToDo = 0)
+#endif
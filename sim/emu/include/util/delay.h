@@ -0,0 +1,8 @@
+#ifndef _UTIL_DELAY_H_
+#define _UTIL_DELAY_H_
+static __inline__ void _delay_ms(double ms)
+{
+    volatile unsigned long n = (unsigned long)(ms * (F_CPU / 4000.0));
+    while (n) n--;
+}
+#endif
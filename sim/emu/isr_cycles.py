@@ -0,0 +1,38 @@
+"""isr_cycles.py [tree] : cycles of the step and profile interrupts over a few
+simple moves, one line per move and interrupt."""
+import os, sys
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from fw import build_tree, boot, summary, tree_arg, NAMES
+
+
+def const(m):
+    m.call('stepper_set_100uS_delay', 1, (2, 2))
+    m.call('stepper_set_steps', 1, (2000, 4))
+    m.call('stepper_start', 1)
+
+
+def both(m):
+    for s in (1, 2):
+        m.call('stepper_set_100uS_delay', s, (3, 2))
+        m.call('stepper_set_steps', s, (2000, 4))
+    m.call('stepper_start', 3)
+
+
+def ramp(m):
+    m.call('stepper_set_accel', 1, (4000, 2), (4000, 2))
+    m.call('stepper_set_max_speed', 1, (3000, 2))
+    m.call('stepper_set_steps', 1, (5000, 4))
+    m.call('stepper_start', 1)
+
+
+def linear(m):
+    m.call('stepper_move_linear', (3000, 4), (1000, 4), (2000, 2))
+
+
+elf = build_tree(tree_arg())
+for name, setup in (('const', const), ('both', both), ('ramp', ramp), ('linear', linear)):
+    m = boot(elf)
+    setup(m)
+    m.run_isrs(400000)
+    for v in sorted(m.isr_cycles):
+        print('%-7s %-14s %s' % (name, NAMES[v], summary(m.isr_cycles[v])))
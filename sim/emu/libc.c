@@ -0,0 +1,23 @@
+/*
+libc.c - The two libc functions the firmware uses, for linking without
+avr-libc.
+*/
+
+#include <stddef.h>
+void *memcpy(void *d, const void *s, size_t n)
+{
+    char *dp = d;
+    const char *sp = s;
+    while (n--) {
+        *dp++ = *sp++;
+    }
+    return d;
+}
+void *memset(void *d, int c, size_t n)
+{
+    char *dp = d;
+    while (n--) {
+        *dp++ = c;
+    }
+    return d;
+}
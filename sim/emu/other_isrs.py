@@ -0,0 +1,27 @@
+"""other_isrs.py [tree ...] : cycles of the interrupts outside the step path,
+the UART receive, the switch pin change, a debounce sample and the perf
+window overflow, built without and with PERF_ISR_BUSY. Interrupts a tree
+doesn't have are left out."""
+import os, sys
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from fw import build_tree, boot, tree_arg, VECTORS
+
+PORTA_IN = 0x608
+
+
+def cycles(elf):
+    m = boot(elf)
+    res = []
+    for name in ('USARTD0_RXC_vect', 'PORTA_INT_vect', 'TCC5_OVF_vect', 'TCD5_OVF_vect'):
+        if VECTORS[name] not in m.elf.syms:
+            continue
+        if name == 'PORTA_INT_vect':
+            m.mem[PORTA_IN] = 0xe0  # R1_A pressed, starts the debounce
+        res.append('%s=%d' % (name, m.isr(VECTORS[name])))
+    return ' '.join(res)
+
+
+for tree in sys.argv[1:] or [tree_arg()]:
+    print(tree)
+    print('  plain         ', cycles(build_tree(tree)))
+    print('  PERF_ISR_BUSY ', cycles(build_tree(tree, ['-DPERF_ISR_BUSY'])))
@@ -0,0 +1,88 @@
+"""stress.py [tree [speed]] : both steppers at speed steps/s, default 2850,
+in every motion mode with backlash, soft limits and the trace on. Prints the
+compares the firmware counted late, the largest delay from a compare match
+to its interrupt in TCC4 ticks and the most cycles each interrupt took."""
+import os, sys
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from fw import build_tree, boot, signed, tree_arg, NAMES
+
+top = int(sys.argv[2]) if len(sys.argv) > 2 else 2850
+
+
+def options(m):
+    for s in (1, 2):
+        m.call('stepper_set_backlash', s, (40, 2), (top, 2))
+        m.call('stepper_set_soft_limits', s, 1, signed(-1000000, 4), signed(1000000, 4))
+    m.call('trace_set_enable', 1)
+
+
+def scurve(m):
+    for s in (1, 2):
+        m.call('stepper_set_accel', s, (20000, 2), (20000, 2))
+        m.call('stepper_set_max_speed', s, (top, 2))
+        m.call('stepper_set_profile', s, 1)
+        m.call('stepper_set_jerk', s, (2000000, 4))
+        m.call('stepper_set_steps', s, (20000, 4))
+    m.call('stepper_start', 3)
+
+
+def jog(m):
+    for s in (1, 2):
+        m.call('stepper_set_accel', s, (30000, 2), (30000, 2))
+        m.call('stepper_set_target_velocity', s, signed(top, 4))
+
+
+def queue(m):
+    for s in (1, 2):
+        m.call('stepper_set_accel', s, (60000, 2), (60000, 2))
+        for k in range(4):
+            m.call('stepper_enqueue', s, 0, 1, (200, 4), (top, 2))
+    m.call('stepper_start', 3)
+
+
+def trapezoid(m):
+    for s in (1, 2):
+        m.call('stepper_set_accel', s, (60000, 2), (60000, 2))
+        m.call('stepper_set_max_speed', s, (top, 2))
+        m.call('stepper_set_steps', s, (20000, 4))
+    m.call('stepper_start', 3)
+
+
+def linear(m):
+    m.call('stepper_move_linear', signed(20000, 4), signed(-9000, 4), (top, 2))
+
+
+def arc(m):
+    m.call('stepper_move_arc', signed(-4000, 2), signed(0, 2), signed(-8000, 2), signed(0, 2), 0, (top, 2))
+
+
+def planned(m):
+    for dx, dy in ((4000, 500), (3000, 3000), (-800, 4000), (6000, -100)):
+        m.call('planner_add_line', signed(dx, 4), signed(dy, 4), (top, 2))
+    m.call('planner_update')
+    m.call('stepper_start_segments')
+
+
+def rate(m):
+    for s in (1, 2):
+        m.call('stepper_set_rate', s, (top << 16, 4))
+        m.call('stepper_set_steps', s, (20000, 4))
+    m.call('stepper_start', 3)
+
+
+elf = build_tree(tree_arg())
+for name, setup in (('scurve', scurve), ('jog', jog), ('queue', queue), ('trapezoid', trapezoid),
+                    ('linear', linear), ('arc', arc), ('planned', planned), ('rate', rate)):
+    m = boot(elf)
+    options(m)
+    setup(m)
+    m.run_isrs(200)
+    # Leave out the start, stepper_start() runs with the compares held off.
+    a = m.elf.syms['perf_latency_max'] & 0xffff
+    m.mem[a] = m.mem[a + 1] = 0
+    m.isr_cycles = {}
+    m.run_isrs(40000)
+    late = sum(m.rd(m.elf.syms['perf_late'] + k) << (8 * k) for k in range(4))
+    latency = m.word16(m.elf.syms['perf_latency_max'] & 0xffff)
+    print('%-9s late=%d latency_max=%d ticks' % (name, late, latency),
+          ' '.join('%s=%d' % (NAMES[v], max(c)) for v, c in sorted(m.isr_cycles.items())))
@@ -0,0 +1,23 @@
+"""trace_cost.py [tree] : step interrupt cycles for a ramped move with the
+trace off and on. The buffer is drained as it fills, as a host streaming it
+would, so the recording path runs on every step."""
+import os, sys
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from fw import build_tree, boot, summary, tree_arg, VECTORS
+
+elf = build_tree(tree_arg())
+for on in (0, 1):
+    m = boot(elf)
+    count = m.elf.syms['trace_count'] & 0xffff
+
+    def drain(m, vec, c):
+        if m.mem[count] >= 30:
+            m.mem[count] = 0
+
+    m.call('stepper_set_accel', 1, (4000, 2), (4000, 2))
+    m.call('stepper_set_max_speed', 1, (3000, 2))
+    m.call('trace_set_enable', on)
+    m.call('stepper_set_steps', 1, (5000, 4))
+    m.call('stepper_start', 1)
+    m.run_isrs(200000, drain)
+    print('trace=%d TCC4_CCA_vect %s' % (on, summary(m.isr_cycles[VECTORS['TCC4_CCA_vect']])))
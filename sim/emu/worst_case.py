@@ -0,0 +1,87 @@
+"""worst_case.py [tree] : the most cycles each interrupt took over a set of
+motion modes at high acceleration and speed, with every option the tree has
+turned on in the last one. Modes the tree doesn't have yet are skipped."""
+import os, sys
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from fw import build_tree, boot, summary, signed, tree_arg, NAMES
+
+
+def scurve(m):
+    for s in (1, 2):
+        m.call('stepper_set_accel', s, (20000, 2), (20000, 2))
+        m.call('stepper_set_max_speed', s, (20000, 2))
+        m.call('stepper_set_profile', s, 1)
+        m.call('stepper_set_jerk', s, (2000000, 4))
+        m.call('stepper_set_steps', s, (6000, 4))
+    m.call('stepper_start', 3)
+
+
+def trapezoid(m):
+    for s in (1, 2):
+        m.call('stepper_set_accel', s, (30000, 2), (30000, 2))
+        m.call('stepper_set_max_speed', s, (30000, 2))
+        m.call('stepper_set_steps', s, (8000, 4))
+    m.call('stepper_start', 3)
+
+
+def queue(m):
+    for s in (1, 2):
+        m.call('stepper_set_accel', s, (30000, 2), (30000, 2))
+        for k in range(4):
+            m.call('stepper_enqueue', s, 0, k & 1, (300, 4), (20000, 2))
+    m.call('stepper_start', 3)
+
+
+def linear(m):
+    m.call('stepper_move_linear', signed(6000, 4), signed(-2500, 4), (20000, 2))
+
+
+def arc(m):
+    m.call('stepper_move_arc', signed(-2000, 2), signed(0, 2), signed(-4000, 2), signed(0, 2), 0, (10000, 2))
+
+
+def planned(m):
+    for dx, dy in ((2000, 500), (1500, 1500), (-800, 2000), (3000, -100)):
+        m.call('planner_add_line', signed(dx, 4), signed(dy, 4), (20000, 2))
+    m.call('planner_update')
+    m.call('stepper_start_segments')
+
+
+def jog(m):
+    # The profile tick does the most work here, with the limits checked.
+    for s in (1, 2):
+        m.call('stepper_set_soft_limits', s, 1, signed(-1000000, 4), signed(1000000, 4))
+        m.call('stepper_set_accel', s, (30000, 2), (30000, 2))
+        m.call('stepper_set_target_velocity', s, signed(-2850 if s == 2 else 2850, 4))
+
+
+def options(m):
+    # Gearing, backlash, soft limits, auto microsteps and the trace all on.
+    m.call('stepper_set_backlash', 1, (40, 2), (20000, 2))
+    m.call('stepper_set_soft_limits', 1, 1, signed(-100000, 4), signed(100000, 4))
+    m.call('stepper_set_soft_limits', 2, 1, signed(-100000, 4), signed(100000, 4))
+    m.call('stepper_set_auto_microsteps', 1, (5000, 2))
+    m.call('trace_set_enable', 1)
+    m.call('stepper_set_gearing', 1, signed(-3, 2), (2, 2))
+    m.call('stepper_set_accel', 1, (30000, 2), (30000, 2))
+    m.call('stepper_set_max_speed', 1, (20000, 2))
+    m.call('stepper_set_steps', 1, (6000, 4))
+    m.call('stepper_start', 1)
+
+
+elf = build_tree(tree_arg())
+worst = {}
+for name, setup in (('scurve', scurve), ('trapezoid', trapezoid), ('queue', queue), ('linear', linear),
+                    ('arc', arc), ('planned', planned), ('jog', jog), ('options', options)):
+    m = boot(elf)
+    try:
+        setup(m)
+    except KeyError as x:
+        print('%-9s skipped, no %s' % (name, x))
+        continue
+    m.run_isrs(60000)
+    for v in sorted(m.isr_cycles):
+        c = m.isr_cycles[v]
+        print('%-9s %-14s %s' % (name, NAMES[v], summary(c)))
+        worst[v] = max(worst.get(v, 0), max(c))
+print('worst', ' '.join('%s=%d' % (NAMES[v], c) for v, c in sorted(worst.items())))
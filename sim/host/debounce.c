@@ -0,0 +1,112 @@
+/*
+debounce.c - Feeds switch input patterns through the debounce filter.
+
+For each pattern on the R1_A switch: when the filtered switch starts to block
+stepper 1 and when it lets go again, in us from the start of the pattern,
+with the default filter time, left out when it never did. Then the same
+with the filter off, and which filter times switches_set_config() takes.
+*/
+
+#include "sim.h"
+#include "switches.h"
+#include <stdio.h>
+
+
+// Patterns, pressed or not at tick t. 4 ticks per us.
+static bool clean(long t)
+{
+    return t >= 400 && t < 4400; // 1 ms press
+}
+
+
+static bool spike(long t)
+{
+    return t >= 400 && t < 440; // 10 us
+}
+
+
+static bool chatter(long t)
+{
+    return t >= 400 && t < 4400 && !(t < 1200 && t % 80 >= 60); // 5 us gaps for 200 us
+}
+
+
+static bool noise(long t)
+{
+    return t % 800 < 80; // 20 us every 200 us
+}
+
+
+static bool bouncy_release(long t)
+{
+    return (t >= 400 && t < 4400) || (t >= 4400 && t < 5200 && t % 80 < 20);
+}
+
+
+static bool (*pattern)(long t);
+
+
+static void inputs(void)
+{
+    sim_switches(pattern(sim_t) ? 0xf0 & ~PIN4_bm : 0xf0);
+}
+
+
+static void run(const char *name, bool (*p)(long t))
+{
+    long trip = -1;
+    long release = -1;
+    bool was = false;
+    bool blocked;
+
+    pattern = p;
+    sim_inputs = inputs;
+    while (sim_t < 8000) {
+        sim_tick();
+        blocked = switch_r1a_or_r1b_triggered();
+        if (blocked && !was && trip < 0) {
+            trip = sim_t;
+        }
+        if (!blocked && was) {
+            release = sim_t;
+        }
+        was = blocked;
+    }
+    printf("%-15s", name);
+    if (trip >= 0) {
+        printf(" trip=%.2fus", trip / 4.0);
+    }
+    if (release >= 0) {
+        printf(" release=%.2fus", release / 4.0);
+    }
+    printf(" blocked=%d\n", was);
+    sim_inputs = 0;
+}
+
+
+int main(void)
+{
+    sim_init();
+    run("clean", clean);
+    sim_init();
+    run("spike", spike);
+    sim_init();
+    run("chatter", chatter);
+    sim_init();
+    run("noise", noise);
+    sim_init();
+    run("bouncy_release", bouncy_release);
+
+    sim_init();
+    switches_set_config(0, SWITCHES_GC, 0);
+    run("unfiltered", clean);
+
+    printf("filter 49=%d 50=%d 16000=%d 16001=%d invert 0x10=%d\n",
+           switches_set_config(0, SWITCHES_GC, SWITCHES_FILTER_MIN - 1),
+           switches_set_config(0, SWITCHES_GC, SWITCHES_FILTER_MIN),
+           switches_set_config(0, SWITCHES_GC, SWITCHES_FILTER_MAX),
+           switches_set_config(0, SWITCHES_GC, SWITCHES_FILTER_MAX + 1),
+           switches_set_config(0x10, SWITCHES_GC, SWITCHES_FILTER_DEFAULT));
+
+    return 0;
+}
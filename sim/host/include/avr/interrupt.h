@@ -0,0 +1,7 @@
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+/* Handlers are plain functions that sim.c calls, nothing nests. */
+#define ISR(vector) void vector(void)
+#define cli() ((void)0)
+#define sei() ((void)0)
+#endif
@@ -0,0 +1,111 @@
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+/* ATxmega16E5 registers for the host build, plain memory that sim.c reads
+   and writes around the interrupt handlers. Only what the firmware uses. */
+#include <stdint.h>
+typedef struct { volatile uint8_t DIR, DIRSET, DIRCLR, DIRTGL, OUT, OUTSET, OUTCLR, OUTTGL, IN, INTCTRL, INTMASK, INTFLAGS, REMAP, PIN0CTRL, PIN1CTRL, PIN2CTRL, PIN3CTRL, PIN4CTRL, PIN5CTRL, PIN6CTRL, PIN7CTRL; } PORT_t;
+typedef struct { volatile uint8_t CTRLA, CTRLB, CTRLC, CTRLD, CTRLE, CTRLF, CTRLGCLR, CTRLGSET, INTCTRLA, INTCTRLB, INTFLAGS; volatile uint16_t CNT, PER, CCA, CCB, CCC, CCD; } TC4_t;
+typedef TC4_t TC5_t;
+typedef struct { volatile uint8_t CTRLA, CTRLB, CTRLC, STATUS; volatile uint16_t CH0DATA, CH1DATA; } DAC_t;
+typedef struct { volatile uint8_t DATA, STATUS, CTRLA, CTRLB, CTRLC, BAUDCTRLA, BAUDCTRLB; } USART_t;
+typedef struct { volatile uint8_t CTRL, STATUS; } PMIC_t;
+typedef struct { volatile uint8_t CTRL, STATUS, XOSCCTRL, PLLCTRL; } OSC_t;
+typedef struct { volatile uint8_t CTRL; } CLK_t;
+typedef struct { volatile uint8_t CTRL; } SLEEP_t;
+extern PORT_t PORTA, PORTC, PORTD;
+extern TC4_t TCC4;
+extern TC5_t TCC5, TCD5;
+extern DAC_t DACA;
+extern USART_t USARTD0;
+extern PMIC_t PMIC;
+extern OSC_t OSC;
+extern CLK_t CLK;
+extern SLEEP_t SLEEP;
+extern volatile uint8_t CCP;
+/* run.sh turns OUTSET and OUTCLR writes into these, so the firmware reads
+   back what it wrote and sim.c sees every step edge, and UART sends into
+   sim_uart_tx(). */
+void sim_port_set(PORT_t *port, uint8_t bm);
+void sim_port_clr(PORT_t *port, uint8_t bm);
+void sim_uart_tx(uint8_t c);
+#define PIN0_bm 1
+#define PIN1_bm 2
+#define PIN2_bm 4
+#define PIN3_bm 8
+#define PIN4_bm 16
+#define PIN5_bm 32
+#define PIN6_bm 64
+#define PIN7_bm 128
+#define PORT_OPC_PULLUP_gc 0x18
+#define PORT_ISC_BOTHEDGES_gc 0
+#define PORT_ISC_gm 7
+#define PORT_INTLVL_LO_gc 1
+#define PORT_INTLVL_gm 3
+#define PORT_USART0_bm 0x10
+#define TC45_CLKSEL_OFF_gc 0
+#define TC45_CLKSEL_DIV1_gc 1
+#define TC45_CLKSEL_DIV8_gc 4
+#define TC45_CLKSEL_DIV64_gc 5
+#define TC45_CLKSEL_gm 0xf
+#define TC45_WGMODE_NORMAL_gc 0
+#define TC45_OVFINTLVL_LO_gc 1
+#define TC45_OVFINTLVL_OFF_gc 0x00
+#define TC45_OVFINTLVL_gm 3
+#define TC45_CCAINTLVL_LO_gc 1
+#define TC45_CCAINTLVL_gm 3
+#define TC45_CCBINTLVL_LO_gc 4
+#define TC45_CCBINTLVL_gm 12
+#define TC45_CCCINTLVL_LO_gc 16
+#define TC45_CCCINTLVL_gm 48
+#define TC45_CCDINTLVL_LO_gc 64
+#define TC45_CCDINTLVL_gm 192
+#define TC45_CCAMODE_COMP_gc 1
+#define TC45_CCBMODE_COMP_gc 4
+#define TC45_CCCMODE_COMP_gc 16
+#define TC45_CCDMODE_COMP_gc 64
+#define TC45_CMD_RESTART_gc 8
+#define TC4_OVFIF_bm 1
+#define TC4_CCAIF_bm 16
+#define TC4_CCBIF_bm 32
+#define TC4_CCCIF_bm 64
+#define TC4_CCDIF_bm 128
+#define TC5_OVFIF_bm 1
+#define DAC_REFSEL_AVCC_gc 8
+#define DAC_CHSEL_DUAL_gc 0x40
+#define DAC_CH0EN_bm 4
+#define DAC_CH1EN_bm 8
+#define DAC_ENABLE_bm 1
+#define DAC_CH0DRE_bm 1
+#define DAC_CH1DRE_bm 2
+#define PMIC_LOLVLEN_bm 1
+#define PMIC_MEDLVLEN_bm 2
+#define PMIC_HILVLEN_bm 4
+#define USART_RXCIF_bm 0x80
+#define USART_TXCIF_bm 0x40
+#define USART_DREIF_bm 0x20
+#define USART_RXCINTLVL_gm 0x30
+#define USART_RXCINTLVL_LO_gc 0x10
+#define USART_RXCINTLVL_OFF_gc 0
+#define USART_CHSIZE_8BIT_gc 3
+#define USART_PMODE_DISABLED_gc 0
+#define USART_BSEL_gm 0xff
+#define USART_BSCALE_gp 4
+#define USART_BSCALE_gm 0xf0
+#define USART_RXEN_bm 0x10
+#define USART_TXEN_bm 0x08
+#define OSC_FRQRANGE_12TO16_gc 0xc0
+#define OSC_XOSCSEL_XTAL_16KCLK_gc 0x0b
+#define OSC_XOSCEN_bm 8
+#define OSC_XOSCRDY_bm 8
+#define OSC_PLLSRC_XOSC_gc 0xc0
+#define OSC_PLLFAC_gm 0x1f
+#define OSC_PLLFAC_gp 0
+#define OSC_PLLEN_bm 0x10
+#define OSC_PLLRDY_bm 0x10
+#define CCP_IOREG_gc 0xd8
+#define CLK_SCLKSEL_gm 7
+#define CLK_SCLKSEL_PLL_gc 4
+#define OSC_RC2MEN_bm 1
+#define OSC_RC32MEN_bm 2
+#define OSC_RC32KEN_bm 4
+#endif
@@ -0,0 +1,9 @@
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+#define SLEEP_SMODE_IDLE_gc 0
+#define SLEEP_MODE_IDLE 0
+#define set_sleep_mode(mode) ((void)0)
+#define sleep_enable() ((void)0)
+#define sleep_disable() ((void)0)
+#define sleep_cpu() ((void)0)
+#endif
@@ -0,0 +1,6 @@
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+#define ATOMIC_BLOCK(type) for (int sim_atomic = 1; sim_atomic; sim_atomic = 0)
+#endif
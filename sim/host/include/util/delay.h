@@ -0,0 +1,5 @@
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+#define _delay_ms(ms) ((void)0)
+#define _delay_us(us) ((void)0)
+#endif
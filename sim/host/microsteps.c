@@ -0,0 +1,96 @@
+/*
+microsteps.c - Automatic microstepping on the MS pins of stepper 1.
+
+Follows the driver the way it sees the pins: every STEP edge moves the
+electrical angle by the microstep the MS pins selected before it. For each
+move: the pulses at each setting, how often the setting changed, any change
+away from a full step, and the angle at the end against the position. Then
+turning it off, which should put back the setting it replaced.
+*/
+
+#include "sim.h"
+#include "stepper.h"
+#include <stdio.h>
+
+#define MS(port) (((port)->OUT >> 1) & 3)
+#define INC(ms) ((ms) == 0 ? 16 : (ms) == 1 ? 8 : (ms) == 2 ? 4 : 1)
+
+static uint8_t ms;
+static long angle;
+static long pulses[4];
+static long changes;
+static long bad;
+
+
+// Before each tick, so a step sees the setting from before its interrupt.
+static void inputs(void)
+{
+    if (MS(&PORTD) != ms) {
+        changes++;
+        if (angle % 16) {
+            bad++;
+        }
+        ms = MS(&PORTD);
+    }
+}
+
+
+static void on_step(uint8_t i, PORT_t *port)
+{
+    if (i == 0) {
+        pulses[ms]++;
+        angle += (port->OUT & PIN3_bm) ? INC(ms) : -INC(ms);
+    }
+}
+
+
+static void run(int32_t steps, uint16_t rate, uint16_t accel, uint16_t speed, uint8_t dir)
+{
+    int32_t p = 0;
+    bool res;
+    long t;
+
+    sim_init();
+    stepper_set_accel(1, accel, accel);
+    stepper_set_max_speed(1, speed);
+    res = stepper_set_auto_microsteps(1, rate);
+    stepper_set_dir(1, dir);
+    stepper_set_steps(1, steps);
+    ms = MS(&PORTD);
+    angle = changes = bad = 0;
+    pulses[0] = pulses[1] = pulses[2] = pulses[3] = 0;
+    sim_inputs = inputs;
+    sim_on_step = on_step;
+    res &= stepper_start(1);
+    t = sim_run(800000000L);
+    stepper_get_position(1, &p);
+    printf("steps=%ld rate=%u speed=%u res=%d pulses full/half/quarter/sixteenth=%ld/%ld/%ld/%ld"
+           " changes=%ld bad=%ld angle=%ld pos=%ld t=%.3fs\n",
+           (long)steps, rate, speed, res, pulses[0], pulses[1], pulses[2], pulses[3],
+           changes, bad, angle, (long)p, (double)t / SIM_TICKS_PER_S);
+}
+
+
+int main(void)
+{
+    uint8_t b;
+
+    run(20000, 1000, 3000, 2500, STEPPER_DIR_HIGH);
+    run(20000, 1000, 3000, 2500, STEPPER_DIR_LOW);
+    run(3001, 800, 5000, 4000, STEPPER_DIR_HIGH);
+    run(200, 1000, 3000, 2500, STEPPER_DIR_HIGH);
+    run(50000, 300, 1000, 6000, STEPPER_DIR_HIGH);
+
+    sim_init();
+    printf("set half=%d", stepper_set_microsteps(1, STEPPER_MICROSTEP_BITFIELD_HALF_STEP));
+    stepper_get_microsteps(1, &b);
+    printf(" ms=%u pins=%u", b, MS(&PORTD));
+    printf(" auto=%d", stepper_set_auto_microsteps(1, 2000));
+    printf(" set while auto=%d", stepper_set_microsteps(1, STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP));
+    printf(" off=%d", stepper_set_auto_microsteps(1, 0));
+    stepper_get_microsteps(1, &b);
+    printf(" ms=%u pins=%u", b, MS(&PORTD));
+    printf(" set bad=%d\n", stepper_set_microsteps(1, 4));
+
+    return 0;
+}
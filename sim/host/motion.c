@@ -0,0 +1,211 @@
+/*
+motion.c - Runs each motion mode and prints what the steppers did.
+
+For every move: the step edges of each stepper, a hash of their times, the
+time of the last one and the end positions. Meant for run.sh with a
+ref_tree, where any change to step timing or positions shows up as a
+difference. Features a tree doesn't have yet are skipped.
+*/
+
+#include "sim.h"
+#include "stepper.h"
+#include "planner.h"
+#include <stdio.h>
+
+// Weak, for trees from before they were added.
+bool stepper_set_backlash(uint8_t stepper_num, uint16_t steps, uint16_t rate) __attribute__((weak));
+bool stepper_set_accel_preset(uint8_t stepper_num, uint8_t preset) __attribute__((weak));
+bool stepper_set_gearing(uint8_t enable, int16_t num, uint16_t den) __attribute__((weak));
+bool stepper_set_auto_microsteps(uint8_t stepper_num, uint16_t rate) __attribute__((weak));
+bool stepper_set_rate(uint8_t stepper_num, uint32_t rate) __attribute__((weak));
+
+
+static uint32_t hash[2];
+static long start;
+
+
+static void on_step(uint8_t i, PORT_t *port)
+{
+    hash[i] = (hash[i] ^ (uint32_t)(sim_t - start)) * 16777619UL;
+}
+
+
+static void report(const char *name, bool res)
+{
+    int32_t p1 = 0;
+    int32_t p2 = 0;
+
+    stepper_get_position(1, &p1);
+    stepper_get_position(2, &p2);
+    printf("%-10s res=%d steps=%ld/%ld last=%ld/%ld hash=%08lx/%08lx pos=%ld/%ld\n", name, res,
+           sim_steps[0], sim_steps[1],
+           sim_last_step[0] < 0 ? -1 : sim_last_step[0] - start,
+           sim_last_step[1] < 0 ? -1 : sim_last_step[1] - start,
+           (unsigned long)hash[0], (unsigned long)hash[1], (long)p1, (long)p2);
+}
+
+
+static void begin()
+{
+    sim_init();
+    sim_on_step = on_step;
+    hash[0] = hash[1] = 2166136261UL;
+    start = sim_t;
+}
+
+
+static void both(uint16_t accel, uint16_t speed)
+{
+    uint8_t i;
+
+    for (i = 1; i <= 2; i++) {
+        stepper_set_accel(i, accel, accel);
+        stepper_set_max_speed(i, speed);
+    }
+}
+
+
+int main(void)
+{
+    bool res;
+    uint8_t k;
+
+    begin();
+    stepper_set_100uS_delay(1, 7);
+    stepper_set_100uS_delay(2, 3);
+    stepper_set_steps(1, 1000);
+    stepper_set_dir(2, STEPPER_DIR_HIGH);
+    stepper_set_steps(2, 1700);
+    res = stepper_start(3);
+    sim_run(40000000L);
+    report("fixed", res);
+
+    begin();
+    both(4000, 3000);
+    stepper_set_steps(1, 5000);
+    stepper_set_steps(2, 300);
+    res = stepper_start(3);
+    sim_run(40000000L);
+    report("trapezoid", res);
+
+    begin();
+    both(3000, 2500);
+    stepper_set_profile(1, STEPPER_PROFILE_SCURVE);
+    stepper_set_jerk(1, 200000);
+    stepper_set_steps(1, 6000);
+    res = stepper_start(1);
+    sim_run(40000000L);
+    report("scurve", res);
+
+    begin();
+    both(2000, 1500);
+    res = stepper_enqueue(1, STEPPER_MODE_STEPS, STEPPER_DIR_HIGH, 800, 1500);
+    res &= stepper_enqueue(1, STEPPER_MODE_STEPS, STEPPER_DIR_LOW, 300, 800);
+    res &= stepper_enqueue(2, STEPPER_MODE_STEPS, STEPPER_DIR_HIGH, 500, 1200);
+    sim_run(40000000L);
+    report("queue", res);
+
+    begin();
+    both(3000, 2000);
+    res = stepper_move_linear(3000, -1100, 2000);
+    sim_run(40000000L);
+    report("linear", res);
+
+    begin();
+    res = stepper_move_arc(-1000, 0, -2000, 0, 0, 1500);
+    sim_run(40000000L);
+    report("arc", res);
+
+    begin();
+    both(2000, 1500);
+    res = stepper_move_to(1, -2500);
+    sim_run(40000000L);
+    report("move_to", res);
+
+    begin();
+    both(3000, 2000);
+    res = stepper_set_target_velocity(1, 2000);
+    sim_idle(4000000L);
+    res &= stepper_set_target_velocity(1, -1000);
+    sim_idle(6000000L);
+    res &= stepper_set_target_velocity(1, 0);
+    sim_run(40000000L);
+    report("jog", res);
+
+    begin();
+    both(3000, 2000);
+    {
+        static const int32_t path[][2] = {
+            { 1000, 0 }, { 1000, 1000 }, { 0, 1000 }, { -2000, 10 }, { 1500, -500 },
+        };
+
+        res = true;
+        for (k = 0; k < sizeof(path) / sizeof(path[0]); k++) {
+            while (!planner_add_line(path[k][0], path[k][1], 1800)) {
+                planner_update();
+                sim_idle(4000);
+            }
+        }
+        // The main loop runs the planner between frames, every 1 ms here.
+        for (;;) {
+            planner_update();
+            planner_get_free(&k);
+            if (k == PLANNER_BUF_LEN && !sim_moving()) {
+                break;
+            }
+            sim_idle(4000);
+        }
+    }
+    report("planner", res);
+
+    if (stepper_set_rate) {
+        begin();
+        res = stepper_set_rate(1, (uint32_t)1234 << 16 | 0x8000);
+        stepper_set_steps(1, 3000);
+        res &= stepper_start(1);
+        sim_run(40000000L);
+        report("rate", res);
+    }
+
+    if (stepper_set_backlash) {
+        begin();
+        both(3000, 2000);
+        res = stepper_set_backlash(1, 40, 1000);
+        res &= stepper_enqueue(1, STEPPER_MODE_STEPS, STEPPER_DIR_HIGH, 500, 2000);
+        res &= stepper_enqueue(1, STEPPER_MODE_STEPS, STEPPER_DIR_LOW, 500, 2000);
+        sim_run(40000000L);
+        report("backlash", res);
+    }
+
+    if (stepper_set_accel_preset) {
+        begin();
+        both(0, 2500);
+        res = stepper_set_accel_preset(1, 3);
+        stepper_set_steps(1, 8000);
+        res &= stepper_start(1);
+        sim_run(40000000L);
+        report("preset", res);
+    }
+
+    if (stepper_set_auto_microsteps) {
+        begin();
+        both(3000, 2500);
+        res = stepper_set_auto_microsteps(1, 1000);
+        stepper_set_steps(1, 20000);
+        res &= stepper_start(1);
+        sim_run(80000000L);
+        report("automicro", res);
+    }
+
+    if (stepper_set_gearing) {
+        begin();
+        both(3000, 2500);
+        res = stepper_set_gearing(1, -3, 7);
+        stepper_set_steps(1, 7000);
+        res &= stepper_start(1);
+        sim_run(40000000L);
+        report("gearing", res);
+    }
+
+    return 0;
+}
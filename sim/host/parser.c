@@ -0,0 +1,87 @@
+/*
+parser.c - Feeds command frames to the UART receive path and the parser.
+
+A frame split over two calls of the parser, garbage and a bad frame end,
+frames back to back, and more frames than the receive buffer holds. For each:
+how many frames the parser handled, what they did and what went out.
+*/
+
+#include "sim.h"
+#include "stepper.h"
+#include "twostep_common_lib.h"
+#include "twostep_parser.h"
+#include "uart.h"
+#include <stdio.h>
+
+// Weak, trees from before the receive buffer parse with a blocking read.
+bool uart_char_receive(uint8_t *c) __attribute__((weak));
+
+
+static int parse_all(void)
+{
+    int n = 0;
+
+    while (twostep_parser_parse()) {
+        n++;
+    }
+    return n;
+}
+
+
+static void report(const char *name, int handled)
+{
+    int32_t p1 = 0;
+    int32_t p2 = 0;
+    int k;
+
+    stepper_get_position(1, &p1);
+    stepper_get_position(2, &p2);
+    printf("%-9s handled=%d pos=%ld/%ld pending=%d tx=%d:", name, handled, (long)p1, (long)p2,
+           uart_char_received(), sim_tx_len);
+    for (k = 0; k < sim_tx_len && k < 16; k++) {
+        printf(" %02x", sim_tx[k]);
+    }
+    printf("\n");
+    sim_tx_len = 0;
+}
+
+
+int main(void)
+{
+    // Set position of stepper 1 to 12345.
+    uint8_t frame[] = { '=', TWOSTEP_SET_POSITION, 1, 0x39, 0x30, 0, 0, '\r', '\n' };
+    // Garbage, a bad command, a bad frame end.
+    static const uint8_t garbage[] = { 'x', '=', 0xee, '=', TWOSTEP_SET_POSITION, 2, 1, 0, 0, 0, '\r', 'X' };
+    int handled;
+    int k;
+
+    if (!uart_char_receive) {
+        printf("no receive buffer, the parser would block\n");
+        return 0;
+    }
+    sim_init();
+    uart_init(BAUD_115200);
+
+    sim_uart_rx(frame, 4);
+    handled = twostep_parser_parse();
+    sim_uart_rx(frame + 4, sizeof(frame) - 4);
+    handled += twostep_parser_parse();
+    report("split", handled);
+
+    sim_uart_rx(garbage, sizeof(garbage));
+    report("garbage", parse_all());
+
+    frame[2] = 2;
+    sim_uart_rx(frame, sizeof(frame));
+    frame[2] = 1;
+    frame[3] = 7;
+    sim_uart_rx(frame, sizeof(frame));
+    report("b2b", parse_all());
+
+    for (k = 0; k < 5; k++) {
+        sim_uart_rx(frame, sizeof(frame));
+    }
+    report("overflow", parse_all());
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+perf.c - Idle windows of the perf counters under a fake interrupt load.
+
+An interrupt that takes a fixed number of cycles runs every 1000 ticks, so
+its share of the CPU is known. Prints the idle percentage after each load
+and whether the TCD5 overflow that closes the windows is on, which it should
+only be while interrupts run.
+*/
+
+#include "sim.h"
+#include "perf.h"
+#include <stdio.h>
+
+// A window is 256 TCD5 overflows at the CPU clock, 8 CPU cycles per tick.
+#define WINDOW_TICKS (256L * 65536 / 8)
+
+static uint16_t load;
+
+
+static void inputs(void)
+{
+    if (load && sim_t % 1000 == 0) {
+        perf_isr_busy(perf_start() - load);
+    }
+}
+
+
+static void run(const char *name, uint16_t cycles, int windows)
+{
+    uint16_t min = 0;
+    uint16_t max = 0;
+    uint16_t mean = 0;
+    uint32_t late = 0;
+    uint8_t idle = 0;
+
+    load = cycles;
+    sim_idle(windows * WINDOW_TICKS);
+    perf_get_stats(&min, &max, &mean, &late, &idle);
+    printf("%-8s load=%u/8000 cycles idle=%u%% overflow=%s\n", name, cycles, idle,
+           (TCD5.INTCTRLA & TC45_OVFINTLVL_gm) ? "on" : "off");
+}
+
+
+int main(void)
+{
+    sim_init();
+    sim_inputs = inputs;
+    printf("init     overflow=%s\n", (TCD5.INTCTRLA & TC45_OVFINTLVL_gm) ? "on" : "off");
+    run("half", 4000, 2);
+    run("tenth", 800, 2);
+    run("full", 8000, 2);
+    run("quiet", 0, 2);
+    run("again", 2000, 2);
+
+    return 0;
+}
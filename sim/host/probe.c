@@ -0,0 +1,121 @@
+/*
+probe.c - Probe and safe moves against a switch at a fixed position.
+
+R1_A closes while stepper 1 is between 1234 and 1300, R1_B can glitch with
+10 us spikes every 100 us at position 500. The filter should let a safe move
+run past them, a probe takes the first raw edge, spike or not. For each move:
+where it ended, the probe latch and the switch state, and how long it took.
+*/
+
+#include "sim.h"
+#include "stepper.h"
+#include "switches.h"
+#include <stdio.h>
+
+
+static bool glitch;
+static int32_t release = 1300;
+
+
+static void inputs(void)
+{
+    int32_t p = 0;
+    uint8_t in = 0xf0;
+
+    stepper_get_position(1, &p);
+    if (p >= 1234 && p <= release) {
+        in &= ~PIN4_bm;
+    }
+    if (glitch && p == 500 && sim_t % 400 < 40) {
+        in &= ~PIN5_bm;
+    }
+    sim_switches(in);
+}
+
+
+static void begin(uint8_t filter)
+{
+    sim_init();
+    sim_inputs = inputs;
+    switches_set_config(0, SWITCHES_GC, filter ? SWITCHES_FILTER_DEFAULT : 0);
+    stepper_set_accel(1, 5000, 5000);
+    stepper_set_max_speed(1, 4000);
+    stepper_set_dir(1, STEPPER_DIR_HIGH);
+}
+
+
+static void report(const char *name, bool res)
+{
+    int32_t p = 0;
+    int32_t probe = 0;
+    uint8_t state = 0;
+    uint8_t reason = 0;
+    uint16_t time = 0;
+    long t = sim_run(40000000L);
+
+    stepper_get_position(1, &p);
+    stepper_get_probe_result(1, &state, &probe, &time);
+    stepper_get_stop_reason(1, &reason);
+    printf("%-16s res=%d pos=%ld probe=%u@%ld reason=%u switches=%x t=%.4fs\n", name, res, (long)p,
+           state, (long)probe, reason, get_switch_status(), (double)t / SIM_TICKS_PER_S);
+}
+
+
+int main(void)
+{
+    bool res;
+
+    begin(0);
+    res = stepper_set_probe_steps(1, 5000, 0);
+    res &= stepper_start(1);
+    report("probe", res);
+
+    begin(0);
+    res = stepper_set_probe_steps(1, 5000, 1);
+    res &= stepper_start(1);
+    report("probe_continue", res);
+
+    begin(0);
+    res = stepper_enqueue(1, STEPPER_MODE_PROBE, STEPPER_DIR_HIGH, 5000, 3000);
+    res &= stepper_enqueue(1, STEPPER_MODE_STEPS, STEPPER_DIR_LOW, 1000, 3000);
+    report("probe_queued", res);
+
+    begin(0);
+    res = stepper_enqueue(1, STEPPER_MODE_PROBE, STEPPER_DIR_HIGH, 1000, 3000);
+    report("probe_missed", res);
+    printf("bad mode=%d\n", stepper_enqueue(1, 5, STEPPER_DIR_HIGH, 10, 3000));
+
+    // A switch that stays closed, the latch holds the first edge.
+    begin(1);
+    release = 5000;
+    res = stepper_set_probe_steps(1, 5000, 1);
+    res &= stepper_start(1);
+    report("probe_filtered", res);
+    release = 1300;
+
+    begin(1);
+    glitch = true;
+    res = stepper_set_safe_steps(1, 5000);
+    res &= stepper_start(1);
+    report("safe_filtered", res);
+
+    begin(0);
+    res = stepper_set_safe_steps(1, 5000);
+    res &= stepper_start(1);
+    report("safe_unfiltered", res);
+
+    begin(1);
+    switches_set_config(0, SWITCHES_GC, 4000);
+    res = stepper_set_probe_steps(1, 5000, 1);
+    res &= stepper_start(1);
+    report("probe_glitch", res);
+    glitch = false;
+
+    begin(1);
+    switches_set_config(0, SWITCHES_GC & ~SWITCHES_R1_A, SWITCHES_FILTER_DEFAULT);
+    res = stepper_set_safe_steps(1, 2000);
+    res &= stepper_start(1);
+    report("r1a_disabled", res);
+
+    return 0;
+}
@@ -0,0 +1,95 @@
+/*
+ramp.c - Compares trapezoid move times with the ideal trapezoid.
+
+The time from the first to the last step edge of a move of n steps against
+a trapezoid of n - 1 steps that starts and ends at rest, for the computed
+ramp and for the flash table ramp of each acceleration preset.
+*/
+
+#include "sim.h"
+#include "stepper.h"
+#include <math.h>
+#include <stdio.h>
+#if __has_include("ramp_table.h")
+#include "ramp_table.h"
+#endif
+
+bool stepper_set_accel_preset(uint8_t stepper_num, uint8_t preset) __attribute__((weak));
+
+
+static double ideal(long n, double accel, double speed)
+{
+    double d = n - 1;
+
+    if (d >= speed * speed / accel) {
+        return d / speed + speed / accel;
+    }
+    return 2 * sqrt(d / accel);
+}
+
+
+// Runs a move on stepper 1 and returns how far its time is off ideal, in %.
+static double run(uint8_t preset, uint16_t accel, long n, uint16_t speed)
+{
+    long first;
+    double t;
+
+    sim_init();
+    stepper_set_max_speed(1, speed);
+    if (preset) {
+        stepper_set_accel_preset(1, preset);
+    } else {
+        stepper_set_accel(1, accel, accel);
+    }
+    stepper_set_steps(1, n);
+    stepper_start(1);
+    while (sim_steps[0] == 0) {
+        sim_tick();
+    }
+    first = sim_last_step[0];
+    sim_run(400000000L);
+    t = (double)(sim_last_step[0] - first) / SIM_TICKS_PER_S;
+
+    return 100 * (t / ideal(n, accel, speed) - 1);
+}
+
+
+int main(void)
+{
+    static const long steps[] = { 200, 2000, 10000 };
+    static const uint16_t speeds[] = { 800, 2800 };
+    static const uint16_t accels[] = { 500, 1000, 2000, 4000, 8000, 16000, 32000, 64000 };
+    double worst[2] = { 0, 0 };
+    double err[2];
+    uint8_t p;
+    uint8_t k;
+    uint8_t s;
+
+    for (p = 0; p < sizeof(accels) / sizeof(accels[0]); p++) {
+        for (k = 0; k < sizeof(steps) / sizeof(steps[0]); k++) {
+            for (s = 0; s < sizeof(speeds) / sizeof(speeds[0]); s++) {
+                uint16_t accel = accels[p];
+
+#ifdef RAMP_PRESET_NUM
+                accel = pgm_read_word(&ramp_preset_accel[p]);
+#endif
+                err[0] = run(0, accel, steps[k], speeds[s]);
+                printf("accel=%5u steps=%5ld speed=%4u computed=%+.3f%%", accel, steps[k], speeds[s], err[0]);
+                if (stepper_set_accel_preset) {
+                    err[1] = run(p + 1, accel, steps[k], speeds[s]);
+                    printf(" preset=%+.3f%% preset-computed=%+.3f%%", err[1], err[1] - err[0]);
+                    if (fabs(err[1] - err[0]) > fabs(worst[1])) {
+                        worst[1] = err[1] - err[0];
+                    }
+                }
+                printf("\n");
+                if (fabs(err[0]) > fabs(worst[0])) {
+                    worst[0] = err[0];
+                }
+            }
+        }
+    }
+    printf("worst computed=%+.3f%% preset-computed=%+.3f%%\n", worst[0], worst[1]);
+
+    return 0;
+}
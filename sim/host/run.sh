@@ -0,0 +1,96 @@
+#!/bin/sh
+# run.sh [tree [ref_tree]]
+#
+# Builds the firmware sources of tree (default: this checkout) for the host
+# with gcc, links each scenario in this directory against them and runs it.
+# With a ref_tree, runs every scenario against both trees and reports which
+# outputs differ. A scenario that needs something the tree doesn't have yet
+# is reported as not building against it. Each scenario gets SIM_TIMEOUT
+# seconds, 300 by default.
+#
+# The sources are copied and edited before they are built:
+# - OUTSET/OUTCLR writes become calls into sim.c, so a read of OUT right
+#   after sees the write and sim.c sees every step edge.
+# - Bytes sent on the UART go to sim.c, which keeps them for the scenario.
+# - stepper_init() calls stepper_get_dir() with a null pointer where it means
+#   stepper_set_dir(). That writes to address 0 on the AVR, a register, but
+#   faults on the host.
+
+here=$(cd "$(dirname "$0")" && pwd)
+tree=$(cd "${1:-$here/../..}" && pwd) || exit 1
+ref=$2
+out=${SIM_OUT:-/tmp/twostep_sim}
+CC=${CC:-gcc}
+CFLAGS="-std=gnu99 -fgnu89-inline -O1 -g -w -DF_CPU=32000000UL -include stdint.h"
+
+# build tree dir: builds the scenarios against tree into dir.
+build() {
+    rm -rf "$2"
+    mkdir -p "$2/src"
+    cp "$1"/*.c "$1"/*.h "$2/src/"
+    sed -i \
+        -e 's/\([A-Za-z_][A-Za-z0-9_]*\)\.OUTSET = \([^;]*\);/sim_port_set(\&\1, \2);/g' \
+        -e 's/\([A-Za-z_][A-Za-z0-9_]*\)\.OUTCLR = \([^;]*\);/sim_port_clr(\&\1, \2);/g' \
+        -e 's/\([A-Za-z_][][A-Za-z0-9_.]*\)->OUTSET = \([^;]*\);/sim_port_set(\1, \2);/g' \
+        -e 's/\([A-Za-z_][][A-Za-z0-9_.]*\)->OUTCLR = \([^;]*\);/sim_port_clr(\1, \2);/g' \
+        -e 's/stepper_get_dir(i+1, false)/stepper_set_dir(i+1, false)/' \
+        -e 's/USARTD0\.DATA = (c)/sim_uart_tx(c)/' \
+        "$2"/src/*.c "$2"/src/*.h
+    objs=""
+    for f in "$2"/src/*.c; do
+        [ "$(basename "$f")" = main.c ] && continue
+        o="$2/$(basename "$f" .c).o"
+        $CC $CFLAGS -I"$here/include" -I"$2/src" -c "$f" -o "$o" || return 1
+        objs="$objs $o"
+    done
+    $CC $CFLAGS -I"$here/include" -I"$2/src" -c "$here/sim.c" -o "$2/sim.o" || return 1
+    for s in "$here"/*.c; do
+        n=$(basename "$s" .c)
+        [ "$n" = sim ] && continue
+        $CC $CFLAGS -I"$here/include" -I"$here" -I"$2/src" -o "$2/$n" "$s" "$2/sim.o" $objs -lm \
+            2> "$2/$n.log" || rm -f "$2/$n"
+    done
+}
+
+# run dir: runs the scenarios built in dir, each output into dir/name.out.
+run() {
+    for s in "$here"/*.c; do
+        n=$(basename "$s" .c)
+        [ "$n" = sim ] && continue
+        if [ -x "$1/$n" ]; then
+            timeout "${SIM_TIMEOUT:-300}" "$1/$n" > "$1/$n.out" 2>&1 ||
+                echo "exited with $?, 124 is a timeout" >> "$1/$n.out"
+        else
+            echo "does not build against this tree, see $1/$n.log" > "$1/$n.out"
+        fi
+    done
+}
+
+build "$tree" "$out/tree" || exit 1
+run "$out/tree"
+if [ -z "$ref" ]; then
+    for s in "$here"/*.c; do
+        n=$(basename "$s" .c)
+        [ "$n" = sim ] && continue
+        echo "== $n"
+        cat "$out/tree/$n.out"
+    done
+    exit 0
+fi
+
+ref=$(cd "$ref" && pwd) || exit 1
+build "$ref" "$out/ref" || exit 1
+run "$out/ref"
+status=0
+for s in "$here"/*.c; do
+    n=$(basename "$s" .c)
+    [ "$n" = sim ] && continue
+    if cmp -s "$out/ref/$n.out" "$out/tree/$n.out"; then
+        echo "same $n"
+    else
+        echo "DIFF $n"
+        diff "$out/ref/$n.out" "$out/tree/$n.out" | sed 's/^/    /'
+        status=1
+    fi
+done
+exit $status
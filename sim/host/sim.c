@@ -0,0 +1,217 @@
+/*
+sim.c - Host simulation of the TwoStep timers and pins, see sim.h.
+*/
+
+#include "sim.h"
+#include "stepper.h"
+#include <string.h>
+
+
+PORT_t PORTA, PORTC, PORTD;
+TC4_t TCC4;
+TC5_t TCC5, TCD5;
+DAC_t DACA;
+USART_t USARTD0;
+PMIC_t PMIC;
+OSC_t OSC;
+CLK_t CLK;
+SLEEP_t SLEEP;
+volatile uint8_t CCP;
+
+long sim_steps[2];
+long sim_last_step[2];
+long sim_t;
+uint8_t sim_tx[SIM_TX_LEN];
+int sim_tx_len;
+void (*sim_on_step)(uint8_t i, PORT_t *port);
+void (*sim_inputs)(void);
+
+// Weak, so the scenarios also build against trees from before a handler was
+// added. A missing handler is never enabled by its tree.
+void TCC4_CCA_vect(void) __attribute__((weak));
+void TCC4_CCB_vect(void) __attribute__((weak));
+void TCC4_CCC_vect(void) __attribute__((weak));
+void TCC4_OVF_vect(void) __attribute__((weak));
+void TCC5_OVF_vect(void) __attribute__((weak));
+void TCD5_OVF_vect(void) __attribute__((weak));
+void PORTA_INT_vect(void) __attribute__((weak));
+void USARTD0_RXC_vect(void) __attribute__((weak));
+void perf_init(void) __attribute__((weak));
+void planner_init(void) __attribute__((weak));
+void switches_init(void) __attribute__((weak));
+
+
+void sim_port_set(PORT_t *port, uint8_t bm)
+{
+    uint8_t rising = bm & ~port->OUT;
+
+    port->OUT |= bm;
+    if (rising & PIN0_bm) {
+        uint8_t i = (port == &PORTD) ? 0 : (port == &PORTC) ? 1 : 2;
+
+        if (i < 2) {
+            sim_steps[i]++;
+            sim_last_step[i] = sim_t;
+            if (sim_on_step) {
+                sim_on_step(i, port);
+            }
+        }
+    }
+}
+
+
+void sim_port_clr(PORT_t *port, uint8_t bm)
+{
+    port->OUT &= ~bm;
+}
+
+
+void sim_uart_tx(uint8_t c)
+{
+    if (sim_tx_len < SIM_TX_LEN) {
+        sim_tx[sim_tx_len++] = c;
+    }
+}
+
+
+void sim_uart_rx(const uint8_t *buf, int len)
+{
+    while (len--) {
+        USARTD0.DATA = *buf++;
+        if (USARTD0_RXC_vect && (USARTD0.CTRLA & USART_RXCINTLVL_gm)) {
+            USARTD0_RXC_vect();
+        }
+    }
+}
+
+
+void sim_init(void)
+{
+    memset(&PORTA, 0, sizeof(PORTA));
+    memset(&PORTC, 0, sizeof(PORTC));
+    memset(&PORTD, 0, sizeof(PORTD));
+    memset(&TCC4, 0, sizeof(TCC4));
+    memset(&TCC5, 0, sizeof(TCC5));
+    memset(&TCD5, 0, sizeof(TCD5));
+    memset(&USARTD0, 0, sizeof(USARTD0));
+    PORTA.IN = 0xf0; // Switches released, they pull low
+    DACA.STATUS = DAC_CH0DRE_bm | DAC_CH1DRE_bm;
+    USARTD0.STATUS = USART_DREIF_bm | USART_TXCIF_bm;
+    OSC.STATUS = 0xff;
+    sim_steps[0] = sim_steps[1] = 0;
+    sim_last_step[0] = sim_last_step[1] = -1;
+    sim_t = 0;
+    sim_tx_len = 0;
+    sim_on_step = 0;
+    sim_inputs = 0;
+
+    if (perf_init) {
+        perf_init();
+    }
+    stepper_init();
+    if (planner_init) {
+        planner_init();
+    }
+    if (switches_init) {
+        switches_init();
+    }
+}
+
+
+void sim_switches(uint8_t in)
+{
+    if (in != PORTA.IN) {
+        PORTA.IN = in;
+        if (PORTA_INT_vect && (PORTA.INTCTRL & PORT_INTLVL_gm)) {
+            PORTA_INT_vect();
+        }
+    }
+}
+
+
+// Counts a timer one tick at a prescaler of DIV1 or DIV8, the only ones the
+// firmware uses, and returns true when it overflows.
+static bool sim_count(TC5_t *tc)
+{
+    uint8_t clk = tc->CTRLA & TC45_CLKSEL_gm;
+    uint16_t inc = (clk == TC45_CLKSEL_DIV1_gc) ? 8 : 1;
+    uint16_t cnt = tc->CNT;
+
+    if (clk == TC45_CLKSEL_OFF_gc) {
+        return false;
+    }
+    if (tc->PER && cnt + inc > tc->PER) {
+        tc->CNT = cnt + inc - tc->PER - 1;
+        return true;
+    }
+    tc->CNT = cnt + inc;
+    return tc->CNT < cnt;
+}
+
+
+void sim_tick(void)
+{
+    uint8_t ib;
+
+    if (sim_inputs) {
+        sim_inputs();
+    }
+    sim_t++;
+
+    if (sim_count(&TCC4)) {
+        TCC4.INTFLAGS |= TC4_OVFIF_bm;
+        if (TCC4_OVF_vect && (TCC4.INTCTRLA & TC45_OVFINTLVL_gm)) {
+            TCC4_OVF_vect();
+        }
+    }
+    if (TCC4.CTRLA & TC45_CLKSEL_gm) {
+        ib = TCC4.INTCTRLB;
+        if ((ib & TC45_CCAINTLVL_gm) && TCC4.CNT == TCC4.CCA) {
+            TCC4_CCA_vect();
+        }
+        if ((ib & TC45_CCBINTLVL_gm) && TCC4.CNT == TCC4.CCB) {
+            TCC4_CCB_vect();
+        }
+        if ((ib & TC45_CCCINTLVL_gm) && TCC4.CNT == TCC4.CCC) {
+            TCC4_CCC_vect();
+        }
+    }
+
+    if (sim_count(&TCC5) && TCC5_OVF_vect && (TCC5.INTCTRLA & TC45_OVFINTLVL_gm)) {
+        TCC5_OVF_vect();
+    }
+    if (sim_count(&TCD5) && TCD5_OVF_vect && (TCD5.INTCTRLA & TC45_OVFINTLVL_gm)) {
+        TCD5_OVF_vect();
+    }
+}
+
+
+bool sim_moving(void)
+{
+    uint8_t m1 = 0;
+    uint8_t m2 = 0;
+
+    stepper_get_moving(1, &m1);
+    stepper_get_moving(2, &m2);
+    return m1 || m2 || (TCC4.INTCTRLB & (TC45_CCAINTLVL_gm | TC45_CCBINTLVL_gm));
+}
+
+
+long sim_run(long max_ticks)
+{
+    long start = sim_t;
+
+    while (sim_t - start < max_ticks && sim_moving()) {
+        sim_tick();
+    }
+
+    return sim_t - start;
+}
+
+
+void sim_idle(long ticks)
+{
+    while (ticks--) {
+        sim_tick();
+    }
+}
@@ -0,0 +1,69 @@
+/*
+sim.h - Host simulation of the TwoStep timers and pins.
+
+The firmware sources are built for the host against the register stubs in
+include/, and sim.c plays the part of the hardware: it counts TCC4, TCC5 and
+TCD5 at their prescaled rates, raises their interrupts, and records every
+rising edge on the STEP pins. Time is in TCC4 ticks, 4 MHz. The handlers take
+no time, so this checks what the firmware does and when the steps land, not
+how long the interrupts run; sim/emu does that. The init functions don't
+reset every static, so a scenario that runs several moves after sim_init()
+can see state, like a probe result, left from the one before.
+*/
+
+#ifndef SIM_H_
+#define SIM_H_
+
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define SIM_TICKS_PER_S 4000000L
+
+// Step edges of each stepper since sim_init().
+extern long sim_steps[2];
+// Tick of the last step edge of each stepper, -1 before the first.
+extern long sim_last_step[2];
+// Ticks since sim_init().
+extern long sim_t;
+
+// Bytes the firmware sent on the UART since sim_init().
+#define SIM_TX_LEN 4096
+extern uint8_t sim_tx[SIM_TX_LEN];
+extern int sim_tx_len;
+
+// Called on each STEP edge with the stepper index and its port, after the
+// edge. Scenarios that don't need it leave it null.
+extern void (*sim_on_step)(uint8_t i, PORT_t *port);
+// Called before each tick, to drive the switch inputs. Null for none.
+extern void (*sim_inputs)(void);
+
+
+// Resets the registers with the switches released, then runs the init
+// functions of the firmware the way main() does, all but the UART.
+void sim_init(void);
+
+// Sets the switch inputs on PORTA and runs the pin change interrupt if they
+// changed.
+void sim_switches(uint8_t in);
+
+// Receives bytes on the UART, running the RX interrupt for each.
+void sim_uart_rx(const uint8_t *buf, int len);
+
+// Advances one TCC4 tick.
+void sim_tick(void);
+
+// True while a stepper is moving or a step compare is pending.
+bool sim_moving(void);
+
+// Ticks until no stepper is moving and no step compare is pending, or for
+// max_ticks. Returns the ticks it ran.
+long sim_run(long max_ticks);
+
+// Ticks for a fixed time.
+void sim_idle(long ticks);
+
+
+#endif
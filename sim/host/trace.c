@@ -0,0 +1,98 @@
+/*
+trace.c - Step trace timing, the timer wrap markers and the bulk dump.
+
+Steps 25 ms apart, so the step timer wraps between them, and the gaps rebuilt
+from the trace with its wrap markers. An event recorded while a wrap is
+pending but not yet counted. A full buffer read back with DUMP_TRACE_ALL,
+frame by frame, then the same with an empty one.
+*/
+
+#include "sim.h"
+#include "stepper.h"
+#include "trace.h"
+#include "twostep_common_lib.h"
+#include "twostep_parser.h"
+#include "uart.h"
+#include <stdio.h>
+
+// Weak, trees from before the receive buffer parse with a blocking read.
+bool uart_char_receive(uint8_t *c) __attribute__((weak));
+
+
+static void dump_all(const char *name)
+{
+    static const uint8_t frame[] = { '=', TWOSTEP_DUMP_TRACE_ALL, '\r', '\n' };
+    int frames = 0;
+    int entries = 0;
+    int k;
+
+    sim_tx_len = 0;
+    sim_uart_rx(frame, sizeof(frame));
+    while (twostep_parser_parse());
+    for (k = 0; k + TWOSTEP_DUMP_TRACE_ALL_RESP_LEN <= sim_tx_len; k += TWOSTEP_DUMP_TRACE_ALL_RESP_LEN) {
+        printf("%s frame %d count=%02x dropped=%u\n", name, ++frames, sim_tx[k + 3],
+               sim_tx[k + 4] | sim_tx[k + 5] << 8);
+        entries += sim_tx[k + 3] & ~TWOSTEP_TRACE_MORE;
+    }
+    printf("%s frames=%d entries=%d bytes=%d\n", name, frames, entries, sim_tx_len);
+}
+
+
+int main(void)
+{
+    struct trace_entry e[TRACE_READ_LEN];
+    uint16_t dropped = 0;
+    uint8_t n;
+    uint8_t k;
+    long base = 0;
+    long prev = -1;
+
+    sim_init();
+    uart_init(BAUD_115200);
+    trace_set_enable(1);
+    stepper_set_100uS_delay(1, 250);
+    stepper_set_steps(1, 5);
+    stepper_start(1);
+    sim_run(4000000L);
+
+    printf("gaps:");
+    do {
+        trace_read(&n, &dropped, e);
+        for (k = 0; k < n; k++) {
+            if (e[k].event == TRACE_WRAP) {
+                base += 65536L * e[k].time;
+                printf(" [wrap %u]", e[k].time);
+                continue;
+            }
+            if (prev >= 0) {
+                printf(" %ld", base + e[k].time - prev);
+            }
+            prev = base + e[k].time;
+        }
+    } while (n);
+    printf("\nexpect 100400 ticks, (250 + 1) * 100 us, dropped=%u\n", dropped);
+
+    // The overflow flag is set but its interrupt hasn't run yet.
+    TCC4.CNT = 5;
+    TCC4.INTFLAGS |= TC4_OVFIF_bm;
+    trace_record(TRACE_STEP);
+    TCC4.INTFLAGS &= ~TC4_OVFIF_bm;
+    trace_read(&n, &dropped, e);
+    printf("pending wrap: n=%u", n);
+    for (k = 0; k < n; k++) {
+        printf(" %02x:%u", e[k].event, e[k].time);
+    }
+    printf("\n");
+
+    if (!uart_char_receive) {
+        printf("no receive buffer, the parser would block\n");
+        return 0;
+    }
+    for (k = 0; k < TRACE_BUF_LEN + 8; k++) {
+        trace_record(TRACE_STEP | 1);
+    }
+    dump_all("full");
+    dump_all("empty");
+
+    return 0;
+}
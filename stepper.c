@@ -21,375 +21,3311 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 
 #include "stepper.h"
 #include "switches.h"
+#include "planner.h"
+#include "perf.h"
+#include "trace.h"
+#include "ramp_table.h"
 #include <avr/interrupt.h>
+#include <util/atomic.h>
+#include <stddef.h>
 
 
-static volatile bool steppers_running = false;
 static volatile bool stepper_running[STEPPER_MAX_STEPPER_NUM];
 
 static volatile uint16_t stepper_delay_increments[STEPPER_MAX_STEPPER_NUM];
-static volatile uint16_t stepper_delay_count[STEPPER_MAX_STEPPER_NUM];
 
-static volatile uint32_t stepper_step_count[STEPPER_MAX_STEPPER_NUM];
-static volatile bool stepper_high[STEPPER_MAX_STEPPER_NUM];
+// Rate of moves without acceleration in steps/s (Q16.16), and the matching
+// step period in timer ticks plus 1/256th ticks. Set by stepper_set_rate() or
+// stepper_set_100uS_delay().
+static volatile uint32_t stepper_rate[STEPPER_MAX_STEPPER_NUM];
+static volatile uint32_t stepper_fixed_period[STEPPER_MAX_STEPPER_NUM];
+static volatile uint8_t stepper_fixed_frac[STEPPER_MAX_STEPPER_NUM];
+
+// What the step ISR and the profile tick work on, kept in one record per
+// stepper so it is reached through a single pointer.
+#define STEPPER_FLAG_UNTIL_SWITCH 0x01 // Step until a switch triggers
+#define STEPPER_FLAG_SAFELY 0x02 // Stop if a switch triggers
+#define STEPPER_FLAG_JOG 0x04 // Velocity mode, see stepper_set_target_velocity()
+#define STEPPER_FLAG_LIMITED 0x08 // Shortened to end at a soft limit
+#define STEPPER_FLAG_PROBE 0x10 // Latch the position a switch triggers at
+
+// Until the first step nothing is known about the backlash.
+#define STEPPER_DIR_UNKNOWN 0xff
+
+struct stepper_axis {
+    uint32_t step_count;
+    int32_t position; // Absolute position in steps, DIR high counts up.
+    // Timer ticks until the next step, either the fixed period or derived
+    // from the ramp. The fractional part is in 1/256th ticks and is
+    // accumulated in phase, each time it wraps a step is delayed by one
+    // extra tick.
+    uint32_t period;
+    uint8_t period_frac;
+    uint8_t phase;
+    uint8_t flags; // Only changed by the ISR, or while the stepper is stopped
+    // Position counts per step pulse, only above 1 while automatic
+    // microstepping runs a coarser resolution, see stepper_ustep_update().
+    uint8_t ustep;
+    // Driver phase in 1/16 steps and how far each pulse moves it, full step
+    // positions are the multiples of STEPPER_USTEP_FULL.
+    uint8_t elec;
+    uint8_t elec_inc;
+    // DIR of the last step and the backlash steps still to take before the
+    // next one, see stepper_backlash_step().
+    uint8_t last_dir;
+    uint16_t backlash;
+    // Timer ticks still to wait once the pending compare fires, for periods
+    // that don't fit in a single compare.
+    uint32_t wait;
+    // Step, DIR and microstep pins, set by stepper_init().
+    PORT_t *port;
+    uint8_t step_bm;
+    uint8_t dir_bm;
+    uint8_t ms1_bm;
+    uint8_t ms2_bm;
+    // Ramp of the running move, see stepper_move_init() and
+    // stepper_ramp_step().
+    uint8_t ramp_state;
+    uint8_t ramp_profile; // Profile of the running move
+    int32_t ramp_n;
+    uint32_t ramp_delay; // Q24.8 ticks per step
+    uint32_t ramp_min_delay; // Q24.8 ticks per step
+    uint32_t ramp_decel_steps;
+    uint32_t ramp_end_n; // Ramp step of the exit speed
+    // S-curve limits and state, see stepper_scurve_update().
+    uint32_t scurve_jerk;
+    uint32_t scurve_accel_max;
+    uint32_t scurve_decel_max;
+    uint32_t scurve_accel;
+    uint32_t scurve_speed;
+    uint32_t scurve_speed_max;
+    uint32_t scurve_speed_min;
+    uint32_t scurve_speed_jerk;
+    uint32_t scurve_speed_start;
+    // Velocity mode. The profile tick ramps the speed towards the target, the
+    // speeds are Q16.16 steps/s and the ramp limits Q16.16 steps/s per tick.
+    int32_t jog_target; // steps/s, negative runs DIR low
+    uint32_t jog_speed;
+    uint32_t jog_speed_min;
+    uint32_t jog_accel;
+    uint32_t jog_decel;
+    uint8_t jog_dir;
+    // Current levels and the idle time, see stepper_current_tick().
+    uint16_t current_run;
+    uint16_t current_hold;
+    uint16_t current_boost;
+    uint16_t hold_timeout; // ms
+    uint16_t idle_ms;
+    uint8_t current_level;
+};
+
+static volatile struct stepper_axis stepper_axis[STEPPER_MAX_STEPPER_NUM];
+
+// Automatic microstepping, see stepper_set_auto_microsteps(). The rate is
+// in 1/16 steps/s and the period is the matching step period, zero is off.
+#define STEPPER_USTEP_FULL 16
+static volatile uint16_t stepper_ustep_auto_rate[STEPPER_MAX_STEPPER_NUM];
+static volatile uint32_t stepper_ustep_auto_period[STEPPER_MAX_STEPPER_NUM];
+
+// Microstep bitfield last set with stepper_set_microsteps(), put back when
+// automatic microstepping is turned off.
+static volatile uint8_t stepper_microsteps[STEPPER_MAX_STEPPER_NUM];
+
+// Backlash compensation, see stepper_set_backlash(). The rate is in steps/s
+// and the period is the matching step period.
+static volatile uint16_t stepper_backlash[STEPPER_MAX_STEPPER_NUM];
+static volatile uint16_t stepper_backlash_rate[STEPPER_MAX_STEPPER_NUM];
+static volatile uint32_t stepper_backlash_period[STEPPER_MAX_STEPPER_NUM];
+
+// Soft travel limits, see stepper_set_soft_limits(), and why each stepper
+// last stopped.
+static volatile bool stepper_limit_on[STEPPER_MAX_STEPPER_NUM];
+static volatile int32_t stepper_limit_min[STEPPER_MAX_STEPPER_NUM];
+static volatile int32_t stepper_limit_max[STEPPER_MAX_STEPPER_NUM];
+static volatile uint8_t stepper_stop_reason[STEPPER_MAX_STEPPER_NUM];
+
+// Probe latch, see stepper_set_probe_steps(). The time is the TCC4 count at
+// the switch edge. stepper_probe_edge() latches the position and time and
+// sets the stepper's bit in edge, the ISR then stops the move and sets the
+// state.
+static volatile uint8_t stepper_probe_state[STEPPER_MAX_STEPPER_NUM];
+static volatile int32_t stepper_probe_pos[STEPPER_MAX_STEPPER_NUM];
+static volatile uint16_t stepper_probe_time[STEPPER_MAX_STEPPER_NUM];
+static volatile uint8_t stepper_probe_edge_bm;
+
+// Electronic gearing, see stepper_set_gearing(). Stepper 2 takes num steps
+// for every den steps of stepper 1, the remainder is kept in error.
+static volatile bool stepper_gear_on;
+static volatile bool stepper_gear_reverse;
+static volatile uint16_t stepper_gear_num;
+static volatile uint16_t stepper_gear_den;
+static volatile uint16_t stepper_gear_error;
+
+// Gantry mode, see stepper_set_gantry(). Gearing at 1:1 that homing lets go
+// of while it squares the two sides.
+static volatile bool stepper_gantry;
+
+// Ramp parameters, see stepper_move_init() and stepper_ramp_step().
+static volatile uint16_t stepper_accel[STEPPER_MAX_STEPPER_NUM];
+static volatile uint16_t stepper_decel[STEPPER_MAX_STEPPER_NUM];
+static volatile uint16_t stepper_max_speed[STEPPER_MAX_STEPPER_NUM];
+
+// Acceleration preset and its delay scale, see stepper_set_accel_preset().
+// Moves that use it run with the internal STEPPER_PROFILE_TABLE profile.
+#define STEPPER_PROFILE_TABLE 0x02
+static volatile uint8_t stepper_accel_preset[STEPPER_MAX_STEPPER_NUM];
+static volatile uint16_t stepper_ramp_scale[STEPPER_MAX_STEPPER_NUM];
+
+// S-curve parameters and state, see stepper_scurve_limits(),
+// stepper_scurve_init() and stepper_scurve_update(). Speeds are Q16.16
+// steps/s, accelerations and jerk are Q8.24 steps/s per profile update.
+static volatile uint8_t stepper_profile[STEPPER_MAX_STEPPER_NUM];
+static volatile uint32_t stepper_jerk[STEPPER_MAX_STEPPER_NUM];
+
+// Current levels, the profile tick switches between them. A zero boost uses
+// the run current, a zero hold timeout never drops to the hold current.
+#define STEPPER_LEVEL_HOLD 0
+#define STEPPER_LEVEL_RUN 1
+#define STEPPER_LEVEL_BOOST 2
+
+// Coordinated two axis moves, see stepper_move_linear(). The major axis is
+// stepped as usual and the minor axis follows it using Bresenham.
+static volatile bool stepper_coord = false;
+static volatile uint8_t stepper_coord_major;
+static volatile uint8_t stepper_coord_minor;
+static volatile uint32_t stepper_coord_major_steps;
+static volatile uint32_t stepper_coord_minor_steps;
+static volatile int32_t stepper_coord_error;
+static volatile bool stepper_planned = false; // Running segments from the planner
+
+// Circular arcs, see stepper_move_arc(). These run as a coordinated move
+// driven by the stepper 1 compare. The position is relative to the center
+// and stepper_arc_f is x^2 + y^2 - r^2, kept up to date incrementally.
+static volatile bool stepper_arc = false;
+static volatile bool stepper_arc_full;
+static volatile bool stepper_arc_cw;
+static volatile int32_t stepper_arc_x;
+static volatile int32_t stepper_arc_y;
+static volatile int32_t stepper_arc_end_x;
+static volatile int32_t stepper_arc_end_y;
+static volatile int32_t stepper_arc_f;
+static volatile uint32_t stepper_arc_steps;
+static volatile uint8_t stepper_arc_mask; // Steppers to step next
+static volatile int8_t stepper_arc_dx;
+static volatile int8_t stepper_arc_dy;
+
+// Moves queued behind the running one, the ISR starts the next one as soon
+// as the running move ends. Must be a power of two.
+#define STEPPER_QUEUE_MASK (STEPPER_QUEUE_LEN - 1)
+static struct stepper_move stepper_queue[STEPPER_MAX_STEPPER_NUM][STEPPER_QUEUE_LEN];
+static volatile uint8_t stepper_queue_head[STEPPER_MAX_STEPPER_NUM];
+static volatile uint8_t stepper_queue_count[STEPPER_MAX_STEPPER_NUM];
+
+// Homing runs a fast seek, a back-off and a slow re-seek from the ISR. Only
+// the config is kept, the ISR works out the move of each stage as it starts
+// it, see stepper_home_move().
+static volatile uint8_t stepper_home_state[STEPPER_MAX_STEPPER_NUM];
+static volatile int32_t stepper_home_switch_pos[STEPPER_MAX_STEPPER_NUM]; // Position the switch was found at
+static uint8_t stepper_home_dir[STEPPER_MAX_STEPPER_NUM]; // Direction of the switch
+static uint16_t stepper_home_fast_speed[STEPPER_MAX_STEPPER_NUM];
+static uint16_t stepper_home_slow_speed[STEPPER_MAX_STEPPER_NUM];
+static uint32_t stepper_home_backoff[STEPPER_MAX_STEPPER_NUM];
+
+
+#define STEPPER_RAMP_OFF 0
+#define STEPPER_RAMP_ACCEL 1
+#define STEPPER_RAMP_CRUISE 2
+#define STEPPER_RAMP_DECEL 3
+
+// TCC4 free runs at 32Mhz/8. Each stepper schedules its next step on its
+// own compare channel, CCA for stepper 1 and CCB for stepper 2. CCC is the
+// profile update tick.
+#define STEPPER_TIMER_FREQ 4000000UL
+#define STEPPER_TIMER_TICKS_100US 400UL
+
+// Worst case cycles of a step compare ISR and of the profile tick, measured
+// with both steppers running and every option on. Both steppers can come due
+// together with the tick in between, so the shortest step period has to hold
+// two step ISRs and a tick. The first step of a queued move also loads it and
+// runs longer, the late compare handling below catches up on that.
+#define STEPPER_ISR_MAX_CYCLES 2850UL
+#define STEPPER_TICK_MAX_CYCLES 5450UL
+
+// Shortest step period, this bounds the ISR load.
+#define STEPPER_TIMER_MIN_PERIOD ((2 * STEPPER_ISR_MAX_CYCLES + STEPPER_TICK_MAX_CYCLES) / (F_CPU / STEPPER_TIMER_FREQ))
+
+// Compares scheduled closer than this to the counter (or in the past) are
+// pushed out so they can't be missed.
+#define STEPPER_TIMER_MIN_LEAD 16
+
+// Longer periods are split up so a compare is never more than half the
+// counter range away.
+#define STEPPER_TIMER_MAX_CHUNK 0x8000UL
+#define STEPPER_TIMER_SPLIT_CHUNK 0x4000UL
+
+#define STEPPER_RAMP_MIN_DELAY (STEPPER_TIMER_MIN_PERIOD << 8)
+
+// First step delay from AVR446: c0 = 0.676 * f * sqrt(2 / accel).
+// Scaled by 16 so it can be divided by sqrt(accel << 8).
+#define STEPPER_RAMP_C0_SCALE ((uint32_t)(STEPPER_TIMER_FREQ * 0.676 * 1.41421356 * 16))
+
+// The S-curve profile is integrated once every millisecond.
+#define STEPPER_PROFILE_FREQ 1000UL
+#define STEPPER_PROFILE_TICKS (STEPPER_TIMER_FREQ / STEPPER_PROFILE_FREQ)
+
+
+// Sets the step period of stepper i from a Q24.8 ramp delay.
+static inline void stepper_period_set(uint8_t i, uint32_t ramp_delay)
+{
+    stepper_axis[i].period = ramp_delay >> 8;
+    stepper_axis[i].period_frac = ramp_delay;
+}
 
-static volatile bool stepper_step_until_switch[STEPPER_MAX_STEPPER_NUM];
 
-static volatile bool stepper_step_safely[STEPPER_MAX_STEPPER_NUM];
+// Converts a 100uS delay value to a step period in timer ticks.
+static inline uint32_t stepper_delay_to_period(uint16_t delay)
+{
+    return (delay + 1UL) * STEPPER_TIMER_TICKS_100US;
+}
 
 
-ISR(TCC4_OVF_vect)
+// Q24.8 delay of ramp step n from the delay table, n counts down to zero
+// speed while decelerating. Past the first RAMP_TABLE_LEN steps the octave
+// table segment is picked by the bits after the leading one of 2 * n + 1
+// and interpolated with the 7 bits after those, see ramp_table.py. The
+// leading one is found with at most three byte tests and three shifts, and
+// the result shifted in five fixed steps, so the cost hardly depends on n.
+static inline uint32_t stepper_ramp_table_delay(uint16_t scale, int32_t n)
 {
-    uint8_t i;
-    // Clear interrupt flag
-    TCC4.INTFLAGS = TC4_OVFIF_bm;
+    uint32_t x = (n >= 0) ? (uint32_t)n : (uint32_t)-(n + 1);
+    uint8_t shift = RAMP_TABLE_SHIFT + 4;
+    uint8_t odd = 0;
+    uint16_t w;
+    uint8_t low;
+    uint8_t j;
+    uint8_t frac;
+    uint16_t a;
+    uint16_t b;
+    uint32_t res;
+
+    if (x < RAMP_TABLE_LEN) {
+        return ((uint32_t)pgm_read_word(&ramp_table[x]) * scale) >> RAMP_TABLE_SHIFT;
+    }
+
+    // A 24 bit window from the top non-zero byte of x, every two bits it
+    // sits higher halve the delay.
+    x = (x << 1) + 1;
+    if (x >> 24) {
+        w = x >> 16;
+        low = x >> 8;
+        shift += 12;
+    } else if (x >> 16) {
+        w = x >> 8;
+        low = x;
+        shift += 8;
+    } else if (x >> 8) {
+        w = x;
+        low = 0;
+        shift += 4;
+    } else {
+        w = x << 8;
+        low = 0;
+    }
+
+    // Moves the leading one to bit 15.
+    if (!(w >> 12)) {
+        w = (w << 4) | (low >> 4);
+        low <<= 4;
+        shift -= 2;
+    }
+    if (!(w >> 14)) {
+        w = (w << 2) | (low >> 6);
+        low <<= 2;
+        shift -= 1;
+    }
+    if (!(w >> 15)) {
+        w = (w << 1) | (low >> 7);
+        shift -= 1;
+        odd = 1;
+    }
+
+    j = (uint8_t)(w >> (15 - RAMP_TABLE_SEG_BITS)) & (RAMP_TABLE_SEGS - 1);
+    frac = (uint8_t)(w >> (8 - RAMP_TABLE_SEG_BITS)) & 0x7f;
+    a = pgm_read_word(&ramp_table_octave[odd][j]);
+    b = pgm_read_word(&ramp_table_octave[odd][j + 1]);
+    res = (uint32_t)(a - (uint16_t)((a - b) * frac >> 7)) * scale;
+
+    if (shift & 16) {
+        res >>= 16;
+    }
+    if (shift & 8) {
+        res >>= 8;
+    }
+    if (shift & 4) {
+        res >>= 4;
+    }
+    if (shift & 2) {
+        res >>= 2;
+    }
+    if (shift & 1) {
+        res >>= 1;
+    }
+
+    return res;
+}
+
 
-    if (!steppers_running) {
+// Called by the ISR after each step to work out the delay of the next one.
+// The delay is computed incrementally as described in Atmel AVR446, or
+// looked up in the delay table for an acceleration preset. A pulse
+// of a coarser microstep resolution covers several ramp steps at once, the
+// delay change of the last one is taken for all of them.
+static inline void stepper_ramp_step(uint8_t i, uint8_t steps)
+{
+    uint8_t state = stepper_axis[i].ramp_state;
+    uint32_t delay = stepper_axis[i].ramp_delay;
+    int32_t n = stepper_axis[i].ramp_n;
+
+    if (state == STEPPER_RAMP_OFF) {
         return;
     }
 
-    for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
-        if (stepper_running[i] && (stepper_step_safely[i] || stepper_step_until_switch[i])) {
-            stepper_running[i] = (i == 0) ? !switch_r1a_or_r1b_triggered() : !switch_r2a_or_r2b_triggered();
+    if (!(stepper_axis[i].flags & STEPPER_FLAG_UNTIL_SWITCH)) {
+        if (stepper_axis[i].step_count == 0) {
+            return;
         }
-        if (stepper_running[i] && !stepper_step_until_switch[i] && !stepper_high[i] && stepper_step_count[i] == 0) {
-            stepper_running[i] = false;
+        if (state != STEPPER_RAMP_DECEL && stepper_axis[i].step_count <= stepper_axis[i].ramp_decel_steps) {
+            state = STEPPER_RAMP_DECEL;
+            n = -(int32_t)(stepper_axis[i].step_count + stepper_axis[i].ramp_end_n) - steps;
+            stepper_axis[i].scurve_accel = 0;
+            stepper_axis[i].scurve_speed_jerk = 0;
+            stepper_axis[i].scurve_speed_start = stepper_axis[i].scurve_speed;
         }
-        if (stepper_running[i]) {
-            if (stepper_delay_count[i] == 0) {
-                if (stepper_high[i]) {
-                    if (i == 0) {
-                        PORTD.OUTSET = PIN0_bm; // STEP_1
-                    } else {
-                        PORTC.OUTSET = PIN0_bm; // Step 2
-                    }
-                    stepper_high[i] = false;
-                } else {
-                    if (i == 0) {
-                        PORTD.OUTCLR = PIN0_bm; // STEP_1
-                    } else {
-                        PORTC.OUTCLR = PIN0_bm; // Step 2
-                    }
-                    stepper_high[i] = true;
-                    if (!stepper_step_until_switch[i]) {
-                        stepper_step_count[i]--;
-                    }
-                }
-                stepper_delay_count[i] = stepper_delay_increments[i];
-            } else {
-                stepper_delay_count[i]--;
+    }
+
+    // The S-curve delay is updated by stepper_scurve_update() instead.
+    if (stepper_axis[i].ramp_profile == STEPPER_PROFILE_SCURVE) {
+        stepper_axis[i].ramp_state = state;
+        return;
+    }
+
+    if (state != STEPPER_RAMP_CRUISE) {
+        n += steps;
+        if (stepper_axis[i].ramp_profile == STEPPER_PROFILE_TABLE) {
+            delay = stepper_ramp_table_delay(stepper_ramp_scale[i], n);
+        } else if (n >= 0) {
+            // Unsigned, twice the first delay of a slow ramp takes all 32
+            // bits. Decelerating 4 * n + 1 is negative and the delay grows.
+            delay -= (delay << 1) / (uint32_t)(4 * n + 1) * steps;
+        } else {
+            delay += (delay << 1) / (uint32_t)-(4 * n + 1) * steps;
+        }
+        if (state == STEPPER_RAMP_ACCEL && delay <= stepper_axis[i].ramp_min_delay) {
+            delay = stepper_axis[i].ramp_min_delay;
+            state = STEPPER_RAMP_CRUISE;
+        }
+    }
+
+    stepper_axis[i].ramp_state = state;
+    stepper_axis[i].ramp_delay = delay;
+    stepper_axis[i].ramp_n = n;
+    stepper_period_set(i, delay);
+}
+
+
+// Converts a Q16.16 speed in steps/s to a Q24.8 ramp delay.
+static inline uint32_t stepper_speed_to_ramp_delay(uint32_t speed)
+{
+    return ((STEPPER_TIMER_FREQ << 8) / (speed >> 8)) << 8;
+}
+
+
+// Called by the ISR once per profile update to integrate the S-curve. The
+// acceleration is ramped at the jerk limit, and ramped back down once the
+// speed left to gain (or lose) equals what was gained while ramping it up.
+static inline void stepper_scurve_update(uint8_t i)
+{
+    uint8_t state = stepper_axis[i].ramp_state;
+    uint32_t accel = stepper_axis[i].scurve_accel;
+    uint32_t speed = stepper_axis[i].scurve_speed;
+    uint32_t speed_max = stepper_axis[i].scurve_speed_max;
+    uint32_t speed_min = stepper_axis[i].scurve_speed_min;
+    uint32_t jerk = stepper_axis[i].scurve_jerk;
+    uint32_t delta;
+
+    if (state == STEPPER_RAMP_ACCEL) {
+        if (speed_max - speed <= stepper_axis[i].scurve_speed_jerk) {
+            accel = (accel > (jerk << 1)) ? accel - jerk : jerk;
+        } else if (accel < stepper_axis[i].scurve_accel_max) {
+            accel += jerk;
+            stepper_axis[i].scurve_speed_jerk = speed - stepper_axis[i].scurve_speed_start;
+        }
+        delta = accel >> 8;
+        if (speed_max - speed <= delta) {
+            speed = speed_max;
+            accel = 0;
+            state = STEPPER_RAMP_CRUISE;
+        } else {
+            speed += delta;
+        }
+    } else if (state == STEPPER_RAMP_DECEL) {
+        if (speed - speed_min <= stepper_axis[i].scurve_speed_jerk) {
+            accel = (accel > (jerk << 1)) ? accel - jerk : jerk;
+        } else if (accel < stepper_axis[i].scurve_decel_max) {
+            accel += jerk;
+            stepper_axis[i].scurve_speed_jerk = stepper_axis[i].scurve_speed_start - speed;
+        }
+        delta = accel >> 8;
+        if (speed - speed_min <= delta) {
+            speed = speed_min;
+        } else {
+            speed -= delta;
+        }
+    } else {
+        return;
+    }
+
+    stepper_axis[i].ramp_state = state;
+    stepper_axis[i].scurve_accel = accel;
+    stepper_axis[i].scurve_speed = speed;
+    stepper_period_set(i, stepper_speed_to_ramp_delay(speed));
+}
+
+
+// Makes a precomputed move the current move of stepper i. Called by the ISR
+// when it starts a queued move, so it only copies.
+static __attribute__((noinline)) void stepper_move_load(uint8_t i, const struct stepper_move *move)
+{
+    stepper_axis[i].step_count = move->steps;
+    if (move->mode == STEPPER_MODE_UNTIL_SWITCH) {
+        stepper_axis[i].flags = STEPPER_FLAG_UNTIL_SWITCH | STEPPER_FLAG_SAFELY;
+    } else if (move->mode == STEPPER_MODE_SAFE_STEPS) {
+        stepper_axis[i].flags = STEPPER_FLAG_SAFELY;
+    } else if (move->mode == STEPPER_MODE_PROBE) {
+        stepper_axis[i].flags = STEPPER_FLAG_PROBE | STEPPER_FLAG_SAFELY;
+    } else if (move->mode == STEPPER_MODE_PROBE_CONTINUE) {
+        stepper_axis[i].flags = STEPPER_FLAG_PROBE;
+    } else {
+        stepper_axis[i].flags = 0;
+    }
+    if (stepper_axis[i].flags & STEPPER_FLAG_PROBE) {
+        stepper_probe_edge_bm &= ~(1 << i);
+        stepper_probe_state[i] = STEPPER_PROBE_ARMED;
+    }
+
+    stepper_axis[i].period = move->period;
+    stepper_axis[i].period_frac = move->period_frac;
+    stepper_axis[i].phase = 0;
+    stepper_axis[i].ramp_state = move->ramp_state;
+    stepper_axis[i].ramp_profile = move->profile;
+    stepper_axis[i].ramp_n = move->ramp_n;
+    stepper_axis[i].ramp_end_n = move->ramp_end_n;
+    stepper_axis[i].ramp_decel_steps = move->ramp_decel_steps;
+
+    if (move->profile == STEPPER_PROFILE_SCURVE) {
+        stepper_axis[i].scurve_speed_max = move->scurve_speed_max;
+        stepper_axis[i].scurve_speed_min = move->scurve_speed_min;
+        stepper_axis[i].scurve_speed = move->scurve_speed_min;
+        stepper_axis[i].scurve_speed_start = move->scurve_speed_min;
+        stepper_axis[i].scurve_speed_jerk = 0;
+        stepper_axis[i].scurve_accel = 0;
+    } else {
+        stepper_axis[i].ramp_delay = move->ramp_delay;
+        stepper_axis[i].ramp_min_delay = move->ramp_min_delay;
+    }
+}
+
+
+// Starts a step pulse and counts it in the position, the sign is taken from
+// the DIR pin so it stays right whoever set it.
+static inline void stepper_step_high(uint8_t i)
+{
+    PORT_t *port = stepper_axis[i].port;
+    volatile struct stepper_axis *ax = &stepper_axis[i];
+
+    port->OUTSET = stepper_axis[i].step_bm;
+    trace_record(TRACE_STEP | i);
+    if (port->OUT & stepper_axis[i].dir_bm) {
+        ax->position += ax->ustep;
+        ax->elec += ax->elec_inc;
+        ax->last_dir = STEPPER_DIR_HIGH;
+    } else {
+        ax->position -= ax->ustep;
+        ax->elec -= ax->elec_inc;
+        ax->last_dir = STEPPER_DIR_LOW;
+    }
+}
+
+
+static inline void stepper_step_low(uint8_t i)
+{
+    stepper_axis[i].port->OUTCLR = stepper_axis[i].step_bm;
+}
+
+
+static inline void stepper_dir_set(uint8_t i, uint8_t dir)
+{
+    if (dir) {
+        stepper_axis[i].port->OUTSET = stepper_axis[i].dir_bm;
+    } else {
+        stepper_axis[i].port->OUTCLR = stepper_axis[i].dir_bm;
+    }
+}
+
+
+// Sets the microstep pins of stepper i from a microstep bitfield.
+static inline void stepper_ms_set(uint8_t i, uint8_t stepper_microstep_bitfield)
+{
+    uint8_t ms_gm = stepper_axis[i].ms1_bm | stepper_axis[i].ms2_bm;
+    uint8_t ms = 0;
+
+    if (stepper_microstep_bitfield & 0x01) {
+        ms |= stepper_axis[i].ms1_bm;
+    }
+    if (stepper_microstep_bitfield & 0x02) {
+        ms |= stepper_axis[i].ms2_bm;
+    }
+    stepper_axis[i].port->OUTCLR = ms_gm & ~ms;
+    stepper_axis[i].port->OUTSET = ms;
+}
+
+
+// Puts stepper i back to the microstep setting of stepper_set_microsteps().
+static void stepper_ms_restore(uint8_t i)
+{
+    uint8_t elec_inc;
+
+    switch (stepper_microsteps[i]) {
+    case STEPPER_MICROSTEP_BITFIELD_HALF_STEP:
+        elec_inc = 8;
+        break;
+    case STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP:
+        elec_inc = 4;
+        break;
+    case STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP:
+        elec_inc = 1;
+        break;
+    default:
+        elec_inc = STEPPER_USTEP_FULL;
+        break;
+    }
+    stepper_ms_set(i, stepper_microsteps[i]);
+    stepper_axis[i].ustep = 1;
+    stepper_axis[i].elec_inc = elec_inc;
+}
+
+
+// Switches the automatic microstep resolution of stepper i, ustep is the
+// number of 1/16 steps per pulse.
+static inline void stepper_ustep_set(uint8_t i, uint8_t ustep)
+{
+    uint8_t ms;
+
+    switch (ustep) {
+    case 16:
+        ms = STEPPER_MICROSTEP_BITFIELD_FULL_STEP;
+        break;
+    case 8:
+        ms = STEPPER_MICROSTEP_BITFIELD_HALF_STEP;
+        break;
+    case 4:
+        ms = STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP;
+        break;
+    default:
+        ms = STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP;
+        ustep = 1;
+        break;
+    }
+    stepper_ms_set(i, ms);
+    stepper_axis[i].ustep = ustep;
+    stepper_axis[i].elec_inc = ustep;
+}
+
+
+// Called by the ISR after each step while automatic microstepping is on.
+// Picks the coarsest resolution the step rate allows, but only on a full step
+// position where all resolutions line up. Within a full step of the end of a
+// move it goes back to 1/16, so the move ends on its exact count.
+static inline void stepper_ustep_update(uint8_t i)
+{
+    volatile struct stepper_axis *ax = &stepper_axis[i];
+    uint32_t limit = stepper_ustep_auto_period[i];
+    uint32_t period = ax->period;
+    uint8_t ustep = 1;
+
+    if (ax->elec & (STEPPER_USTEP_FULL - 1)) {
+        return;
+    }
+
+    if (period <= (limit >> 2)) {
+        ustep = 16;
+    } else if (period <= (limit >> 1)) {
+        ustep = 8;
+    } else if (period <= limit) {
+        ustep = 4;
+    }
+    if (!(ax->flags & (STEPPER_FLAG_UNTIL_SWITCH | STEPPER_FLAG_JOG)) && ax->step_count < STEPPER_USTEP_FULL) {
+        ustep = 1;
+    }
+
+    if (ustep != ax->ustep) {
+        stepper_ustep_set(i, ustep);
+    }
+}
+
+
+// Goes back to 1/16 steps once a move is over, wherever it stopped. Any
+// position of a coarser resolution is one of the finer ones too.
+static inline void stepper_ustep_reset(uint8_t i)
+{
+    if (stepper_axis[i].ustep != 1) {
+        stepper_ustep_set(i, 1);
+    }
+}
+
+
+// Called by the ISR in place of a step. When DIR differs from the last step
+// the backlash steps are queued, and while any are left one is started
+// instead of the step. They move the driver but not the position.
+static inline bool stepper_backlash_step(uint8_t i)
+{
+    PORT_t *port = stepper_axis[i].port;
+    volatile struct stepper_axis *ax = &stepper_axis[i];
+    uint8_t dir = (port->OUT & stepper_axis[i].dir_bm) ? STEPPER_DIR_HIGH : STEPPER_DIR_LOW;
+    bool res = false;
+
+    if (dir != ax->last_dir) {
+        if (ax->last_dir != STEPPER_DIR_UNKNOWN) {
+            ax->backlash = stepper_backlash[i];
+            if (ax->backlash) {
+                stepper_ustep_reset(i);
             }
         }
+        ax->last_dir = dir;
+    }
+
+    if (ax->backlash) {
+        ax->backlash--;
+        port->OUTSET = stepper_axis[i].step_bm;
+        trace_record(TRACE_STEP | i);
+        if (dir) {
+            ax->elec += ax->elec_inc;
+        } else {
+            ax->elec -= ax->elec_inc;
+        }
+        res = true;
+    }
+
+    return res;
+}
+
+
+// Helper method. True if the soft limits of stepper i apply, homing has to
+// be free to find the switch wherever the position was.
+static inline bool stepper_limit_active(uint8_t i)
+{
+    return stepper_limit_on[i] && (stepper_home_state[i] == STEPPER_HOME_IDLE || stepper_home_state[i] >= STEPPER_HOME_DONE);
+}
+
+
+// The soft limit stepper i moves towards, as a stop reason.
+static inline uint8_t stepper_limit_reason(uint8_t i)
+{
+    return (stepper_axis[i].port->OUT & stepper_axis[i].dir_bm) ? STEPPER_STOP_LIMIT_MAX : STEPPER_STOP_LIMIT_MIN;
+}
+
+
+// Steps stepper i can still take in direction dir before it reaches the soft
+// limit, zero if it is already past it.
+static inline uint32_t stepper_limit_room_dir(uint8_t i, uint8_t dir)
+{
+    int32_t room;
+
+    if (dir == STEPPER_DIR_HIGH) {
+        room = stepper_limit_max[i] - stepper_axis[i].position;
+    } else {
+        room = stepper_axis[i].position - stepper_limit_min[i];
+    }
+
+    return room > 0 ? (uint32_t)room : 0;
+}
+
+
+// Steps stepper i can still take before it reaches the soft limit it moves
+// towards, zero if it is already past it.
+static inline uint32_t stepper_limit_room(uint8_t i)
+{
+    return stepper_limit_room_dir(i, (stepper_axis[i].port->OUT & stepper_axis[i].dir_bm) ? STEPPER_DIR_HIGH : STEPPER_DIR_LOW);
+}
+
+
+// Returns the stop reason if a step in direction dir would take stepper i
+// past a soft limit.
+static inline uint8_t stepper_limit_hit_dir(uint8_t i, uint8_t dir)
+{
+    uint8_t res = STEPPER_STOP_NONE;
+
+    if (stepper_limit_active(i) && stepper_limit_room_dir(i, dir) < stepper_axis[i].ustep) {
+        res = (dir == STEPPER_DIR_HIGH) ? STEPPER_STOP_LIMIT_MAX : STEPPER_STOP_LIMIT_MIN;
+    }
+
+    return res;
+}
+
+
+// Called by the ISR before each step. Returns the stop reason if the step
+// would take stepper i past a soft limit.
+static inline uint8_t stepper_limit_hit(uint8_t i)
+{
+    return stepper_limit_hit_dir(i, (stepper_axis[i].port->OUT & stepper_axis[i].dir_bm) ? STEPPER_DIR_HIGH : STEPPER_DIR_LOW);
+}
+
+
+// The direction stepper 2 follows stepper 1 in while gearing is on.
+static inline uint8_t stepper_gear_dir_get()
+{
+    uint8_t dir = (stepper_axis[0].port->OUT & stepper_axis[0].dir_bm) ? STEPPER_DIR_HIGH : STEPPER_DIR_LOW;
+
+    return stepper_gear_reverse ? !dir : dir;
+}
+
+
+// Keeps the DIR of stepper 2 in line with stepper 1 while gearing is on.
+static inline void stepper_gear_dir()
+{
+    stepper_dir_set(1, stepper_gear_dir_get());
+}
+
+
+// Called by the ISR after each step of stepper 1 while gearing is on. Starts
+// a step of stepper 2 whenever the ratio adds up to a whole step. The
+// remainder runs back down when stepper 1 reverses, so stepper 2 always sits
+// at the position of stepper 1 times the ratio, rounded down. DIR of stepper
+// 2 is set first, so it has the time of the ratio math to settle before the
+// step.
+static inline bool stepper_gear_step()
+{
+    bool res = false;
+    uint32_t error = stepper_gear_error;
+
+    stepper_gear_dir();
+    if (stepper_axis[0].port->OUT & stepper_axis[0].dir_bm) {
+        error += stepper_gear_num;
+        if (error >= stepper_gear_den) {
+            error -= stepper_gear_den;
+            res = true;
+        }
+    } else if (error < stepper_gear_num) {
+        error += stepper_gear_den - stepper_gear_num;
+        res = true;
+    } else {
+        error -= stepper_gear_num;
+    }
+    stepper_gear_error = error;
+
+    if (res) {
+        stepper_step_high(1);
+    }
+
+    return res;
+}
+
+
+// Locks the two sides of a gantry together again once homing let go of them
+// and both have stopped.
+static inline void stepper_gantry_lock(void)
+{
+    if (stepper_gantry && !stepper_gear_on && !stepper_running[0] && !stepper_running[1]) {
+        stepper_gear_error = 0;
+        stepper_gear_on = true;
+    }
+}
+
+
+// Called by the ISR once per profile update while stepper i is jogging. Ramps
+// the speed towards the target velocity, through zero with a direction change
+// if the target has the other sign, and stops once a zero target is reached.
+static inline void stepper_jog_update(uint8_t i)
+{
+    int32_t target = stepper_axis[i].jog_target;
+    uint32_t speed = stepper_axis[i].jog_speed;
+    uint32_t goal = (uint32_t)(target < 0 ? -target : target) << 16;
+    uint32_t accel = stepper_axis[i].jog_accel;
+    uint32_t decel = stepper_axis[i].jog_decel;
+    bool reverse = target != 0 && (target > 0) != (stepper_axis[i].jog_dir == STEPPER_DIR_HIGH);
+    uint32_t v = speed >> 16;
+
+    if (target != 0 && !reverse && stepper_limit_active(i) && stepper_decel[i] != STEPPER_ACCEL_DISABLED &&
+            stepper_limit_room(i) <= v * v / ((uint32_t)stepper_decel[i] << 1) + v / STEPPER_PROFILE_FREQ) {
+        // Ramp down in time to stop at the soft limit.
+        target = 0;
+        goal = 0;
+        stepper_axis[i].jog_target = 0;
+        stepper_stop_reason[i] = stepper_limit_reason(i);
+    }
+
+    if (reverse) {
+        goal = 0;
+    }
+
+    if (speed < goal) {
+        speed = (accel == 0 || goal - speed <= accel) ? goal : speed + accel;
+    } else if (speed > goal) {
+        speed = (decel == 0 || speed - goal <= decel) ? goal : speed - decel;
+    }
+
+    if (speed < stepper_axis[i].jog_speed_min) {
+        if (reverse) {
+            stepper_axis[i].jog_dir = !stepper_axis[i].jog_dir;
+            stepper_dir_set(i, stepper_axis[i].jog_dir);
+            speed = (accel == 0) ? (uint32_t)(target < 0 ? -target : target) << 16 : stepper_axis[i].jog_speed_min;
+        } else if (goal == 0) {
+            stepper_axis[i].jog_speed = 0;
+            stepper_axis[i].flags &= ~STEPPER_FLAG_JOG;
+            stepper_running[i] = false;
+            return;
+        } else {
+            speed = stepper_axis[i].jog_speed_min;
+        }
+    }
+
+    stepper_axis[i].jog_speed = speed;
+    stepper_period_set(i, stepper_speed_to_ramp_delay(speed));
+}
+
+
+// Drives the DAC of stepper i at one of its current levels.
+static inline void stepper_current_level_set(uint8_t i, uint8_t level)
+{
+    uint16_t val = stepper_axis[i].current_run;
+
+    if (level == STEPPER_LEVEL_HOLD) {
+        val = stepper_axis[i].current_hold;
+    } else if (level == STEPPER_LEVEL_BOOST && stepper_axis[i].current_boost) {
+        val = stepper_axis[i].current_boost;
+    }
+
+    if (i == 0) {
+        DACA.CH0DATA = val;
+    } else {
+        DACA.CH1DATA = val;
+    }
+    stepper_axis[i].current_level = level;
+}
+
+
+// Helper method. True if the current levels of stepper i need the profile
+// tick.
+static inline bool stepper_current_auto(uint8_t i)
+{
+    return stepper_axis[i].hold_timeout || stepper_axis[i].current_boost;
+}
+
+
+// Helper method. True while stepper i is changing speed. The minor axis of a
+// coordinated move follows its major axis.
+static inline bool stepper_current_ramping(uint8_t i)
+{
+    uint8_t r = (stepper_coord && i == stepper_coord_minor) ? stepper_coord_major : i;
+    int32_t target = stepper_axis[r].jog_target;
+
+    if (stepper_axis[r].flags & STEPPER_FLAG_JOG) {
+        return stepper_axis[r].jog_speed != (uint32_t)(target < 0 ? -target : target) << 16 ||
+               (target < 0) != (stepper_axis[r].jog_dir == STEPPER_DIR_LOW);
+    }
+    return stepper_axis[r].ramp_state == STEPPER_RAMP_ACCEL || stepper_axis[r].ramp_state == STEPPER_RAMP_DECEL;
+}
+
+
+// Called by the profile tick to pick the current level of stepper i: boost
+// while changing speed, run while moving and hold once idle for the hold
+// timeout. Returns true if the tick is still needed for it.
+static inline bool stepper_current_tick(uint8_t i)
+{
+    uint8_t level = stepper_axis[i].current_level;
+
+    if (!stepper_current_auto(i)) {
+        return false;
+    }
+
+    if (stepper_running[i]) {
+        stepper_axis[i].idle_ms = 0;
+        level = stepper_current_ramping(i) ? STEPPER_LEVEL_BOOST : STEPPER_LEVEL_RUN;
+    } else if (level != STEPPER_LEVEL_HOLD) {
+        level = STEPPER_LEVEL_RUN;
+        if (stepper_axis[i].hold_timeout && ++stepper_axis[i].idle_ms >= stepper_axis[i].hold_timeout) {
+            level = STEPPER_LEVEL_HOLD;
+        }
+    }
+
+    if (level != stepper_axis[i].current_level) {
+        stepper_current_level_set(i, level);
+    }
+
+    return stepper_running[i] || (level != STEPPER_LEVEL_HOLD && stepper_axis[i].hold_timeout);
+}
+
+
+// Starts the profile tick unless it is already running.
+static inline void stepper_profile_tick_start(void)
+{
+    if (!(TCC4.INTCTRLB & TC45_CCCINTLVL_gm)) {
+        TCC4.CTRLA = TC45_CLKSEL_DIV8_gc;
+        TCC4.CCC = TCC4.CNT + STEPPER_PROFILE_TICKS;
+        TCC4.INTFLAGS = TC4_CCCIF_bm;
+        TCC4.INTCTRLB |= TC45_CCCINTLVL_LO_gc;
     }
 }
 
 
 // Helper method.
-static bool stepper_num_valid(uint8_t stepper_num)
+static inline int32_t stepper_abs(int32_t val)
 {
-    bool res = true;
-    if (stepper_num > STEPPER_MAX_STEPPER_NUM || stepper_num < STEPPER_MIN_STEPPER_NUM) {
-        res = false;
+    return val < 0 ? -val : val;
+}
+
+
+// Helper method.
+static inline int8_t stepper_sign(int32_t val)
+{
+    return val > 0 ? 1 : (val < 0 ? -1 : 0);
+}
+
+
+// Works out the next step of an arc using the midpoint circle method: of the
+// steps along the tangent, take the one that ends up closest to the circle.
+// The direction pins are set here, a full step period ahead of the step.
+static inline void stepper_arc_next(void)
+{
+    int32_t x = stepper_arc_x;
+    int32_t y = stepper_arc_y;
+    int32_t f = stepper_arc_f;
+    int32_t fx;
+    int32_t fy;
+    int32_t fxy;
+    int32_t to_end_x = stepper_arc_end_x - x;
+    int32_t to_end_y = stepper_arc_end_y - y;
+    int8_t dx;
+    int8_t dy;
+    uint8_t mask;
+
+    if (stepper_abs(to_end_x) <= 1 && stepper_abs(to_end_y) <= 1 && (!stepper_arc_full || stepper_arc_steps > 3)) {
+        // Close enough, step right onto the end point.
+        dx = to_end_x;
+        dy = to_end_y;
+        if (dx == 0 && dy == 0) {
+            stepper_axis[0].step_count = 0;
+        }
+    } else {
+        if (stepper_arc_cw) {
+            dx = stepper_sign(y);
+            dy = stepper_sign(-x);
+        } else {
+            dx = stepper_sign(-y);
+            dy = stepper_sign(x);
+        }
+
+        fx = f + (dx > 0 ? x : -x) * 2 + 1;
+        fy = f + (dy > 0 ? y : -y) * 2 + 1;
+        fxy = fx + fy - f;
+        if (dx && dy) {
+            if (stepper_abs(fx) < stepper_abs(fxy) && stepper_abs(fx) <= stepper_abs(fy)) {
+                dy = 0;
+            } else if (stepper_abs(fy) < stepper_abs(fxy)) {
+                dx = 0;
+            }
+        }
+    }
+
+    mask = 0;
+    if (dx) {
+        mask |= STEPPER_BITFIELD_STEPPER_1;
+        stepper_dir_set(0, dx > 0 ? STEPPER_DIR_HIGH : STEPPER_DIR_LOW);
+    }
+    if (dy) {
+        mask |= STEPPER_BITFIELD_STEPPER_2;
+        stepper_dir_set(1, dy > 0 ? STEPPER_DIR_HIGH : STEPPER_DIR_LOW);
+    }
+    stepper_arc_dx = dx;
+    stepper_arc_dy = dy;
+    stepper_arc_mask = mask;
+}
+
+
+// Takes the step worked out by stepper_arc_next() and works out the next one.
+// Returns the timer ticks until the next step.
+static inline uint32_t stepper_arc_step(void)
+{
+    uint8_t mask = stepper_arc_mask;
+    int32_t x = stepper_arc_x;
+    int32_t y = stepper_arc_y;
+    int32_t f = stepper_arc_f;
+    uint32_t ticks;
+
+    if (mask & STEPPER_BITFIELD_STEPPER_1) {
+        stepper_step_high(0);
+        f += (stepper_arc_dx > 0 ? x : -x) * 2 + 1;
+        x += stepper_arc_dx;
+    }
+    if (mask & STEPPER_BITFIELD_STEPPER_2) {
+        stepper_step_high(1);
+        f += (stepper_arc_dy > 0 ? y : -y) * 2 + 1;
+        y += stepper_arc_dy;
+    }
+    stepper_arc_x = x;
+    stepper_arc_y = y;
+    stepper_arc_f = f;
+    stepper_arc_steps++;
+    stepper_axis[0].step_count--;
+
+    stepper_arc_next();
+
+    ticks = stepper_axis[0].period;
+    if (stepper_arc_mask == STEPPER_BITFIELD_STEPPER_GM) {
+        // Diagonal steps are sqrt(2) longer, 181 / 128 ~= 1.414.
+        ticks = (ticks * 181) >> 7;
+    }
+
+    // The work above keeps the step pulse high long enough for the driver.
+    if (mask & STEPPER_BITFIELD_STEPPER_1) {
+        stepper_step_low(0);
+    }
+    if (mask & STEPPER_BITFIELD_STEPPER_2) {
+        stepper_step_low(1);
+    }
+
+    return ticks;
+}
+
+
+static inline uint16_t stepper_timer_cc(uint8_t i)
+{
+    return (i == 0) ? TCC4.CCA : TCC4.CCB;
+}
+
+
+static inline void stepper_timer_set_cc(uint8_t i, uint16_t cc)
+{
+    if (i == 0) {
+        TCC4.CCA = cc;
+    } else {
+        TCC4.CCB = cc;
+    }
+}
+
+
+// Schedules the next compare of a stepper ticks after its last one.
+static inline void stepper_timer_schedule(uint8_t i, uint32_t ticks)
+{
+    uint16_t cc;
+    uint16_t chunk = ticks;
+
+    if (ticks > STEPPER_TIMER_MAX_CHUNK) {
+        chunk = STEPPER_TIMER_SPLIT_CHUNK;
+    }
+    stepper_axis[i].wait = ticks - chunk;
+
+    cc = stepper_timer_cc(i) + chunk;
+    if ((int16_t)(cc - TCC4.CNT) < STEPPER_TIMER_MIN_LEAD) {
+        // We are running late, step as soon as possible.
+        cc = TCC4.CNT + STEPPER_TIMER_MIN_LEAD;
+        perf_isr_late();
+    }
+    stepper_timer_set_cc(i, cc);
+}
+
+
+// Stops the timer clock once none of its interrupts are in use. Started again
+// by stepper_timer_start() and stepper_profile_tick_start().
+static inline void stepper_timer_gate(void)
+{
+    if (!(TCC4.INTCTRLB & (TC45_CCAINTLVL_gm | TC45_CCBINTLVL_gm | TC45_CCCINTLVL_gm))) {
+        TCC4.CTRLA = TC45_CLKSEL_OFF_gc;
+    }
+}
+
+
+static inline void stepper_timer_disable(uint8_t i)
+{
+    if (i == 0) {
+        TCC4.INTCTRLB &= ~TC45_CCAINTLVL_gm;
+    } else {
+        TCC4.INTCTRLB &= ~TC45_CCBINTLVL_gm;
+    }
+    stepper_timer_gate();
+}
+
+
+// Starts a segment from the planner as the coordinated move.
+static __attribute__((noinline)) void stepper_segment_load(const struct stepper_segment *seg)
+{
+    uint8_t major = seg->major;
+    uint8_t minor = 1 - major;
+
+    stepper_dir_set(major, seg->move.dir);
+    stepper_dir_set(minor, seg->minor_dir);
+
+    stepper_move_load(major, &seg->move);
+    stepper_axis[minor].step_count = seg->minor_steps;
+    stepper_axis[minor].flags = 0;
+    stepper_axis[minor].ramp_state = STEPPER_RAMP_OFF;
+
+    stepper_coord_major = major;
+    stepper_coord_minor = minor;
+    stepper_coord_major_steps = seg->move.steps;
+    stepper_coord_minor_steps = seg->minor_steps;
+    stepper_coord_error = seg->move.steps - 1;
+    stepper_running[major] = true;
+    stepper_running[minor] = true;
+}
+
+
+// Precomputes the trapezoidal ramp of a move, or its table ramp if an
+// acceleration preset is selected. This does the setup math so the ISR only
+// needs one division per step. Speed is the cruise speed, in steps/s.
+static void stepper_ramp_init(uint8_t i, struct stepper_move *move, uint32_t speed)
+{
+    uint32_t accel = stepper_accel[i];
+    uint32_t decel = stepper_decel[i];
+    uint32_t steps = move->steps;
+    uint32_t delay;
+    uint32_t min_delay;
+    uint32_t accel_lim;
+    uint32_t max_s_lim;
+
+    move->profile = STEPPER_PROFILE_TRAPEZOIDAL;
+    min_delay = (STEPPER_TIMER_FREQ << 8) / speed;
+    if (min_delay < STEPPER_RAMP_MIN_DELAY) {
+        min_delay = STEPPER_RAMP_MIN_DELAY;
+    }
+
+    if (stepper_ramp_scale[i]) {
+        move->profile = STEPPER_PROFILE_TABLE;
+        delay = stepper_ramp_table_delay(stepper_ramp_scale[i], 0);
+    } else {
+        delay = (STEPPER_RAMP_C0_SCALE / stepper_isqrt(accel << 8)) << 8;
+    }
+
+    // Steps needed to reach max speed, and steps after which we have to
+    // decelerate if max speed is never reached.
+    max_s_lim = speed * speed / (accel << 1);
+    accel_lim = (steps / (accel + decel)) * decel + (steps % (accel + decel)) * decel / (accel + decel);
+
+    if (max_s_lim < accel_lim) {
+        move->ramp_decel_steps = speed * speed / (decel << 1);
+    } else {
+        move->ramp_decel_steps = steps - accel_lim;
+    }
+
+    if (delay <= min_delay) {
+        delay = min_delay;
+        move->ramp_state = STEPPER_RAMP_CRUISE;
+    } else {
+        move->ramp_state = STEPPER_RAMP_ACCEL;
+    }
+
+    move->ramp_delay = delay;
+    move->ramp_min_delay = min_delay;
+    move->period = delay >> 8;
+    move->period_frac = delay;
+}
+
+
+// Works out the move of homing stage state of stepper i from its home config.
+// Called by the ISR as homing moves on to the stage, so the back-off ramps
+// trapezoidally even if an S-curve is set, working one out takes too long
+// there.
+static void stepper_home_move(uint8_t i, uint8_t state, struct stepper_move *move)
+{
+    uint16_t speed = stepper_home_slow_speed[i];
+    uint32_t period;
+
+    move->ramp_n = 0;
+    move->ramp_end_n = 0;
+    move->profile = STEPPER_PROFILE_TRAPEZOIDAL;
+    move->ramp_state = STEPPER_RAMP_OFF;
+
+    if (state == STEPPER_HOME_BACKOFF) {
+        // Back off the switch.
+        speed = stepper_home_fast_speed[i];
+        move->steps = stepper_home_backoff[i];
+        move->mode = STEPPER_MODE_STEPS;
+        move->dir = !stepper_home_dir[i];
+        if (stepper_accel[i] != STEPPER_ACCEL_DISABLED) {
+            stepper_ramp_init(i, move, speed);
+            return;
+        }
+    } else {
+        // Creep back onto it without a ramp, so it stops where it hits.
+        move->steps = 0;
+        move->mode = STEPPER_MODE_UNTIL_SWITCH;
+        move->dir = stepper_home_dir[i];
+    }
+
+    period = STEPPER_TIMER_FREQ / speed;
+    move->period_frac = ((STEPPER_TIMER_FREQ % speed) << 8) / speed;
+    if (period < STEPPER_TIMER_MIN_PERIOD) {
+        period = STEPPER_TIMER_MIN_PERIOD;
+        move->period_frac = 0;
+    }
+    move->period = period;
+}
+
+
+// Moves homing of stepper i on to its next stage once a stage ended. Returns
+// true if it loaded another move.
+static __attribute__((noinline)) bool stepper_home_next(uint8_t i)
+{
+    bool res = false;
+    struct stepper_move move;
+
+    switch (stepper_home_state[i]) {
+    case STEPPER_HOME_SEEK:
+        stepper_home_state[i] = STEPPER_HOME_BACKOFF;
+        res = true;
+        break;
+    case STEPPER_HOME_BACKOFF:
+        if ((i == 0) ? switch_r1a_or_r1b_triggered() : switch_r2a_or_r2b_triggered()) {
+            // Didn't back off far enough to clear the switch, the queue
+            // can't be trusted without a home.
+            stepper_home_state[i] = STEPPER_HOME_FAILED;
+            stepper_queue_count[i] = 0;
+        } else {
+            stepper_home_state[i] = STEPPER_HOME_RESEEK;
+            res = true;
+        }
+        break;
+    case STEPPER_HOME_RESEEK:
+        stepper_home_switch_pos[i] = stepper_axis[i].position;
+        stepper_axis[i].position = 0;
+        stepper_home_state[i] = STEPPER_HOME_DONE;
+        break;
+    default:
+        break;
+    }
+
+    if (res) {
+        stepper_home_move(i, stepper_home_state[i], &move);
+        stepper_move_load(i, &move);
+        stepper_dir_set(i, move.dir);
+        stepper_running[i] = true;
+    }
+
+    return res;
+}
+
+
+// Ends the running move of stepper a once its steps are done or it has to
+// stop.
+static inline void stepper_move_check(uint8_t i, uint8_t a)
+{
+    volatile struct stepper_axis *ax = &stepper_axis[a];
+    uint8_t flags;
+    uint8_t reason;
+    uint8_t hit;
+
+    flags = ax->flags;
+    // A continuing probe runs on over the switch once it has latched.
+    if ((flags & (STEPPER_FLAG_SAFELY | STEPPER_FLAG_UNTIL_SWITCH)) || ((flags & STEPPER_FLAG_PROBE) && stepper_probe_state[a] == STEPPER_PROBE_ARMED)) {
+        // A locked gantry stops on the switches of either side.
+        // A probe goes by the raw edge, not the filtered switch state.
+        if (((flags & STEPPER_FLAG_PROBE) && (stepper_probe_edge_bm & (1 << a))) || ((a == 0) ? switch_r1a_or_r1b_triggered() || (stepper_gantry && stepper_gear_on && switch_r2a_or_r2b_triggered()) : switch_r2a_or_r2b_triggered())) {
+            trace_record(TRACE_SWITCH | a);
+            if (flags & STEPPER_FLAG_PROBE) {
+                if (!(stepper_probe_edge_bm & (1 << a))) {
+                    // The switch was on before the probe started, there
+                    // was no edge to latch.
+                    stepper_probe_pos[a] = ax->position;
+                    stepper_probe_time[a] = stepper_timer_cc(i);
+                }
+                stepper_probe_state[a] = STEPPER_PROBE_TRIPPED;
+            }
+            if (flags & STEPPER_FLAG_SAFELY) {
+                stepper_running[a] = false;
+                if (!(flags & (STEPPER_FLAG_UNTIL_SWITCH | STEPPER_FLAG_PROBE))) {
+                    // A safe move hit a switch, don't carry on with the queue.
+                    stepper_queue_count[a] = 0;
+                    stepper_stop_reason[a] = STEPPER_STOP_SWITCH;
+                }
+            }
+        }
+    }
+    if (stepper_running[a] && !(flags & (STEPPER_FLAG_UNTIL_SWITCH | STEPPER_FLAG_JOG)) && ax->step_count == 0) {
+        stepper_running[a] = false;
+        if (flags & STEPPER_FLAG_LIMITED) {
+            stepper_queue_count[a] = 0;
+            stepper_stop_reason[a] = stepper_limit_reason(a);
+        }
+    }
+    if (stepper_running[a]) {
+        hit = a;
+        reason = stepper_limit_hit(a);
+        if (!reason && stepper_coord) {
+            hit = stepper_coord_minor;
+            reason = stepper_limit_hit(hit);
+        } else if (!reason && a == 0 && stepper_gear_on) {
+            // Stepper 2 at its limit holds stepper 1 too.
+            hit = 1;
+            reason = stepper_limit_hit_dir(hit, stepper_gear_dir_get());
+        }
+        if (reason) {
+            // Stop dead rather than run past the limit.
+            stepper_running[a] = false;
+            stepper_queue_count[a] = 0;
+            stepper_stop_reason[a] = reason;
+            stepper_stop_reason[hit] = reason;
+            if (stepper_planned) {
+                stepper_planned = false;
+                planner_flush();
+            }
+        }
+    }
+}
+
+
+// Starts what follows the finished move of stepper a, the next homing stage
+// or the next queued move. Rare next to plain steps, so kept out of line.
+static __attribute__((noinline)) void stepper_move_next(uint8_t i, uint8_t a)
+{
+    while (!stepper_running[a] && !stepper_coord) {
+        stepper_ustep_reset(a);
+
+        if (stepper_home_next(a)) {
+            // Queued moves run once homing is done.
+        } else if (stepper_queue_count[a]) {
+            // Start the next queued move right away.
+            stepper_move_load(a, &stepper_queue[a][stepper_queue_head[a]]);
+            stepper_dir_set(a, stepper_queue[a][stepper_queue_head[a]].dir);
+            stepper_queue_head[a] = (stepper_queue_head[a] + 1) & STEPPER_QUEUE_MASK;
+            stepper_queue_count[a]--;
+            stepper_running[a] = true;
+        } else {
+            return;
+        }
+
+        if (stepper_axis[a].ramp_profile == STEPPER_PROFILE_SCURVE && stepper_axis[a].ramp_state != STEPPER_RAMP_OFF) {
+            // The profile tick is off unless an S-curve was already running.
+            stepper_profile_tick_start();
+        }
+        if (!stepper_running[a]) {
+            return;
+        }
+        stepper_move_check(i, a);
+    }
+}
+
+
+// Handles a compare of channel i, i.e. takes one step of stepper a when it is
+// due. Coordinated moves always run on the stepper 1 compare and step their
+// major axis on it, the minor axis follows. Loading a move, a homing stage
+// or a planned segment is rare, those are kept out of line so the common path
+// stays short.
+static inline void stepper_timer_isr(uint8_t i, uint8_t a)
+{
+    volatile struct stepper_axis *ax = &stepper_axis[a];
+    uint8_t minor;
+    bool minor_step = false;
+    const struct stepper_segment *seg;
+    uint32_t ticks;
+    uint16_t phase;
+    uint8_t ustep;
+
+    if (stepper_axis[i].wait) {
+        stepper_timer_schedule(i, stepper_axis[i].wait);
+        return;
+    }
+
+    if (stepper_running[a]) {
+        stepper_move_check(i, a);
+        if (!stepper_running[a] && !stepper_coord) {
+            stepper_move_next(i, a);
+        }
+    }
+
+    if (!stepper_running[a] && stepper_planned) {
+        // Blend straight into the next planned segment.
+        seg = planner_next();
+        if (seg) {
+            stepper_segment_load(seg);
+            a = stepper_coord_major;
+            ax = &stepper_axis[a];
+        }
+    }
+
+    minor = stepper_coord_minor;
+    if (!stepper_running[a]) {
+        stepper_timer_disable(i);
+        if (stepper_coord) {
+            stepper_running[minor] = false;
+            stepper_coord = false;
+            stepper_arc = false;
+            stepper_planned = false;
+        } else {
+            stepper_gantry_lock();
+        }
+        return;
+    }
+
+    if (stepper_arc) {
+        stepper_timer_schedule(i, stepper_arc_step());
+        return;
+    }
+
+    if (!stepper_coord && stepper_backlash_step(a)) {
+        stepper_timer_schedule(i, stepper_backlash_period[a]);
+        stepper_step_low(a);
+        return;
+    }
+
+    stepper_step_high(a);
+    if (stepper_coord) {
+        stepper_coord_error -= stepper_coord_minor_steps;
+        if (stepper_coord_error < 0) {
+            stepper_coord_error += stepper_coord_major_steps;
+            stepper_step_high(minor);
+            minor_step = true;
+        }
+    } else if (a == 0 && stepper_gear_on) {
+        if (stepper_gear_step()) {
+            minor = 1;
+            minor_step = true;
+        }
+    }
+
+    ustep = ax->ustep;
+    if (!(ax->flags & (STEPPER_FLAG_UNTIL_SWITCH | STEPPER_FLAG_JOG))) {
+        ax->step_count -= ustep;
+    }
+    stepper_ramp_step(a, ustep);
+
+    // Carry the fractional part of the period, no division needed.
+    if (ustep == 1) {
+        ticks = ax->period;
+        phase = ax->phase + ax->period_frac;
+    } else {
+        ticks = ax->period * ustep;
+        phase = ax->phase + (uint16_t)ax->period_frac * ustep;
+    }
+    ticks += phase >> 8;
+    ax->phase = phase;
+    stepper_timer_schedule(i, ticks);
+
+    if (stepper_ustep_auto_period[a] && !stepper_coord) {
+        stepper_ustep_update(a);
+    }
+
+    // The work above keeps the step pulse high long enough for the driver.
+    stepper_step_low(a);
+    if (minor_step) {
+        stepper_step_low(minor);
+    }
+}
+
+
+ISR(TCC4_CCA_vect)
+{
+    uint16_t start = perf_start();
+    perf_isr_latency(TCC4.CNT - TCC4.CCA);
+    // Clear interrupt flag
+    TCC4.INTFLAGS = TC4_CCAIF_bm;
+    if (stepper_coord && stepper_coord_major) {
+        stepper_timer_isr(0, 1);
+    } else {
+        stepper_timer_isr(0, 0);
+    }
+    perf_isr_end(start);
+}
+
+
+ISR(TCC4_CCB_vect)
+{
+    uint16_t start = perf_start();
+    perf_isr_latency(TCC4.CNT - TCC4.CCB);
+    // Clear interrupt flag
+    TCC4.INTFLAGS = TC4_CCBIF_bm;
+    if (stepper_coord) {
+        // Left over from before a coordinated move took stepper 2 over.
+        stepper_timer_disable(1);
+    } else {
+        stepper_timer_isr(1, 1);
+    }
+    perf_isr_end(start);
+}
+
+
+// Profile update tick, only enabled while an S-curve move or a jog is running,
+// or while the current levels of a stepper are managed.
+ISR(TCC4_CCC_vect)
+{
+    uint16_t start = perf_start();
+    bool needed = false;
+    uint8_t i;
+    // Clear interrupt flag
+    TCC4.INTFLAGS = TC4_CCCIF_bm;
+
+    TCC4.CCC += STEPPER_PROFILE_TICKS;
+
+    for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+        if (stepper_running[i] && (stepper_axis[i].flags & STEPPER_FLAG_JOG)) {
+            stepper_jog_update(i);
+            needed = true;
+        } else if (stepper_running[i] && stepper_axis[i].ramp_profile == STEPPER_PROFILE_SCURVE && stepper_axis[i].ramp_state != STEPPER_RAMP_OFF) {
+            stepper_scurve_update(i);
+            needed = true;
+        }
+        if (stepper_current_tick(i)) {
+            needed = true;
+        }
+    }
+
+    if (!needed) {
+        TCC4.INTCTRLB &= ~TC45_CCCINTLVL_gm;
+        stepper_timer_gate();
+    }
+    perf_isr_end(start);
+}
+
+
+// Helper method.
+static bool stepper_num_valid(uint8_t stepper_num)
+{
+    bool res = true;
+    if (stepper_num > STEPPER_MAX_STEPPER_NUM || stepper_num < STEPPER_MIN_STEPPER_NUM) {
+        res = false;
+    }
+    return res;
+}
+
+
+// Helper method. True if stepper i can't be moved on its own, i.e. stepper 2
+// while it follows stepper 1, or either side of a gantry while it is homed.
+static bool stepper_held(uint8_t i)
+{
+    return stepper_gantry ? (!stepper_gear_on || i == 1) : (i == 1 && stepper_gear_on);
+}
+
+
+// Helper method
+static bool stepper_bitfield_valid(uint8_t stepper_bitfield)
+{
+    bool res = true;
+    if (stepper_bitfield & ~(STEPPER_BITFIELD_STEPPER_1 | STEPPER_BITFIELD_STEPPER_2)) {
+        res = false;
+    }
+    return res;
+}
+
+
+uint16_t stepper_isqrt(uint32_t val)
+{
+    uint32_t res = 0;
+    uint32_t bit = 1UL << 30;
+
+    while (bit > val) {
+        bit >>= 2;
+    }
+
+    while (bit) {
+        if (val >= res + bit) {
+            val -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return res;
+}
+
+
+// Helper method. Converts a Q16.16 rate in steps/s to a step period in timer
+// ticks plus 1/256th ticks. This is a long division of STEPPER_TIMER_FREQ << 24
+// done a bit at a time, so it doesn't pull in 64 bit division. The rate must
+// be within STEPPER_RATE_MIN and STEPPER_RATE_MAX.
+static void stepper_rate_to_period(uint32_t rate, uint32_t *period, uint8_t *frac)
+{
+    uint32_t num = STEPPER_TIMER_FREQ;
+    uint32_t rem = 0;
+    uint32_t quot = 0;
+    uint8_t quot_frac = 0;
+    bool carry;
+    uint8_t bit;
+
+    for (bit = 0; bit < 32 + 24; bit++) {
+        carry = rem & 0x80000000UL;
+        rem = (rem << 1) | (num >> 31);
+        num <<= 1;
+        quot = (quot << 1) | (quot_frac >> 7);
+        quot_frac <<= 1;
+        if (carry || rem >= rate) {
+            rem -= rate;
+            quot_frac |= 1;
+        }
+    }
+
+    *period = quot;
+    *frac = quot_frac;
+}
+
+
+// Helper method. Returns the steps an S-curve takes to go from standstill to
+// speed (steps/s) given accel (steps/s^2) and jerk (steps/s^3), saturating.
+static uint32_t stepper_scurve_steps(uint32_t speed, uint32_t accel, uint32_t jerk)
+{
+    uint32_t time;
+
+    if (jerk >= accel * accel / speed) {
+        // Max accel is reached: steps = speed / 2 * (speed / accel + accel / jerk)
+        time = (speed << 8) / accel + (accel << 8) / jerk;
+        if (time > UINT32_MAX / speed) {
+            return UINT32_MAX;
+        }
+        return (speed * time) >> 9;
+    }
+
+    // Max accel is never reached: steps = speed * sqrt(speed / jerk)
+    time = stepper_isqrt((speed << 16) / jerk);
+    return (speed * time) >> 8;
+}
+
+
+// Helper method. Converts the S-curve limits of stepper i to the units of the
+// profile update, 2^24 / 1000000 = 2^18 / 15625. The ISR uses them for every
+// S-curve move, they are only set while the stepper is stopped.
+static void stepper_scurve_limits(uint8_t i)
+{
+    uint32_t jerk = stepper_jerk[i];
+
+    stepper_axis[i].scurve_jerk = ((jerk / 15625) << 18) + ((jerk % 15625) << 18) / 15625;
+    stepper_axis[i].scurve_accel_max = (((uint32_t)stepper_accel[i] << 16) / 125) << 5;
+    stepper_axis[i].scurve_decel_max = (((uint32_t)stepper_decel[i] << 16) / 125) << 5;
+}
+
+
+// Precomputes the S-curve of a move. Moves that are too short to reach max
+// speed get their peak speed lowered until both ramps fit.
+static void stepper_scurve_init(uint8_t i, struct stepper_move *move, uint32_t speed)
+{
+    uint32_t accel = stepper_accel[i];
+    uint32_t decel = stepper_decel[i];
+    uint32_t jerk = stepper_jerk[i];
+    uint32_t speed_min = stepper_isqrt(accel << 1);
+    uint32_t steps = move->steps;
+    uint32_t delay;
+    uint32_t low;
+    uint32_t high;
+
+    if (speed_min == 0) {
+        speed_min = 1;
+    }
+    // The S-curve sets its period from the speed, hold that to the shortest
+    // step period.
+    if (speed > STEPPER_TIMER_FREQ / STEPPER_TIMER_MIN_PERIOD) {
+        speed = STEPPER_TIMER_FREQ / STEPPER_TIMER_MIN_PERIOD;
+    }
+    if (speed_min > speed) {
+        speed_min = speed;
+    }
+
+    if (move->mode != STEPPER_MODE_UNTIL_SWITCH) {
+        // Binary search the highest peak speed whose ramps fit in the move.
+        low = speed_min;
+        high = speed;
+        while (low < high) {
+            speed = (low + high + 1) >> 1;
+            if (stepper_scurve_steps(speed, accel, jerk) / 2 + stepper_scurve_steps(speed, decel, jerk) / 2 <= steps / 2) {
+                low = speed;
+            } else {
+                high = speed - 1;
+            }
+        }
+        speed = low;
+        move->ramp_decel_steps = stepper_scurve_steps(speed, decel, jerk);
+    }
+
+    move->scurve_speed_max = speed << 16;
+    move->scurve_speed_min = speed_min << 16;
+
+    move->ramp_state = (speed > speed_min) ? STEPPER_RAMP_ACCEL : STEPPER_RAMP_CRUISE;
+    delay = stepper_speed_to_ramp_delay(speed_min << 16);
+    move->period = delay >> 8;
+    move->period_frac = delay;
+}
+
+
+// Precomputes the ramp of a move, trapezoidal or S-curve as set for stepper i.
+// Speed is the cruise speed, in steps/s. Without acceleration the move runs
+// at fixed_period ticks plus fixed_frac 1/256th ticks.
+static void stepper_move_init(uint8_t i, struct stepper_move *move, uint32_t speed, uint32_t fixed_period, uint8_t fixed_frac)
+{
+    move->ramp_n = 0;
+    move->ramp_end_n = 0;
+    move->profile = stepper_profile[i];
+
+    if (stepper_accel[i] == STEPPER_ACCEL_DISABLED) {
+        move->ramp_state = STEPPER_RAMP_OFF;
+        if (fixed_period < STEPPER_TIMER_MIN_PERIOD) {
+            fixed_period = STEPPER_TIMER_MIN_PERIOD;
+            fixed_frac = 0;
+        }
+        move->period = fixed_period;
+        move->period_frac = fixed_frac;
+        return;
+    }
+
+    if (stepper_profile[i] == STEPPER_PROFILE_SCURVE) {
+        stepper_scurve_init(i, move, speed);
+        return;
+    }
+
+    stepper_ramp_init(i, move, speed);
+}
+
+
+// Helper method. Fills in the mode and step count of a move from what was set
+// with stepper_set_steps() and friends.
+static void stepper_move_from_current(uint8_t i, struct stepper_move *move)
+{
+    move->steps = stepper_axis[i].step_count;
+    if (stepper_axis[i].flags & STEPPER_FLAG_UNTIL_SWITCH) {
+        move->mode = STEPPER_MODE_UNTIL_SWITCH;
+    } else if (stepper_axis[i].flags & STEPPER_FLAG_PROBE) {
+        move->mode = (stepper_axis[i].flags & STEPPER_FLAG_SAFELY) ? STEPPER_MODE_PROBE : STEPPER_MODE_PROBE_CONTINUE;
+    } else if (stepper_axis[i].flags & STEPPER_FLAG_SAFELY) {
+        move->mode = STEPPER_MODE_SAFE_STEPS;
+    } else {
+        move->mode = STEPPER_MODE_STEPS;
+    }
+}
+
+
+bool stepper_set_steps(uint8_t stepper_num, uint32_t steps)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        if (stepper_running[stepper_num-1]) {
+            res = false;
+        }
+    }
+
+    if (res) {
+        stepper_axis[stepper_num-1].step_count = steps;
+        stepper_axis[stepper_num-1].flags = 0;
+    }
+
+    return res;
+}
+
+
+bool stepper_set_safe_steps(uint8_t stepper_num, uint32_t steps)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        if (stepper_running[stepper_num-1]) {
+            res = false;
+        }
+    }
+
+    if (res) {
+        stepper_axis[stepper_num-1].step_count = steps;
+        stepper_axis[stepper_num-1].flags = STEPPER_FLAG_SAFELY;
+    }
+
+    return res;
+}
+
+
+bool stepper_set_step_until_switch(uint8_t stepper_num)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        if (stepper_running[stepper_num-1]) {
+            res = false;
+        }
+    }
+
+    if (res) {
+        stepper_axis[stepper_num-1].step_count = 0;
+        stepper_axis[stepper_num-1].flags = STEPPER_FLAG_UNTIL_SWITCH | STEPPER_FLAG_SAFELY;
+    }
+
+    return res;
+}
+
+
+// Sets up a probe move of steps for the next stepper_start(). It runs like a
+// safe move, but the pin change interrupt latches the position and time of
+// the first switch edge without waiting for the filter, see
+// stepper_probe_edge(). The move stops on the next step and goes on with the
+// queue, or with cont set runs the rest of its steps over the switch.
+bool stepper_set_probe_steps(uint8_t stepper_num, uint32_t steps, uint8_t cont)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        if (stepper_running[stepper_num-1]) {
+            res = false;
+        }
+    }
+
+    if (res) {
+        stepper_axis[stepper_num-1].step_count = steps;
+        stepper_axis[stepper_num-1].flags = cont ? STEPPER_FLAG_PROBE : STEPPER_FLAG_PROBE | STEPPER_FLAG_SAFELY;
+    }
+
+    return res;
+}
+
+
+// Called by the pin change interrupt with the switches the pins show active,
+// before the filter. A running probe latches where its stepper stands and
+// the TCC4 count at the first edge, so neither the filter time nor the wait
+// for the next step adds to the error.
+void stepper_probe_edge(uint8_t level)
+{
+    uint8_t i;
+
+    for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+        if (stepper_running[i] && (stepper_axis[i].flags & STEPPER_FLAG_PROBE) && stepper_probe_state[i] == STEPPER_PROBE_ARMED && !(stepper_probe_edge_bm & (1 << i))) {
+            if ((i == 0) ? (level & SWITCHES_R1) || (stepper_gantry && stepper_gear_on && (level & SWITCHES_R2)) : (level & SWITCHES_R2)) {
+                stepper_probe_pos[i] = stepper_axis[i].position;
+                stepper_probe_time[i] = TCC4.CNT;
+                stepper_probe_edge_bm |= 1 << i;
+            }
+        }
+    }
+}
+
+
+// The outcome of the last probe move. Armed while it runs and after it ended
+// without a trip. The position is where the stepper stood at the switch edge.
+bool stepper_get_probe_result(uint8_t stepper_num, uint8_t *state, int32_t *position, uint16_t *time)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            *state = stepper_probe_state[stepper_num-1];
+            *position = stepper_probe_pos[stepper_num-1];
+            *time = stepper_probe_time[stepper_num-1];
+        }
+    }
+
+    return res;
+}
+
+
+// Arms the compare channels of the steppers in the bitfield so they take their
+// first step right away. Steppers armed together step on the same tick.
+static void stepper_timer_start(uint8_t stepper_bitfield)
+{
+    uint8_t flags = 0;
+    uint8_t intctrl = 0;
+    bool profile = false;
+    uint16_t cc;
+    uint8_t i;
+
+    for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+        if (stepper_bitfield & (1 << i)) {
+            stepper_axis[i].wait = 0;
+        }
+        if ((stepper_bitfield & (1 << i)) || stepper_coord) {
+            stepper_stop_reason[i] = STEPPER_STOP_NONE;
+        }
+        if (stepper_running[i] && ((stepper_axis[i].flags & STEPPER_FLAG_JOG) ||
+                (stepper_axis[i].ramp_profile == STEPPER_PROFILE_SCURVE && stepper_axis[i].ramp_state != STEPPER_RAMP_OFF))) {
+            profile = true;
+        }
+        if (stepper_running[i] && stepper_current_auto(i)) {
+            // Don't wait for the tick, the first step needs the current.
+            ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+                stepper_axis[i].idle_ms = 0;
+                stepper_current_level_set(i, stepper_current_ramping(i) ? STEPPER_LEVEL_BOOST : STEPPER_LEVEL_RUN);
+            }
+            profile = true;
+        }
+    }
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        // The clock may have been gated, the count picks up where it stopped.
+        TCC4.CTRLA = TC45_CLKSEL_DIV8_gc;
+        cc = TCC4.CNT + STEPPER_TIMER_MIN_LEAD;
+        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_1) {
+            TCC4.CCA = cc;
+            flags |= TC4_CCAIF_bm;
+            intctrl |= TC45_CCAINTLVL_LO_gc;
+        }
+        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_2) {
+            TCC4.CCB = cc;
+            flags |= TC4_CCBIF_bm;
+            intctrl |= TC45_CCBINTLVL_LO_gc;
+        }
+        if (profile && !(TCC4.INTCTRLB & TC45_CCCINTLVL_gm)) {
+            TCC4.CCC = cc + STEPPER_PROFILE_TICKS;
+            flags |= TC4_CCCIF_bm;
+            intctrl |= TC45_CCCINTLVL_LO_gc;
+        }
+        TCC4.INTFLAGS = flags;
+        TCC4.INTCTRLB |= intctrl;
+    }
+}
+
+
+bool stepper_set_profile(uint8_t stepper_num, uint8_t profile)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res && stepper_running[stepper_num-1]) {
+        res = false;
+    }
+
+    if (profile != STEPPER_PROFILE_TRAPEZOIDAL && profile != STEPPER_PROFILE_SCURVE) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_profile[stepper_num-1] = profile;
+    }
+
+    return res;
+}
+
+
+bool stepper_get_profile(uint8_t stepper_num, uint8_t *profile)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *profile = stepper_profile[stepper_num-1];
+    }
+
+    return res;
+}
+
+
+bool stepper_start(uint8_t stepper_bitfield)
+{
+    bool res = stepper_bitfield_valid(stepper_bitfield);
+    struct stepper_move move;
+    bool limited;
+    uint8_t i;
+
+    if (res) {
+        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_1 && (stepper_running[0] || stepper_held(0))) {
+            res = false;
+        }
+    }
+
+    if (res) {
+        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_2 && (stepper_running[1] || stepper_held(1))) {
+            res = false;
+        }
+    }
+
+    if (res) {
+        for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+            if (stepper_bitfield & (1 << i)) {
+                stepper_move_from_current(i, &move);
+                limited = false;
+                if (move.mode != STEPPER_MODE_UNTIL_SWITCH && stepper_limit_active(i) && move.steps > stepper_limit_room(i)) {
+                    // Shorten the move so it ramps down to a stop at the limit.
+                    move.steps = stepper_limit_room(i);
+                    limited = true;
+                }
+                stepper_move_init(i, &move, stepper_max_speed[i], stepper_fixed_period[i], stepper_fixed_frac[i]);
+                stepper_move_load(i, &move);
+                if (limited) {
+                    stepper_axis[i].flags |= STEPPER_FLAG_LIMITED;
+                }
+                stepper_running[i] = true;
+            }
+        }
+
+        // Both motors start at exactly the same time.
+        stepper_timer_start(stepper_bitfield);
+    }
+
+    return res;
+}
+
+
+bool stepper_move_linear(int32_t dx, int32_t dy, uint16_t speed)
+{
+    bool res = !stepper_running[0] && !stepper_running[1] && !stepper_gear_on && !stepper_gantry;
+    uint32_t steps[STEPPER_MAX_STEPPER_NUM];
+    uint32_t major = 0;
+    uint32_t minor = 0;
+    uint8_t shift = 0;
+    uint32_t len;
+    uint32_t major_speed;
+    uint32_t delay;
+    struct stepper_move move;
+    uint8_t i;
+
+    if (speed < STEPPER_MAX_SPEED_MIN) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_set_dir(1, dx < 0 ? STEPPER_DIR_LOW : STEPPER_DIR_HIGH);
+        stepper_set_dir(2, dy < 0 ? STEPPER_DIR_LOW : STEPPER_DIR_HIGH);
+        steps[0] = dx < 0 ? -(uint32_t)dx : (uint32_t)dx;
+        steps[1] = dy < 0 ? -(uint32_t)dy : (uint32_t)dy;
+
+        stepper_coord_major = steps[0] >= steps[1] ? 0 : 1;
+        stepper_coord_minor = 1 - stepper_coord_major;
+        major = steps[stepper_coord_major];
+        minor = steps[stepper_coord_minor];
+    }
+
+    // Nothing to do for a zero length move.
+    if (res && major > 0) {
+        // The major axis runs at speed * major / length so the path moves at
+        // speed. Both are scaled down so the squares can't overflow.
+        while ((major >> shift) > 0x7fff) {
+            shift++;
+        }
+        len = stepper_isqrt((major >> shift) * (major >> shift) + (minor >> shift) * (minor >> shift));
+        major_speed = speed * (major >> shift) / len;
+        if (major_speed < STEPPER_MAX_SPEED_MIN) {
+            major_speed = STEPPER_MAX_SPEED_MIN;
+        }
+
+        for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+            stepper_axis[i].step_count = steps[i];
+            stepper_axis[i].flags = 0;
+        }
+
+        stepper_coord_major_steps = major;
+        stepper_coord_minor_steps = minor;
+        // Starting at major - 1 makes the last major step also step the
+        // minor axis, so both axes finish on the same tick.
+        stepper_coord_error = major - 1;
+
+        move.steps = major;
+        move.mode = STEPPER_MODE_STEPS;
+        delay = stepper_speed_to_ramp_delay(major_speed << 16);
+        stepper_move_init(stepper_coord_major, &move, major_speed, delay >> 8, delay);
+        stepper_move_load(stepper_coord_major, &move);
+
+        // Only the stepper 1 compare runs, it steps both axes.
+        stepper_axis[stepper_coord_minor].ramp_state = STEPPER_RAMP_OFF;
+        stepper_arc = false;
+        stepper_planned = false;
+        stepper_coord = true;
+        stepper_running[0] = true;
+        stepper_running[1] = true;
+        stepper_timer_start(STEPPER_BITFIELD_STEPPER_1);
+    }
+
+    return res;
+}
+
+
+void stepper_segment_init(struct stepper_segment *seg, int32_t dx, int32_t dy, uint32_t len,
+                          uint16_t entry, uint16_t nominal, uint16_t exit, uint16_t accel)
+{
+    struct stepper_move *move = &seg->move;
+    uint32_t steps[STEPPER_MAX_STEPPER_NUM];
+    uint32_t major;
+    uint32_t ratio;
+    uint32_t entry_sq;
+    uint32_t nominal_sq;
+    uint32_t exit_sq;
+    uint32_t accel_steps;
+    uint32_t decel_steps;
+    int32_t decel_lim;
+    uint32_t delay;
+    uint8_t shift = 0;
+
+    steps[0] = dx < 0 ? -(uint32_t)dx : (uint32_t)dx;
+    steps[1] = dy < 0 ? -(uint32_t)dy : (uint32_t)dy;
+    seg->major = steps[0] >= steps[1] ? 0 : 1;
+    major = steps[seg->major];
+    seg->minor_steps = steps[1 - seg->major];
+    move->dir = (seg->major == 0 ? dx : dy) < 0 ? STEPPER_DIR_LOW : STEPPER_DIR_HIGH;
+    seg->minor_dir = (seg->major == 0 ? dy : dx) < 0 ? STEPPER_DIR_LOW : STEPPER_DIR_HIGH;
+
+    move->steps = major;
+    move->mode = STEPPER_MODE_STEPS;
+    move->profile = STEPPER_PROFILE_TRAPEZOIDAL;
+    move->ramp_n = 0;
+    move->ramp_end_n = 0;
+    move->ramp_decel_steps = 0;
+
+    // Path speeds are converted to major axis speeds by major / len, as Q16.
+    while ((len >> shift) > 0xffff) {
+        shift++;
+    }
+    ratio = ((major >> shift) << 16) / ((len >> shift) ? (len >> shift) : 1);
+    nominal = ((uint32_t)nominal * ratio) >> 16;
+    entry = ((uint32_t)entry * ratio) >> 16;
+    exit = ((uint32_t)exit * ratio) >> 16;
+    accel = ((uint32_t)accel * ratio) >> 16;
+    if (nominal < STEPPER_MAX_SPEED_MIN) {
+        nominal = STEPPER_MAX_SPEED_MIN;
+    }
+    if (entry > nominal) {
+        entry = nominal;
+    }
+    if (exit > nominal) {
+        exit = nominal;
+    }
+
+    move->ramp_min_delay = (STEPPER_TIMER_FREQ << 8) / nominal;
+    if (move->ramp_min_delay < STEPPER_RAMP_MIN_DELAY) {
+        move->ramp_min_delay = STEPPER_RAMP_MIN_DELAY;
+    }
+
+    if (accel == STEPPER_ACCEL_DISABLED) {
+        move->ramp_state = STEPPER_RAMP_OFF;
+        move->period = move->ramp_min_delay >> 8;
+        move->period_frac = move->ramp_min_delay;
+        return;
+    }
+
+    entry_sq = (uint32_t)entry * entry;
+    nominal_sq = (uint32_t)nominal * nominal;
+    exit_sq = (uint32_t)exit * exit;
+
+    accel_steps = (nominal_sq - entry_sq) / ((uint32_t)accel << 1);
+    decel_steps = (nominal_sq - exit_sq) / ((uint32_t)accel << 1);
+    if (accel_steps + decel_steps > major) {
+        // Max speed is never reached, decelerate where the ramps meet.
+        decel_lim = (int32_t)(major >> 1) + (int32_t)(entry_sq / ((uint32_t)accel << 2)) - (int32_t)(exit_sq / ((uint32_t)accel << 2));
+        if (decel_lim < 0) {
+            decel_lim = 0;
+        } else if ((uint32_t)decel_lim > major) {
+            decel_lim = major;
+        }
+        decel_steps = decel_lim;
+    }
+    move->ramp_decel_steps = decel_steps;
+    move->ramp_end_n = exit_sq / ((uint32_t)accel << 1);
+
+    if (entry == 0) {
+        delay = (STEPPER_RAMP_C0_SCALE / stepper_isqrt((uint32_t)accel << 8)) << 8;
+    } else {
+        // Pick up the ramp at the step where it reaches the entry speed.
+        delay = (STEPPER_TIMER_FREQ << 8) / entry;
+        move->ramp_n = entry_sq / ((uint32_t)accel << 1);
+    }
+
+    if (delay <= move->ramp_min_delay) {
+        delay = move->ramp_min_delay;
+        move->ramp_state = STEPPER_RAMP_CRUISE;
+    } else {
+        move->ramp_state = STEPPER_RAMP_ACCEL;
+    }
+
+    move->ramp_delay = delay;
+    move->period = delay >> 8;
+    move->period_frac = delay;
+}
+
+
+bool stepper_start_segments()
+{
+    bool res = false;
+    const struct stepper_segment *seg;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (!stepper_running[0] && !stepper_running[1] && !stepper_gear_on && !stepper_gantry) {
+            seg = planner_next();
+            if (seg) {
+                stepper_segment_load(seg);
+                stepper_arc = false;
+                stepper_planned = true;
+                stepper_coord = true;
+                stepper_timer_start(STEPPER_BITFIELD_STEPPER_1);
+                res = true;
+            }
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_stop(uint8_t stepper_bitfield)
+{
+    bool res = stepper_bitfield_valid(stepper_bitfield);
+    bool flush = false;
+    uint8_t free;
+    uint8_t i;
+
+    if (res && stepper_coord && stepper_bitfield) {
+        // Both axes of a coordinated move have to stop together.
+        stepper_bitfield = STEPPER_BITFIELD_STEPPER_GM;
+    }
+
+    if (res) {
+        // Stops steppers at exactly the same time.
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            // Planned segments are dropped only if they drive a stopped
+            // stepper, running or waiting for the main loop to start them.
+            planner_get_free(&free);
+            flush = (stepper_bitfield & STEPPER_BITFIELD_STEPPER_GM) && (stepper_planned || free < PLANNER_BUF_LEN);
+
+            for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+                if (stepper_bitfield & (1 << i)) {
+                    if (stepper_running[i]) {
+                        stepper_stop_reason[i] = STEPPER_STOP_COMMAND;
+                    }
+                    stepper_running[i] = false;
+                    stepper_axis[i].flags &= ~STEPPER_FLAG_JOG;
+                    stepper_queue_count[i] = 0;
+                    stepper_timer_disable(i);
+                    stepper_ustep_reset(i);
+                    if (stepper_home_state[i] != STEPPER_HOME_DONE && stepper_home_state[i] != STEPPER_HOME_FAILED) {
+                        // Homing was cut short.
+                        stepper_home_state[i] = STEPPER_HOME_IDLE;
+                    }
+                }
+            }
+
+            if (!stepper_running[0] && !stepper_running[1]) {
+                stepper_coord = false;
+                stepper_arc = false;
+                stepper_planned = false;
+            }
+            stepper_gantry_lock();
+        }
+        if (flush) {
+            planner_flush();
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_move_arc(int16_t center_x, int16_t center_y, int16_t end_x, int16_t end_y, uint8_t dir, uint16_t speed)
+{
+    bool res = !stepper_running[0] && !stepper_running[1] && !stepper_gear_on && !stepper_gantry;
+    int32_t x = -(int32_t)center_x;
+    int32_t y = -(int32_t)center_y;
+    int32_t ex = (int32_t)end_x - center_x;
+    int32_t ey = (int32_t)end_y - center_y;
+    uint32_t radius_sq = 0;
+    uint32_t end_radius_sq = 0;
+    uint16_t radius = 0;
+    uint32_t delay;
+    struct stepper_move move;
+
+    if (dir != STEPPER_ARC_CW && dir != STEPPER_ARC_CCW) {
+        res = false;
+    }
+
+    if (speed < STEPPER_MAX_SPEED_MIN) {
+        res = false;
+    }
+
+    // Keeps the squares below from overflowing.
+    if (stepper_abs(x) > SHRT_MAX || stepper_abs(y) > SHRT_MAX || stepper_abs(ex) > SHRT_MAX || stepper_abs(ey) > SHRT_MAX) {
+        res = false;
+    }
+
+    if (res) {
+        radius_sq = (uint32_t)(x * x) + (uint32_t)(y * y);
+        end_radius_sq = (uint32_t)(ex * ex) + (uint32_t)(ey * ey);
+        radius = stepper_isqrt(radius_sq);
+        // The end point has to be within about a step of the circle.
+        if (radius == 0 || (radius_sq > end_radius_sq ? radius_sq - end_radius_sq : end_radius_sq - radius_sq) > 2UL * radius + 1) {
+            res = false;
+        }
+    }
+
+    if (res) {
+        stepper_arc_x = x;
+        stepper_arc_y = y;
+        stepper_arc_end_x = ex;
+        stepper_arc_end_y = ey;
+        stepper_arc_f = 0;
+        stepper_arc_cw = dir == STEPPER_ARC_CW;
+        stepper_arc_full = ex == x && ey == y;
+        stepper_arc_steps = 0;
+
+        // A full circle is at most 8 * r steps, this bounds the arc in case
+        // the end point is never hit.
+        move.steps = ((uint32_t)radius << 3) + 8;
+        move.mode = STEPPER_MODE_STEPS;
+        move.dir = STEPPER_DIR_HIGH;
+        delay = stepper_speed_to_ramp_delay((uint32_t)speed << 16);
+        move.period = delay >> 8;
+        move.period_frac = delay;
+        if (move.period < STEPPER_TIMER_MIN_PERIOD) {
+            move.period = STEPPER_TIMER_MIN_PERIOD;
+            move.period_frac = 0;
+        }
+        move.ramp_n = 0;
+        move.ramp_end_n = 0;
+        move.profile = STEPPER_PROFILE_TRAPEZOIDAL;
+        move.ramp_state = STEPPER_RAMP_OFF;
+        stepper_move_load(0, &move);
+        stepper_axis[1].step_count = 0;
+        stepper_axis[1].flags = 0;
+        stepper_axis[1].ramp_state = STEPPER_RAMP_OFF;
+        stepper_arc_next();
+
+        // Arcs run at a fixed speed, driven by the stepper 1 compare.
+        stepper_coord_major = 0;
+        stepper_coord_minor = 1;
+        stepper_coord = true;
+        stepper_arc = true;
+        stepper_planned = false;
+        stepper_running[0] = true;
+        stepper_running[1] = true;
+        stepper_timer_start(STEPPER_BITFIELD_STEPPER_1);
+    }
+
+    return res;
+}
+
+
+bool stepper_move_to(uint8_t stepper_num, int32_t target)
+{
+    bool res = stepper_num_valid(stepper_num);
+    int32_t position = 0;
+    uint32_t steps = 0;
+
+    // Checked before DIR is touched, a follower has to keep the DIR of the
+    // stepper it follows.
+    if (res && (stepper_running[stepper_num-1] || stepper_held(stepper_num-1))) {
+        res = false;
+    }
+
+    if (res) {
+        // The distance as an unsigned count, target - position can overflow.
+        position = stepper_axis[stepper_num-1].position;
+        steps = target < position ? (uint32_t)position - (uint32_t)target : (uint32_t)target - (uint32_t)position;
+        stepper_set_dir(stepper_num, target < position ? STEPPER_DIR_LOW : STEPPER_DIR_HIGH);
+        res = stepper_set_steps(stepper_num, steps);
+    }
+
+    // Nothing to do if we are already there.
+    if (res && steps != 0) {
+        res = stepper_start(stepper_num == 1 ? STEPPER_BITFIELD_STEPPER_1 : STEPPER_BITFIELD_STEPPER_2);
+    }
+
+    return res;
+}
+
+
+bool stepper_enqueue(uint8_t stepper_num, uint8_t mode, uint8_t dir, uint32_t steps, uint16_t speed)
+{
+    bool res = stepper_num_valid(stepper_num);
+    struct stepper_move move;
+    uint8_t i = stepper_num - 1;
+
+    if (mode > STEPPER_MODE_PROBE_CONTINUE) {
+        res = false;
+    }
+
+    if (dir != STEPPER_DIR_HIGH && dir != STEPPER_DIR_LOW) {
+        res = false;
+    }
+
+    if (speed < STEPPER_MAX_SPEED_MIN || (steps == 0 && mode != STEPPER_MODE_UNTIL_SWITCH)) {
+        res = false;
+    }
+
+    if (res && (stepper_coord || (stepper_axis[i].flags & STEPPER_FLAG_JOG) || stepper_queue_count[i] >= STEPPER_QUEUE_LEN)) {
+        res = false;
+    }
+
+    if (res && stepper_held(i)) {
+        res = false;
+    }
+
+    if (res) {
+        // Do the ramp math now, so the ISR only has to copy the move.
+        move.steps = mode == STEPPER_MODE_UNTIL_SWITCH ? 0 : steps;
+        move.mode = mode;
+        move.dir = dir;
+        stepper_move_init(i, &move, speed, STEPPER_TIMER_FREQ / speed, ((STEPPER_TIMER_FREQ % speed) << 8) / speed);
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (stepper_running[i]) {
+                stepper_queue[i][(stepper_queue_head[i] + stepper_queue_count[i]) & STEPPER_QUEUE_MASK] = move;
+                stepper_queue_count[i]++;
+            } else {
+                stepper_move_load(i, &move);
+                stepper_dir_set(i, dir);
+                stepper_running[i] = true;
+                stepper_timer_start(1 << i);
+            }
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_flush(uint8_t stepper_bitfield)
+{
+    bool res = stepper_bitfield_valid(stepper_bitfield);
+
+    if (res) {
+        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_1) {
+            stepper_queue_count[0] = 0;
+        }
+        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_2) {
+            stepper_queue_count[1] = 0;
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_get_queue_depth(uint8_t stepper_num, uint8_t *depth)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *depth = stepper_queue_count[stepper_num-1];
+    }
+
+    return res;
+}
+
+
+bool stepper_set_home_config(uint8_t stepper_num, uint8_t dir, uint16_t fast_speed, uint16_t slow_speed, uint32_t backoff)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (dir != STEPPER_DIR_HIGH && dir != STEPPER_DIR_LOW) {
+        res = false;
+    }
+
+    if (fast_speed < STEPPER_MAX_SPEED_MIN || slow_speed < STEPPER_MAX_SPEED_MIN || backoff == 0) {
+        res = false;
+    }
+
+    if (res && stepper_running[stepper_num-1]) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_home_dir[stepper_num-1] = dir;
+        stepper_home_fast_speed[stepper_num-1] = fast_speed;
+        stepper_home_slow_speed[stepper_num-1] = slow_speed;
+        stepper_home_backoff[stepper_num-1] = backoff;
+    }
+
+    return res;
+}
+
+
+bool stepper_get_home_config(uint8_t stepper_num, uint8_t *dir, uint16_t *fast_speed, uint16_t *slow_speed, uint32_t *backoff)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *dir = stepper_home_dir[stepper_num-1];
+        *fast_speed = stepper_home_fast_speed[stepper_num-1];
+        *slow_speed = stepper_home_slow_speed[stepper_num-1];
+        *backoff = stepper_home_backoff[stepper_num-1];
+    }
+
+    return res;
+}
+
+
+// Homes the steppers in the bitfield: seeks the switch at the fast speed,
+// backs off it, seeks it again at the slow speed and makes that position
+// zero. The ISR runs all the stages, poll stepper_get_home_status() for the
+// outcome. A gantry always homes both sides, see stepper_set_gantry().
+bool stepper_home(uint8_t stepper_bitfield)
+{
+    bool res = stepper_bitfield_valid(stepper_bitfield) && stepper_bitfield && !stepper_coord;
+    struct stepper_move move;
+    uint16_t speed;
+    uint8_t i;
+
+    if (res && stepper_gantry) {
+        // Both sides of a gantry home at once, each stops on its own switches.
+        stepper_bitfield = STEPPER_BITFIELD_STEPPER_GM;
+    }
+
+    for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+        if ((stepper_bitfield & (1 << i)) && stepper_running[i]) {
+            res = false;
+        }
+    }
+
+    if ((stepper_bitfield & STEPPER_BITFIELD_STEPPER_2) && stepper_gear_on && !stepper_gantry) {
+        res = false;
+    }
+
+    if (res) {
+        if (stepper_gantry) {
+            // Let go of the gantry, it locks again once both sides are done.
+            stepper_gear_on = false;
+        }
+
+        for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
+            if (!(stepper_bitfield & (1 << i))) {
+                continue;
+            }
+
+            // Fast seek, the back-off and the slow re-seek follow from the
+            // ISR, see stepper_home_next().
+            speed = stepper_home_fast_speed[i];
+            move.steps = 0;
+            move.mode = STEPPER_MODE_UNTIL_SWITCH;
+            move.dir = stepper_home_dir[i];
+            stepper_move_init(i, &move, speed, STEPPER_TIMER_FREQ / speed, ((STEPPER_TIMER_FREQ % speed) << 8) / speed);
+
+            stepper_move_load(i, &move);
+            stepper_dir_set(i, move.dir);
+            stepper_home_state[i] = STEPPER_HOME_SEEK;
+            stepper_running[i] = true;
+        }
+
+        stepper_timer_start(stepper_bitfield);
+    }
+
+    return res;
+}
+
+
+bool stepper_get_home_status(uint8_t stepper_num, uint8_t *state, int32_t *switch_position)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            *state = stepper_home_state[stepper_num-1];
+            *switch_position = stepper_home_switch_pos[stepper_num-1];
+        }
+    }
+
+    return res;
+}
+
+
+// Runs stepper i at velocity steps/s until told otherwise, negative velocities
+// run with DIR low. Can be called again while jogging, the profile tick ramps
+// to the new velocity at the acceleration limits. Zero ramps down and stops.
+bool stepper_set_target_velocity(uint8_t stepper_num, int32_t velocity)
+{
+    bool res = stepper_num_valid(stepper_num);
+    uint8_t i = stepper_num - 1;
+    uint32_t speed_min;
+    uint32_t speed;
+
+    if (velocity > STEPPER_JOG_SPEED_MAX || velocity < -STEPPER_JOG_SPEED_MAX) {
+        res = false;
+    }
+
+    if (res && (stepper_coord || (stepper_running[i] && !(stepper_axis[i].flags & STEPPER_FLAG_JOG)))) {
+        res = false;
+    }
+
+    if (res && stepper_held(i)) {
+        res = false;
+    }
+
+    if (res) {
+        // The speed after the first step, as used by the S-curve.
+        speed_min = stepper_isqrt((uint32_t)stepper_accel[i] << 1);
+        speed_min = (speed_min ? speed_min << 16 : STEPPER_RATE_MIN);
+
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            stepper_axis[i].jog_target = velocity;
+            stepper_axis[i].jog_speed_min = speed_min;
+            // accel * 2^16 / 1000 per profile tick.
+            stepper_axis[i].jog_accel = ((uint32_t)stepper_accel[i] << 13) / 125;
+            stepper_axis[i].jog_decel = ((uint32_t)stepper_decel[i] << 13) / 125;
+
+            if (!stepper_running[i] && velocity != 0) {
+                speed = (uint32_t)(velocity < 0 ? -velocity : velocity) << 16;
+                if (stepper_accel[i] != STEPPER_ACCEL_DISABLED && speed > speed_min) {
+                    speed = speed_min;
+                }
+                stepper_axis[i].jog_speed = speed;
+                stepper_axis[i].jog_dir = velocity < 0 ? STEPPER_DIR_LOW : STEPPER_DIR_HIGH;
+                stepper_dir_set(i, stepper_axis[i].jog_dir);
+
+                stepper_axis[i].step_count = 0;
+                stepper_axis[i].flags = STEPPER_FLAG_JOG;
+                stepper_axis[i].ramp_state = STEPPER_RAMP_OFF;
+                stepper_axis[i].phase = 0;
+                stepper_period_set(i, stepper_speed_to_ramp_delay(speed));
+
+                stepper_running[i] = true;
+                stepper_timer_start(1 << i);
+            }
+        }
+    }
+
+    return res;
+}
+
+
+// Current velocity of a jogging stepper in steps/s, zero when not jogging.
+bool stepper_get_velocity(uint8_t stepper_num, int32_t *velocity)
+{
+    bool res = stepper_num_valid(stepper_num);
+    uint32_t speed = 0;
+    uint8_t dir = STEPPER_DIR_HIGH;
+
+    if (res) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            if (stepper_axis[stepper_num-1].flags & STEPPER_FLAG_JOG) {
+                speed = stepper_axis[stepper_num-1].jog_speed;
+                dir = stepper_axis[stepper_num-1].jog_dir;
+            }
+        }
+        *velocity = (dir == STEPPER_DIR_HIGH) ? (int32_t)(speed >> 16) : -(int32_t)(speed >> 16);
+    }
+
+    return res;
+}
+
+
+bool stepper_set_position(uint8_t stepper_num, int32_t position)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res && stepper_running[stepper_num-1]) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_axis[stepper_num-1].position = position;
+    }
+
+    return res;
+}
+
+
+bool stepper_get_position(uint8_t stepper_num, int32_t *position)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            *position = stepper_axis[stepper_num-1].position;
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_get_moving(uint8_t stepper_num, uint8_t *stepper_moving)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *stepper_moving = stepper_running[stepper_num-1];
+    }
+    return res;
+
+}
+
+
+bool stepper_set_enable(uint8_t stepper_num, uint8_t enable)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (enable != STEPPER_ENABLE && enable != STEPPER_DISABLE) {
+        res = false;
+    }
+
+    if (stepper_running[stepper_num-1]) {
+        res = false;
+    }
+
+    // Stepper enable pins are active low.
+    switch (stepper_num) {
+    case 1:
+        if (enable) {
+            PORTD.OUTCLR = PIN4_bm; // ENABLE_1
+        } else {
+            PORTD.OUTSET = PIN4_bm; // ENABLE_1
+        }
+        break;
+    case 2:
+        if (enable) {
+            PORTC.OUTCLR = PIN4_bm; // ENABLE_2
+        } else {
+            PORTC.OUTSET = PIN4_bm; // ENABLE_2
+        }
+        break;
+    }
+
+    return res;
+}
+
+
+bool stepper_get_enable(uint8_t stepper_num, uint8_t *enable)
+{
+    bool res = true;
+    // Stepper enable pins are active low.
+    switch (stepper_num) {
+    case 1:
+        *enable = (PORTD.OUT & PIN4_bm) ? STEPPER_DISABLE: STEPPER_ENABLE;// ENABLE_1
+        break;
+    case 2:
+        *enable = (PORTC.OUT & PIN4_bm) ? STEPPER_DISABLE: STEPPER_ENABLE;// ENABLE_2
+        break;
+    default:
+        res = false;
+        break;
+    }
+
+    return res;
+}
+
+
+bool stepper_set_microsteps(uint8_t stepper_num, uint8_t stepper_microstep_bitfield)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (stepper_running[stepper_num-1] || stepper_ustep_auto_rate[stepper_num-1]) {
+        res = false;
+    }
+
+    if (stepper_microstep_bitfield > STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_microsteps[stepper_num-1] = stepper_microstep_bitfield;
+        stepper_ms_restore(stepper_num-1);
+    }
+
+    return res;
+}
+
+
+bool stepper_get_microsteps(uint8_t stepper_num, uint8_t *stepper_microstep_bitfield)
+{
+    bool res = true;
+    bool ms1 = false;
+    bool ms2 = false;
+
+    switch (stepper_num) {
+    case 1:
+        ms1 = (PORTD.OUT & PIN1_bm) ? true : false;
+        ms2 = (PORTD.OUT & PIN2_bm) ? true : false;
+        break;
+    case 2:
+        ms1 = (PORTC.OUT & PIN1_bm) ? true : false;
+        ms2 = (PORTC.OUT & PIN2_bm) ? true : false;
+        break;
+    default:
+        res = false;
+        break;
+    }
+
+    if (res) {
+        switch ((ms1 ? 1 : 0) + (ms2 ? 2 : 0)) {
+        case STEPPER_MICROSTEP_BITFIELD_FULL_STEP:
+            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_FULL_STEP;
+            break;
+        case STEPPER_MICROSTEP_BITFIELD_HALF_STEP:
+            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_HALF_STEP;
+            break;
+        case STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP:
+            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP;
+            break;
+        case STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP:
+            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP;
+            break;
+        }
+    }
+
+    return res;
+}
+
+
+// Lets the firmware pick the microstep resolution from the step rate. Above
+// rate 1/16 steps/s it runs 1/4 steps, above twice that 1/2 steps and above
+// four times that full steps. Positions and step counts stay in 1/16 steps
+// whatever resolution runs. A zero rate turns it off and puts back the setting
+// of stepper_set_microsteps().
+bool stepper_set_auto_microsteps(uint8_t stepper_num, uint16_t rate)
+{
+    bool res = stepper_num_valid(stepper_num);
+    uint8_t i = stepper_num - 1;
+
+    if (stepper_running[i] || (i == 0 && rate && (stepper_gear_on || stepper_gantry))) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_ustep_auto_rate[i] = rate;
+        stepper_ustep_auto_period[i] = rate ? STEPPER_TIMER_FREQ / rate : 0;
+        if (rate) {
+            stepper_ustep_set(i, 1);
+        } else {
+            stepper_ms_restore(i);
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_get_auto_microsteps(uint8_t stepper_num, uint16_t *rate)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *rate = stepper_ustep_auto_rate[stepper_num-1];
+    }
+
+    return res;
+}
+
+
+// Takes up steps of backlash at rate steps/s whenever a stepper reverses,
+// before its first step in the new direction. Only moves of a single stepper
+// are compensated, coordinated moves and arcs run as they are.
+bool stepper_set_backlash(uint8_t stepper_num, uint16_t steps, uint16_t rate)
+{
+    bool res = stepper_num_valid(stepper_num);
+    uint8_t i = stepper_num - 1;
+    uint32_t period = 0;
+
+    if (stepper_running[i] || rate == 0) {
+        res = false;
+    }
+
+    if (res) {
+        period = STEPPER_TIMER_FREQ / rate;
+        if (period < STEPPER_TIMER_MIN_PERIOD) {
+            period = STEPPER_TIMER_MIN_PERIOD;
+        }
+        stepper_backlash[i] = steps;
+        stepper_backlash_rate[i] = rate;
+        stepper_backlash_period[i] = period;
+        stepper_axis[i].backlash = 0;
+    }
+
+    return res;
+}
+
+
+bool stepper_get_backlash(uint8_t stepper_num, uint16_t *steps, uint16_t *rate)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *steps = stepper_backlash[stepper_num-1];
+        *rate = stepper_backlash_rate[stepper_num-1];
+    }
+
+    return res;
+}
+
+
+// Sets the soft travel limits of a stepper. While enabled, a move never
+// takes the position below min or above max. Moves started with
+// stepper_start() and velocity mode ramp down to a stop at the limit, other
+// moves stop dead on it. Homing ignores the limits.
+bool stepper_set_soft_limits(uint8_t stepper_num, uint8_t enable, int32_t min, int32_t max)
+{
+    bool res = stepper_num_valid(stepper_num);
+    uint8_t i = stepper_num - 1;
+
+    if (enable && min > max) {
+        res = false;
+    }
+
+    if (res) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            stepper_limit_min[i] = min;
+            stepper_limit_max[i] = max;
+            stepper_limit_on[i] = enable ? true : false;
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_get_soft_limits(uint8_t stepper_num, uint8_t *enable, int32_t *min, int32_t *max)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            *enable = stepper_limit_on[stepper_num-1];
+            *min = stepper_limit_min[stepper_num-1];
+            *max = stepper_limit_max[stepper_num-1];
+        }
+    }
+
+    return res;
+}
+
+
+// Why the last move of a stepper ended before its end, STEPPER_STOP_NONE if
+// it ran to the end or is still running.
+bool stepper_get_stop_reason(uint8_t stepper_num, uint8_t *reason)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *reason = stepper_stop_reason[stepper_num-1];
+    }
+
+    return res;
+}
+
+
+// Slaves stepper 2 to stepper 1. Stepper 2 then takes num steps for every
+// den steps stepper 1 takes, in the same direction, or the other one for a
+// negative num. The remainder is carried over, so the two stay locked for
+// any length of move. Stepper 2 can't step more often than stepper 1, and
+// can't be moved on its own while geared. Stepper 1 can't use automatic
+// microstepping meanwhile.
+bool stepper_set_gearing(uint8_t enable, int16_t num, uint16_t den)
+{
+    bool res = !stepper_running[0] && !stepper_running[1] && !stepper_coord && !stepper_gantry;
+    uint16_t num_abs = num < 0 ? -(int32_t)num : num;
+
+    if (enable && (den == 0 || num_abs > den || stepper_ustep_auto_rate[0])) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_gear_on = false;
+        stepper_gear_num = num_abs;
+        stepper_gear_den = den;
+        stepper_gear_reverse = num < 0;
+        stepper_gear_error = 0;
+        if (enable) {
+            stepper_gear_dir();
+            stepper_gear_on = true;
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_get_gearing(uint8_t *enable, int16_t *num, uint16_t *den)
+{
+    *enable = stepper_gear_on || stepper_gantry;
+    *num = stepper_gear_reverse ? -(int16_t)stepper_gear_num : (int16_t)stepper_gear_num;
+    *den = stepper_gear_den;
+
+    return true;
+}
+
+
+// Drives one gantry axis with both steppers. Stepper 2 takes every step of
+// stepper 1 in the same ISR, in the same direction or the other one if
+// reverse is set, and a move of stepper 1 stops on the switches of either
+// side. Homing lets go of the lock: stepper_home() then homes both sides at
+// once, each on its own switches and with its own home config, which squares
+// the gantry. The ISR locks the two together again once both have stopped.
+bool stepper_set_gantry(uint8_t enable, uint8_t reverse)
+{
+    bool res = !stepper_running[0] && !stepper_running[1] && !stepper_coord;
+
+    if (enable && stepper_ustep_auto_rate[0]) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_gantry = false;
+        stepper_gear_on = false;
+        stepper_gear_num = 1;
+        stepper_gear_den = 1;
+        stepper_gear_reverse = reverse != 0;
+        stepper_gear_error = 0;
+        if (enable) {
+            stepper_gear_dir();
+            stepper_gear_on = true;
+            stepper_gantry = true;
+        }
+    }
+
+    return res;
+}
+
+
+bool stepper_get_gantry(uint8_t *enable, uint8_t *reverse, uint8_t *locked)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *enable = stepper_gantry;
+        *reverse = stepper_gantry && stepper_gear_reverse;
+        *locked = stepper_gantry && stepper_gear_on;
+    }
+
+    return true;
+}
+
+
+bool stepper_set_dir(uint8_t stepper_num, uint8_t dir)
+{
+    bool res = stepper_num_valid(stepper_num);
+
+    if (dir != STEPPER_DIR_HIGH && dir != STEPPER_DIR_LOW) {
+        res = false;
+    }
+
+    if (stepper_running[stepper_num-1]) {
+        res = false;
+    }
+
+    switch (stepper_num) {
+    case 1:
+        if (dir) {
+            PORTD.OUTSET = PIN3_bm; // DIR_1
+        } else {
+            PORTD.OUTCLR = PIN3_bm; // DIR_1
+        }
+        break;
+    case 2:
+        if (dir) {
+            PORTC.OUTSET = PIN3_bm; // DIR_2
+        } else {
+            PORTC.OUTCLR = PIN3_bm; // DIR_2
+        }
+        break;
     }
+
     return res;
 }
 
 
-// Helper method
-static bool stepper_bitfield_valid(uint8_t stepper_bitfield)
+bool stepper_get_dir(uint8_t stepper_num, uint8_t *dir)
 {
     bool res = true;
-    if (stepper_bitfield & ~(STEPPER_BITFIELD_STEPPER_1 | STEPPER_BITFIELD_STEPPER_2)) {
+    // Stepper enable pins are active low.
+    switch (stepper_num) {
+    case 1:
+        *dir = (PORTD.OUT & PIN3_bm) ? STEPPER_DIR_HIGH: STEPPER_DIR_LOW; // DIR_1
+        break;
+    case 2:
+        *dir = (PORTC.OUT & PIN3_bm) ? STEPPER_DIR_HIGH: STEPPER_DIR_LOW;// DIR_2
+        break;
+    default:
         res = false;
+        break;
     }
+
     return res;
 }
 
 
-bool stepper_set_steps(uint8_t stepper_num, uint32_t steps)
+// Sets the run current. It is applied right away unless the stepper is
+// holding or boosting.
+bool stepper_set_current(uint8_t stepper_num, uint16_t val)
 {
     bool res = stepper_num_valid(stepper_num);
 
-    if (res) {
-        if (stepper_running[stepper_num-1]) {
-            res = false;
-        }
+    if (val > STEPPER_MAX_CURRENT_VAL) {
+        res = false;
     }
 
     if (res) {
-        stepper_step_count[stepper_num-1] = steps;
-        stepper_high[stepper_num-1] = false;
-        stepper_step_until_switch[stepper_num-1] = false;
-        stepper_step_safely[stepper_num-1] = false;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            stepper_axis[stepper_num-1].current_run = val;
+            if (stepper_axis[stepper_num-1].current_level == STEPPER_LEVEL_RUN) {
+                stepper_current_level_set(stepper_num-1, STEPPER_LEVEL_RUN);
+            }
+        }
     }
-
     return res;
 }
 
 
-bool stepper_set_safe_steps(uint8_t stepper_num, uint32_t steps)
+bool stepper_get_current(uint8_t stepper_num, uint16_t *val)
 {
     bool res = stepper_num_valid(stepper_num);
 
     if (res) {
-        if (stepper_running[stepper_num-1]) {
-            res = false;
-        }
-    }
-
-    if (res) {
-        stepper_step_count[stepper_num-1] = steps;
-        stepper_high[stepper_num-1] = false;
-        stepper_step_until_switch[stepper_num-1] = false;
-        stepper_step_safely[stepper_num-1] = true;
+        *val = stepper_axis[stepper_num-1].current_run;
     }
 
     return res;
 }
 
 
-bool stepper_set_step_until_switch(uint8_t stepper_num)
+// Sets the hold current, used once the stepper has been idle for timeout ms,
+// and the boost current, used while it changes speed. A zero timeout stays
+// at the run current and a zero boost uses the run current.
+bool stepper_set_current_levels(uint8_t stepper_num, uint16_t hold, uint16_t boost, uint16_t timeout)
 {
     bool res = stepper_num_valid(stepper_num);
+    uint8_t i = stepper_num - 1;
 
-    if (res) {
-        if (stepper_running[stepper_num-1]) {
-            res = false;
-        }
+    if (hold > STEPPER_MAX_CURRENT_VAL || boost > STEPPER_MAX_CURRENT_VAL) {
+        res = false;
     }
 
     if (res) {
-        stepper_step_count[stepper_num-1] = 0;
-        stepper_high[stepper_num-1] = false;
-        stepper_step_until_switch[stepper_num-1] = true;
-        stepper_step_safely[stepper_num-1] = true;
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            stepper_axis[i].current_hold = hold;
+            stepper_axis[i].current_boost = boost;
+            stepper_axis[i].hold_timeout = timeout;
+            stepper_axis[i].idle_ms = 0;
+            if (!stepper_running[i]) {
+                // Count down to the hold current from now.
+                stepper_current_level_set(i, STEPPER_LEVEL_RUN);
+            }
+            if (stepper_current_auto(i)) {
+                stepper_profile_tick_start();
+            }
+        }
     }
 
     return res;
 }
 
 
-bool stepper_start(uint8_t stepper_bitfield)
+bool stepper_get_current_levels(uint8_t stepper_num, uint16_t *hold, uint16_t *boost, uint16_t *timeout)
 {
-    bool res = stepper_bitfield_valid(stepper_bitfield);
-
-    if (res) {
-        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_1 && stepper_running[0]) {
-            res = false;
-        }
-    }
-
-    if (res) {
-        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_2 && stepper_running[1]) {
-            res = false;
-        }
-    }
+    bool res = stepper_num_valid(stepper_num);
 
     if (res) {
-        if (!stepper_running[0] && !stepper_running[1]) {
-            // Enables starting both motors at exactly the same time.
-            steppers_running = false;
-        }
-
-        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_1) {
-            stepper_delay_count[0] = 0;
-            stepper_running[0] = true;
-        }
-        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_2) {
-            stepper_delay_count[1] = 0;
-            stepper_running[1] = true;
-        }
-
-        steppers_running = true;
+        *hold = stepper_axis[stepper_num-1].current_hold;
+        *boost = stepper_axis[stepper_num-1].current_boost;
+        *timeout = stepper_axis[stepper_num-1].hold_timeout;
     }
 
     return res;
 }
 
 
-bool stepper_stop(uint8_t stepper_bitfield)
+bool stepper_set_100uS_delay(uint8_t stepper_num, uint16_t val)
 {
-    bool res = stepper_bitfield_valid(stepper_bitfield);
+    bool res = stepper_num_valid(stepper_num);
 
-    if (res) {
-        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_1 && stepper_bitfield & STEPPER_BITFIELD_STEPPER_2) {
-            // Stops steppers at exactly the same time.
-            steppers_running = false;
-        }
-        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_1) {
-            stepper_running[0] = false;
-        }
+    if (stepper_running[stepper_num-1]) {
+        res = false;
+    }
 
-        if (stepper_bitfield & STEPPER_BITFIELD_STEPPER_2) {
-            stepper_running[1] = false;
-        }
+    if (res && (val >= USHRT_MAX)) {
+        res = false;
+    }
+
+    if (res) {
+        stepper_delay_increments[stepper_num-1] = val;
+        stepper_rate[stepper_num-1] = (10000UL << 16) / (val + 1UL);
+        stepper_fixed_period[stepper_num-1] = stepper_delay_to_period(val);
+        stepper_fixed_frac[stepper_num-1] = 0;
     }
 
     return res;
 }
 
 
-bool stepper_get_moving(uint8_t stepper_num, uint8_t *stepper_moving)
+bool stepper_get_100uS_delay(uint8_t stepper_num, uint16_t *val)
 {
     bool res = stepper_num_valid(stepper_num);
 
     if (res) {
-        *stepper_moving = stepper_running[stepper_num-1];
+        *val = stepper_delay_increments[stepper_num-1];
     }
-    return res;
 
+    return res;
 }
 
 
-bool stepper_set_enable(uint8_t stepper_num, uint8_t enable)
+bool stepper_set_rate(uint8_t stepper_num, uint32_t rate)
 {
     bool res = stepper_num_valid(stepper_num);
+    uint32_t period = 0;
+    uint8_t frac = 0;
 
-    if (enable != STEPPER_ENABLE && enable != STEPPER_DISABLE) {
+    if (res && stepper_running[stepper_num-1]) {
         res = false;
     }
 
-    if (stepper_running[stepper_num-1]) {
+    if (rate < STEPPER_RATE_MIN || rate > STEPPER_RATE_MAX) {
         res = false;
     }
 
-    // Stepper enable pins are active low.
-    switch (stepper_num) {
-    case 1:
-        if (enable) {
-            PORTD.OUTCLR = PIN4_bm; // ENABLE_1
-        } else {
-            PORTD.OUTSET = PIN4_bm; // ENABLE_1
-        }
-        break;
-    case 2:
-        if (enable) {
-            PORTC.OUTCLR = PIN4_bm; // ENABLE_2
-        } else {
-            PORTC.OUTSET = PIN4_bm; // ENABLE_2
-        }
-        break;
+    if (res) {
+        stepper_rate_to_period(rate, &period, &frac);
+        stepper_rate[stepper_num-1] = rate;
+        stepper_fixed_period[stepper_num-1] = period;
+        stepper_fixed_frac[stepper_num-1] = frac;
     }
 
     return res;
 }
 
 
-bool stepper_get_enable(uint8_t stepper_num, uint8_t *enable)
+bool stepper_get_rate(uint8_t stepper_num, uint32_t *rate)
 {
-    bool res = true;
-    // Stepper enable pins are active low.
-    switch (stepper_num) {
-    case 1:
-        *enable = (PORTD.OUT & PIN4_bm) ? STEPPER_DISABLE: STEPPER_ENABLE;// ENABLE_1
-        break;
-    case 2:
-        *enable = (PORTC.OUT & PIN4_bm) ? STEPPER_DISABLE: STEPPER_ENABLE;// ENABLE_2
-        break;
-    default:
-        res = false;
-        break;
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *rate = stepper_rate[stepper_num-1];
     }
 
     return res;
 }
 
 
-bool stepper_set_microsteps(uint8_t stepper_num, uint8_t stepper_microstep_bitfield)
+bool stepper_set_accel(uint8_t stepper_num, uint16_t accel, uint16_t decel)
 {
     bool res = stepper_num_valid(stepper_num);
-    bool ms1 = false;
-    bool ms2 = false;
 
-    if (stepper_running[stepper_num-1]) {
+    if (res && stepper_running[stepper_num-1]) {
         res = false;
     }
 
-    switch(stepper_microstep_bitfield) {
-    case STEPPER_MICROSTEP_BITFIELD_FULL_STEP:
-        break;
-    case STEPPER_MICROSTEP_BITFIELD_HALF_STEP:
-        ms1 = true;
-        break;
-    case STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP:
-        ms2 = true;
-        break;
-    case STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP:
-        ms1 = true;
-        ms2 = true;
-        break;
-    default:
+    // Either both are disabled or both are set.
+    if ((accel == STEPPER_ACCEL_DISABLED) != (decel == STEPPER_ACCEL_DISABLED)) {
         res = false;
-        break;
     }
 
     if (res) {
-        switch (stepper_num) {
-        case 1:
-            if (ms1) {
-                PORTD.OUTSET = PIN1_bm; // MS1_1
-            } else {
-                PORTD.OUTCLR = PIN1_bm; // MS1_1
-            }
-            if (ms2) {
-                PORTD.OUTSET = PIN2_bm; // MS2_1
-            } else {
-                PORTD.OUTCLR = PIN2_bm; // MS2_1
-            }
-            break;
-        case 2:
-            if (ms1) {
-                PORTC.OUTSET = PIN1_bm; // MS1_2
-            } else {
-                PORTC.OUTCLR = PIN1_bm; // MS1_2
-            }
-            if (ms2) {
-                PORTC.OUTSET = PIN2_bm; // MS2_2
-            } else {
-                PORTC.OUTCLR = PIN2_bm; // MS2_2
-            }
-            break;
-        }
+        stepper_accel[stepper_num-1] = accel;
+        stepper_decel[stepper_num-1] = decel;
+        stepper_accel_preset[stepper_num-1] = STEPPER_ACCEL_PRESET_NONE;
+        stepper_ramp_scale[stepper_num-1] = 0;
+        stepper_scurve_limits(stepper_num-1);
     }
 
     return res;
 }
 
 
-bool stepper_get_microsteps(uint8_t stepper_num, uint8_t *stepper_microstep_bitfield)
+// Selects one of the acceleration presets of ramp_table.h, used for both
+// acceleration and deceleration. Ramped moves then take their delays from
+// the table instead of dividing for each step. STEPPER_ACCEL_PRESET_NONE
+// goes back to the computed ramp with the preset acceleration, as does
+// stepper_set_accel(). S-curve moves never use the table.
+bool stepper_set_accel_preset(uint8_t stepper_num, uint8_t preset)
 {
-    bool res = true;
-    bool ms1 = false;
-    bool ms2 = false;
+    bool res = stepper_num_valid(stepper_num);
+    uint16_t accel;
 
-    switch (stepper_num) {
-    case 1:
-        ms1 = (PORTD.OUT & PIN1_bm) ? true : false;
-        ms2 = (PORTD.OUT & PIN2_bm) ? true : false;
-        break;
-    case 2:
-        ms1 = (PORTC.OUT & PIN1_bm) ? true : false;
-        ms2 = (PORTC.OUT & PIN2_bm) ? true : false;
-        break;
-    default:
+    if (preset > RAMP_PRESET_NUM) {
         res = false;
-        break;
     }
 
-    if (res) {
-        switch ((ms1 ? 1 : 0) + (ms2 ? 2 : 0)) {
-        case STEPPER_MICROSTEP_BITFIELD_FULL_STEP:
-            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_FULL_STEP;
-            break;
-        case STEPPER_MICROSTEP_BITFIELD_HALF_STEP:
-            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_HALF_STEP;
-            break;
-        case STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP:
-            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP;
-            break;
-        case STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP:
-            *stepper_microstep_bitfield = STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP;
-            break;
+    if (res && preset != STEPPER_ACCEL_PRESET_NONE) {
+        accel = pgm_read_word(&ramp_preset_accel[preset-1]);
+        res = stepper_set_accel(stepper_num, accel, accel);
+        if (res) {
+            stepper_accel_preset[stepper_num-1] = preset;
+            stepper_ramp_scale[stepper_num-1] = pgm_read_word(&ramp_preset_scale[preset-1]);
+        }
+    } else if (res) {
+        if (stepper_running[stepper_num-1]) {
+            res = false;
+        } else {
+            stepper_accel_preset[stepper_num-1] = STEPPER_ACCEL_PRESET_NONE;
+            stepper_ramp_scale[stepper_num-1] = 0;
         }
     }
 
@@ -397,131 +3333,90 @@ bool stepper_get_microsteps(uint8_t stepper_num, uint8_t *stepper_microstep_bitf
 }
 
 
-bool stepper_set_dir(uint8_t stepper_num, uint8_t dir)
+bool stepper_get_accel_preset(uint8_t stepper_num, uint8_t *preset)
 {
     bool res = stepper_num_valid(stepper_num);
 
-    if (dir != STEPPER_DIR_HIGH && dir != STEPPER_DIR_LOW) {
-        res = false;
-    }
-
-    if (stepper_running[stepper_num-1]) {
-        res = false;
-    }
-
-    switch (stepper_num) {
-    case 1:
-        if (dir) {
-            PORTD.OUTSET = PIN3_bm; // DIR_1
-        } else {
-            PORTD.OUTCLR = PIN3_bm; // DIR_1
-        }
-        break;
-    case 2:
-        if (dir) {
-            PORTC.OUTSET = PIN3_bm; // DIR_2
-        } else {
-            PORTC.OUTCLR = PIN3_bm; // DIR_2
-        }
-        break;
+    if (res) {
+        *preset = stepper_accel_preset[stepper_num-1];
     }
 
     return res;
 }
 
 
-bool stepper_get_dir(uint8_t stepper_num, uint8_t *dir)
+bool stepper_get_accel(uint8_t stepper_num, uint16_t *accel, uint16_t *decel)
 {
-    bool res = true;
-    // Stepper enable pins are active low.
-    switch (stepper_num) {
-    case 1:
-        *dir = (PORTD.OUT & PIN3_bm) ? STEPPER_DIR_HIGH: STEPPER_DIR_LOW; // DIR_1
-        break;
-    case 2:
-        *dir = (PORTC.OUT & PIN3_bm) ? STEPPER_DIR_HIGH: STEPPER_DIR_LOW;// DIR_2
-        break;
-    default:
-        res = false;
-        break;
+    bool res = stepper_num_valid(stepper_num);
+
+    if (res) {
+        *accel = stepper_accel[stepper_num-1];
+        *decel = stepper_decel[stepper_num-1];
     }
 
     return res;
 }
 
 
-bool stepper_set_current(uint8_t stepper_num, uint16_t val)
+bool stepper_set_max_speed(uint8_t stepper_num, uint16_t val)
 {
     bool res = stepper_num_valid(stepper_num);
 
-    if (stepper_running[stepper_num-1]) {
+    if (res && stepper_running[stepper_num-1]) {
         res = false;
     }
 
-    if (val > STEPPER_MAX_CURRENT_VAL) {
+    if (val < STEPPER_MAX_SPEED_MIN) {
         res = false;
     }
 
     if (res) {
-        switch (stepper_num) {
-        case 1:
-            DACA.CH0DATA = val;
-            break;
-        case 2:
-            DACA.CH1DATA = val;
-            break;
-        }
+        stepper_max_speed[stepper_num-1] = val;
     }
+
     return res;
 }
 
 
-bool stepper_get_current(uint8_t stepper_num, uint16_t *val)
+bool stepper_get_max_speed(uint8_t stepper_num, uint16_t *val)
 {
-    bool res = true;
+    bool res = stepper_num_valid(stepper_num);
 
-    switch (stepper_num) {
-    case 1:
-        *val = DACA.CH0DATA;
-        break;
-    case 2:
-        *val = DACA.CH1DATA;
-        break;
-    default:
-        res = false;
-        break;
+    if (res) {
+        *val = stepper_max_speed[stepper_num-1];
     }
 
     return res;
 }
 
 
-bool stepper_set_100uS_delay(uint8_t stepper_num, uint16_t val)
+bool stepper_set_jerk(uint8_t stepper_num, uint32_t val)
 {
     bool res = stepper_num_valid(stepper_num);
 
-    if (stepper_running[stepper_num-1]) {
+    if (res && stepper_running[stepper_num-1]) {
         res = false;
     }
 
-    if (res && (val >= USHRT_MAX)) {
+    if (val < STEPPER_MIN_JERK_VAL || val > STEPPER_MAX_JERK_VAL) {
         res = false;
     }
 
     if (res) {
-        stepper_delay_increments[stepper_num-1] = val;
+        stepper_jerk[stepper_num-1] = val;
+        stepper_scurve_limits(stepper_num-1);
     }
 
     return res;
 }
 
 
-bool stepper_get_100uS_delay(uint8_t stepper_num, uint16_t *val)
+bool stepper_get_jerk(uint8_t stepper_num, uint32_t *val)
 {
     bool res = stepper_num_valid(stepper_num);
 
     if (res) {
-        *val = stepper_delay_increments[stepper_num-1];
+        *val = stepper_jerk[stepper_num-1];
     }
 
     return res;
@@ -549,19 +3444,18 @@ static void stepper_dacs_init()
 static void stepper_timer_init()
 {
     cli();
-    // We want a 50uS overflow.. and assume a 32Mhz clock
-    // = 100uS
-    // = (1/(32Mhz/64))*50
-    // = (1/32Mhz/(DIV))*(PER+1)
-
-    // Set per to 25-1
-    TCC4.PER = 24;
+    // Free running counter, assuming a 32Mhz clock
+    // = 0.25uS per tick
+    // = 1/(32Mhz/8)
+    TCC4.PER = 0xffff;
 
-    // Set CLK DIV to 1:64
-    TCC4.CTRLA = TC45_CLKSEL_DIV64_gc;
+    // CLK DIV is set to 1:8 while steppers run, the clock is off when idle.
+    TCC4.CTRLA = TC45_CLKSEL_OFF_gc;
 
-    // Low level overflow interrupt
-    TCC4.INTCTRLA = TC45_OVFINTLVL_LO_gc;
+    // Compare interrupts are enabled per stepper as moves start. The compare
+    // outputs stay disabled, OC4A shares PC0 with the stepper 2 step pin.
+    TCC4.INTCTRLA = 0;
+    TCC4.INTCTRLB = 0;
 
     // Enable low level interrupts
     PMIC.CTRL |= PMIC_LOLVLEN_bm;
@@ -583,12 +3477,22 @@ void stepper_init()
     PORTD.DIRSET = PIN1_bm; // MS2_1
     PORTD.DIRSET = PIN2_bm; // MS1_1
     PORTD.DIRSET = PIN3_bm; // DIR_1
+    stepper_axis[0].port = &PORTD;
+    stepper_axis[0].step_bm = PIN0_bm; // STEP_1
+    stepper_axis[0].dir_bm = PIN3_bm; // DIR_1
+    stepper_axis[0].ms1_bm = PIN1_bm; // MS1_1
+    stepper_axis[0].ms2_bm = PIN2_bm; // MS2_1
 
     // Set the rest of stepper 2 pins as outputs
     PORTC.DIRSET = PIN0_bm; // STEP_2
     PORTC.DIRSET = PIN1_bm; // MS1_2
     PORTC.DIRSET = PIN2_bm; // MS2_2
     PORTC.DIRSET = PIN3_bm; // DIR_2
+    stepper_axis[1].port = &PORTC;
+    stepper_axis[1].step_bm = PIN0_bm; // STEP_2
+    stepper_axis[1].dir_bm = PIN3_bm; // DIR_2
+    stepper_axis[1].ms1_bm = PIN1_bm; // MS1_2
+    stepper_axis[1].ms2_bm = PIN2_bm; // MS2_2
 
     // Set all stepper 1 ports low.
     PORTD.OUTCLR = PIN0_bm; // STEP_1
@@ -597,20 +3501,38 @@ void stepper_init()
     // Set stepper motor current to minimum possible.
     stepper_dacs_init();
 
-    steppers_running = false;
     for (i = 0; i < STEPPER_MAX_STEPPER_NUM; i++) {
         stepper_running[i] = false;
 
-        stepper_step_count[i] = 0;
-        stepper_high[i] = false;
-
-        stepper_step_until_switch[i] = false;
-
-        stepper_step_safely[i] = true;
+        stepper_axis[i].step_count = 0;
+        stepper_axis[i].position = 0;
+        stepper_axis[i].wait = 0;
+        stepper_axis[i].ustep = 1;
+        stepper_axis[i].elec = 0; // The driver starts on a full step
+        stepper_axis[i].last_dir = STEPPER_DIR_UNKNOWN;
+        stepper_stop_reason[i] = STEPPER_STOP_NONE;
+        stepper_probe_state[i] = STEPPER_PROBE_IDLE;
+        stepper_set_soft_limits(i+1, false, 0, 0);
+        stepper_ustep_auto_rate[i] = 0;
+        stepper_ustep_auto_period[i] = 0;
+        stepper_queue_head[i] = 0;
+        stepper_queue_count[i] = 0;
+        stepper_home_state[i] = STEPPER_HOME_IDLE;
+        stepper_home_switch_pos[i] = 0;
+        stepper_axis[i].flags = STEPPER_FLAG_SAFELY;
+        stepper_axis[i].current_level = STEPPER_LEVEL_RUN;
+        stepper_set_current_levels(i+1, STEPPER_MIN_CURRENT_VAL, 0, 0);
         stepper_set_current(i+1, STEPPER_MIN_CURRENT_VAL);
         stepper_get_dir(i+1, false);
         stepper_set_microsteps(i+1, STEPPER_MICROSTEP_BITFIELD_FULL_STEP);
         stepper_set_100uS_delay(i+1, STEPPER_STEP_100US_DELAY_5MS);
+        stepper_set_accel(i+1, STEPPER_ACCEL_DISABLED, STEPPER_ACCEL_DISABLED);
+        stepper_set_max_speed(i+1, STEPPER_MAX_SPEED_DEFAULT);
+        stepper_set_profile(i+1, STEPPER_PROFILE_TRAPEZOIDAL);
+        stepper_set_jerk(i+1, STEPPER_JERK_DEFAULT);
+        stepper_set_backlash(i+1, 0, STEPPER_BACKLASH_RATE_DEFAULT);
+        stepper_set_home_config(i+1, STEPPER_DIR_LOW, STEPPER_HOME_FAST_SPEED_DEFAULT, STEPPER_HOME_SLOW_SPEED_DEFAULT,
+                                STEPPER_HOME_BACKOFF_DEFAULT);
     }
 
     stepper_timer_init();
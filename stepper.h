@@ -32,6 +32,68 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #define STEPPER_STEP_100US_DELAY_MIN 1
 #define STEPPER_STEP_100US_DELAY_MAX (USHRT_MAX)
 
+// Rate of moves without acceleration, in steps/s as Q16.16. The top rate
+// keeps the step period above STEPPER_TIMER_MIN_PERIOD in stepper.c.
+#define STEPPER_RATE_MIN 0x2800UL
+#define STEPPER_RATE_MAX (2850UL << 16)
+
+// Acceleration and deceleration are in steps/s^2, zero disables ramping.
+#define STEPPER_ACCEL_DISABLED 0
+#define STEPPER_MAX_ACCEL_VAL (USHRT_MAX)
+
+// Max speed is the cruise speed of ramped moves, in steps/s.
+#define STEPPER_MAX_SPEED_DEFAULT 1000
+#define STEPPER_MAX_SPEED_MIN 1
+#define STEPPER_MAX_SPEED_MAX (USHRT_MAX)
+
+#define STEPPER_PROFILE_TRAPEZOIDAL 0x00
+#define STEPPER_PROFILE_SCURVE 0x01
+
+// Acceleration presets are numbered from 1, see ramp_table.py.
+#define STEPPER_ACCEL_PRESET_NONE 0x00
+
+// Jerk is in steps/s^3 and only used by the S-curve profile.
+#define STEPPER_JERK_DEFAULT 100000UL
+#define STEPPER_MIN_JERK_VAL 1UL
+#define STEPPER_MAX_JERK_VAL 50000000UL
+
+// Modes of queued moves, these match stepper_set_steps(),
+// stepper_set_safe_steps(), stepper_set_step_until_switch() and
+// stepper_set_probe_steps().
+#define STEPPER_MODE_STEPS 0x00
+#define STEPPER_MODE_SAFE_STEPS 0x01
+#define STEPPER_MODE_UNTIL_SWITCH 0x02
+#define STEPPER_MODE_PROBE 0x03
+#define STEPPER_MODE_PROBE_CONTINUE 0x04
+
+// Arc directions, stepper 1 is x and stepper 2 is y.
+#define STEPPER_ARC_CW 0x00
+#define STEPPER_ARC_CCW 0x01
+
+// Homing stages, see stepper_home(). Speeds are in steps/s and the back-off
+// distance in steps.
+#define STEPPER_HOME_IDLE 0x00
+#define STEPPER_HOME_SEEK 0x01
+#define STEPPER_HOME_BACKOFF 0x02
+#define STEPPER_HOME_RESEEK 0x03
+#define STEPPER_HOME_DONE 0x04
+#define STEPPER_HOME_FAILED 0x05
+
+#define STEPPER_HOME_FAST_SPEED_DEFAULT 500
+#define STEPPER_HOME_SLOW_SPEED_DEFAULT 50
+#define STEPPER_HOME_BACKOFF_DEFAULT 100
+
+// Backlash compensation rate, in steps/s.
+#define STEPPER_BACKLASH_RATE_DEFAULT 2000
+
+// Top speed of velocity mode, in steps/s.
+#define STEPPER_JOG_SPEED_MAX 2850L
+
+// Moves that can be queued behind the running move of each stepper. Each
+// slot holds a precomputed struct stepper_move, so this is kept to what a
+// host needs to keep the stepper busy between two commands.
+#define STEPPER_QUEUE_LEN 2
+
 #define STEPPER_MAX_CURRENT_VAL 4095
 #define STEPPER_MIN_CURRENT_VAL 0
 
@@ -51,20 +113,94 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #define STEPPER_BITFIELD_STEPPER_2 2
 #define STEPPER_BITFIELD_STEPPER_GM 3
 
+// Why a stepper last stopped short, see stepper_get_stop_reason().
+#define STEPPER_STOP_NONE 0x00
+#define STEPPER_STOP_COMMAND 0x01
+#define STEPPER_STOP_SWITCH 0x02
+#define STEPPER_STOP_LIMIT_MIN 0x03
+#define STEPPER_STOP_LIMIT_MAX 0x04
+
+// Probe latch states, see stepper_get_probe_result().
+#define STEPPER_PROBE_IDLE 0x00
+#define STEPPER_PROBE_ARMED 0x01
+#define STEPPER_PROBE_TRIPPED 0x02
+
 #define STEPPER_MICROSTEP_BITFIELD_FULL_STEP 0
 #define STEPPER_MICROSTEP_BITFIELD_HALF_STEP 1
 #define STEPPER_MICROSTEP_BITFIELD_QUARTER_STEP 2
 #define STEPPER_MICROSTEP_BITFIELD_SIXTEENTH_STEP 3
 
 
+// A move with its ramp already worked out, so the ISR can start it by just
+// copying it in. The ramp starts at step ramp_n and decelerates down to the
+// speed at step ramp_end_n, both are 0 for moves from and to standstill.
+// S-curve moves take their limits from the stepper and only carry their
+// start and peak speeds, in Q16.16 steps/s.
+struct stepper_move {
+    uint32_t steps;
+    uint32_t period;
+    uint8_t period_frac;
+    union {
+        struct {
+            uint32_t ramp_delay;
+            uint32_t ramp_min_delay;
+        };
+        struct {
+            uint32_t scurve_speed_min;
+            uint32_t scurve_speed_max;
+        };
+    };
+    uint32_t ramp_decel_steps;
+    int32_t ramp_n;
+    uint32_t ramp_end_n;
+    uint8_t ramp_state;
+    uint8_t profile;
+    uint8_t mode;
+    uint8_t dir;
+};
+
+// A coordinated two axis segment. The move is that of the major axis, the
+// minor axis follows it.
+struct stepper_segment {
+    struct stepper_move move;
+    uint32_t minor_steps;
+    uint8_t major;
+    uint8_t minor_dir;
+};
+
+
 bool stepper_set_steps(uint8_t stepper_num, uint32_t steps);
 bool stepper_set_safe_steps(uint8_t stepper_number, uint32_t steps);
+bool stepper_set_profile(uint8_t stepper_num, uint8_t profile);
+bool stepper_get_profile(uint8_t stepper_num, uint8_t *profile);
 bool stepper_set_step_until_switch(uint8_t stepper_num);
+bool stepper_set_probe_steps(uint8_t stepper_num, uint32_t steps, uint8_t cont);
+bool stepper_get_probe_result(uint8_t stepper_num, uint8_t *state, int32_t *position, uint16_t *time);
+void stepper_probe_edge(uint8_t level);
 bool stepper_start(uint8_t stepper_bitfield);
 bool stepper_stop(uint8_t stepper_bitfield);
 
+bool stepper_move_linear(int32_t dx, int32_t dy, uint16_t speed);
+bool stepper_move_to(uint8_t stepper_num, int32_t target);
+bool stepper_move_arc(int16_t center_x, int16_t center_y, int16_t end_x, int16_t end_y, uint8_t dir, uint16_t speed);
+
+bool stepper_enqueue(uint8_t stepper_num, uint8_t mode, uint8_t dir, uint32_t steps, uint16_t speed);
+bool stepper_flush(uint8_t stepper_bitfield);
+bool stepper_get_queue_depth(uint8_t stepper_num, uint8_t *depth);
+
+bool stepper_set_home_config(uint8_t stepper_num, uint8_t dir, uint16_t fast_speed, uint16_t slow_speed, uint32_t backoff);
+bool stepper_get_home_config(uint8_t stepper_num, uint8_t *dir, uint16_t *fast_speed, uint16_t *slow_speed, uint32_t *backoff);
+bool stepper_home(uint8_t stepper_bitfield);
+bool stepper_get_home_status(uint8_t stepper_num, uint8_t *state, int32_t *switch_position);
+
+bool stepper_set_target_velocity(uint8_t stepper_num, int32_t velocity);
+bool stepper_get_velocity(uint8_t stepper_num, int32_t *velocity);
+
 bool stepper_get_moving(uint8_t stepper_num, uint8_t *stepper_moving);
 
+bool stepper_set_position(uint8_t stepper_num, int32_t position);
+bool stepper_get_position(uint8_t stepper_num, int32_t *position);
+
 
 bool stepper_set_enable(uint8_t stepper_num, uint8_t enable);
 bool stepper_get_enable(uint8_t stepper_num, uint8_t *enable);
@@ -72,15 +208,52 @@ bool stepper_get_enable(uint8_t stepper_num, uint8_t *enable);
 bool stepper_set_microsteps(uint8_t stepper_num, uint8_t stepper_microstep_bitfield);
 bool stepper_get_microsteps(uint8_t stepper_num, uint8_t *stepper_microstep_bitfield);
 
+bool stepper_set_auto_microsteps(uint8_t stepper_num, uint16_t rate);
+bool stepper_get_auto_microsteps(uint8_t stepper_num, uint16_t *rate);
+
+bool stepper_set_backlash(uint8_t stepper_num, uint16_t steps, uint16_t rate);
+bool stepper_get_backlash(uint8_t stepper_num, uint16_t *steps, uint16_t *rate);
+
+bool stepper_set_soft_limits(uint8_t stepper_num, uint8_t enable, int32_t min, int32_t max);
+bool stepper_get_soft_limits(uint8_t stepper_num, uint8_t *enable, int32_t *min, int32_t *max);
+bool stepper_get_stop_reason(uint8_t stepper_num, uint8_t *reason);
+
+bool stepper_set_gearing(uint8_t enable, int16_t num, uint16_t den);
+bool stepper_get_gearing(uint8_t *enable, int16_t *num, uint16_t *den);
+bool stepper_set_gantry(uint8_t enable, uint8_t reverse);
+bool stepper_get_gantry(uint8_t *enable, uint8_t *reverse, uint8_t *locked);
+
 bool stepper_set_dir(uint8_t stepper_num, uint8_t dir);
 bool stepper_get_dir(uint8_t stepper_num, uint8_t *dir);
 
 bool stepper_set_current(uint8_t stepper_num, uint16_t val);
 bool stepper_get_current(uint8_t stepper_num, uint16_t *val);
+bool stepper_set_current_levels(uint8_t stepper_num, uint16_t hold, uint16_t boost, uint16_t timeout);
+bool stepper_get_current_levels(uint8_t stepper_num, uint16_t *hold, uint16_t *boost, uint16_t *timeout);
 
 bool stepper_set_100uS_delay(uint8_t stepper_num, uint16_t val);
 bool stepper_get_100uS_delay(uint8_t stepper_num, uint16_t *val);
 
+bool stepper_set_rate(uint8_t stepper_num, uint32_t rate);
+bool stepper_get_rate(uint8_t stepper_num, uint32_t *rate);
+
+bool stepper_set_accel(uint8_t stepper_num, uint16_t accel, uint16_t decel);
+bool stepper_get_accel(uint8_t stepper_num, uint16_t *accel, uint16_t *decel);
+bool stepper_set_accel_preset(uint8_t stepper_num, uint8_t preset);
+bool stepper_get_accel_preset(uint8_t stepper_num, uint8_t *preset);
+
+bool stepper_set_max_speed(uint8_t stepper_num, uint16_t val);
+bool stepper_get_max_speed(uint8_t stepper_num, uint16_t *val);
+
+bool stepper_set_jerk(uint8_t stepper_num, uint32_t val);
+bool stepper_get_jerk(uint8_t stepper_num, uint32_t *val);
+
+void stepper_segment_init(struct stepper_segment *seg, int32_t dx, int32_t dy, uint32_t len,
+                          uint16_t entry, uint16_t nominal, uint16_t exit, uint16_t accel);
+bool stepper_start_segments();
+
+uint16_t stepper_isqrt(uint32_t val);
+
 void stepper_init();
 
 
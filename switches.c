@@ -19,35 +19,167 @@ You should have received a copy of the GNU General Public License
 along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 */
 #include "switches.h"
+#include "stepper.h"
+#include "perf.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
 
 
-inline bool switch_r1a_or_r1b_triggered()
+volatile uint8_t switches_blocked;
+
+// Debounced switch states, active switches set, in the SWITCHES_R* bits.
+static volatile uint8_t switches_active;
+// Switches that are active high rather than pulled to ground.
+static volatile uint8_t switches_invert;
+// Switches that stop their stepper.
+static volatile uint8_t switches_enable;
+// Filter time in us, 0 takes each change as it comes.
+static volatile uint16_t switches_filter;
+// Samples of each switch that read the new level, less those that read the
+// old one, while a change settles.
+static uint8_t switches_count[4];
+
+
+// Switches the pin levels show active, in the SWITCHES_R* bits.
+static inline uint8_t switches_level(uint8_t port_in)
+{
+    return (((uint8_t)~port_in >> 4) ^ switches_invert) & SWITCHES_GC;
+}
+
+
+// Takes active as the debounced state and works out which steppers that
+// blocks.
+static void switches_update(uint8_t active)
 {
-    return !((PORTA.IN & PIN4_bm) && (PORTA.IN & PIN5_bm));
+    uint8_t blocked = 0;
+
+    switches_active = active;
+
+    active &= switches_enable;
+    if (active & SWITCHES_R1) {
+        blocked |= SWITCHES_BLOCKED_1;
+    }
+    if (active & SWITCHES_R2) {
+        blocked |= SWITCHES_BLOCKED_2;
+    }
+    switches_blocked = blocked;
 }
 
 
-inline bool switch_r2a_or_r2b_triggered()
+// A switch pin changed. The first change starts the sampling, later edges
+// while it runs don't restart it, so bounces can't push a trip back. Probes
+// see the unfiltered edge.
+ISR(PORTA_INT_vect)
 {
-    return !((PORTA.IN & PIN6_bm) && (PORTA.IN & PIN7_bm));
+#ifdef PERF_ISR_BUSY
+    uint16_t start = perf_start();
+#endif
+    uint8_t level;
+
+    PORTA.INTFLAGS = PIN4_bm | PIN5_bm | PIN6_bm | PIN7_bm;
+
+    level = switches_level(PORTA.IN);
+    stepper_probe_edge(level & switches_enable);
+    if (!switches_filter) {
+        switches_update(level);
+    } else if (TCC5.CTRLA == TC45_CLKSEL_OFF_gc) {
+        TCC5.CNT = 0;
+        TCC5.INTFLAGS = TC5_OVFIF_bm;
+        TCC5.CTRLA = TC45_CLKSEL_DIV8_gc;
+    }
+#ifdef PERF_ISR_BUSY
+    perf_isr_busy(start);
+#endif
+}
+
+
+// Samples the pins while a change settles. A sample at the new level counts
+// a switch up, one back at the old level counts it down again. The sampling
+// stops once no switch is left in between.
+ISR(TCC5_OVF_vect)
+{
+#ifdef PERF_ISR_BUSY
+    uint16_t start = perf_start();
+#endif
+    uint8_t changed;
+    uint8_t active = switches_active;
+    uint8_t settling = 0;
+    uint8_t bm;
+    uint8_t i;
+
+    TCC5.INTFLAGS = TC5_OVFIF_bm;
+
+    changed = switches_level(PORTA.IN) ^ active;
+    for (i = 0, bm = 1; i < 4; i++, bm <<= 1) {
+        if (changed & bm) {
+            if (++switches_count[i] >= SWITCHES_SAMPLES) {
+                switches_count[i] = 0;
+                active ^= bm;
+            }
+        } else if (switches_count[i]) {
+            switches_count[i]--;
+        }
+        settling |= switches_count[i];
+    }
+
+    if (!settling) {
+        TCC5.CTRLA = TC45_CLKSEL_OFF_gc;
+    }
+    if (active != switches_active) {
+        switches_update(active);
+    }
+#ifdef PERF_ISR_BUSY
+    perf_isr_busy(start);
+#endif
 }
 
 
 uint8_t get_switch_status()
 {
+    return switches_active;
+}
 
-    uint8_t res = 0;
-    uint8_t port_in = PORTA.IN;
 
-    res |= (port_in & PIN4_bm) ? 0 : SWITCHES_R1_A; // R1_A
-    res |= (port_in & PIN5_bm) ? 0 : SWITCHES_R1_B; // R1_B
-    res |= (port_in & PIN6_bm) ? 0 : SWITCHES_R2_A; // R2_A
-    res |= (port_in & PIN7_bm) ? 0 : SWITCHES_R2_B; // R2_B
+// Sets which switches are active high, which stop their stepper and the
+// filter time in microseconds, see SWITCHES_FILTER_DEFAULT.
+bool switches_set_config(uint8_t invert, uint8_t enable, uint16_t filter)
+{
+    bool res = !(invert & ~SWITCHES_GC) && !(enable & ~SWITCHES_GC);
+    uint8_t i;
+
+    if (filter && (filter < SWITCHES_FILTER_MIN || filter > SWITCHES_FILTER_MAX)) {
+        res = false;
+    }
+
+    if (res) {
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+            switches_invert = invert;
+            switches_enable = enable;
+            switches_filter = filter;
+            // A sample every filter / SWITCHES_SAMPLES us, in 4 MHz ticks.
+            TCC5.CTRLA = TC45_CLKSEL_OFF_gc;
+            TCC5.PER = filter ? (filter << 2) / SWITCHES_SAMPLES - 1 : 0;
+            for (i = 0; i < 4; i++) {
+                switches_count[i] = 0;
+            }
+            switches_update(switches_level(PORTA.IN));
+        }
+    }
 
     return res;
 }
 
 
+bool switches_get_config(uint8_t *invert, uint8_t *enable, uint16_t *filter)
+{
+    *invert = switches_invert;
+    *enable = switches_enable;
+    *filter = switches_filter;
+
+    return true;
+}
+
+
 void switches_init()
 {
     // Set relay pins as inputs.
@@ -56,10 +188,20 @@ void switches_init()
     PORTA.DIRCLR = PIN6_bm; // R2_A
     PORTA.DIRCLR = PIN7_bm; // R2_B
 
-    // Pullup pins internally.
-    PORTA.PIN4CTRL |= PORT_OPC_PULLUP_gc;
-    PORTA.PIN5CTRL |= PORT_OPC_PULLUP_gc;
-    PORTA.PIN6CTRL |= PORT_OPC_PULLUP_gc;
-    PORTA.PIN7CTRL |= PORT_OPC_PULLUP_gc;
+    // Pullup pins internally, either edge raises the pin change interrupt.
+    PORTA.PIN4CTRL = PORT_OPC_PULLUP_gc | PORT_ISC_BOTHEDGES_gc;
+    PORTA.PIN5CTRL = PORT_OPC_PULLUP_gc | PORT_ISC_BOTHEDGES_gc;
+    PORTA.PIN6CTRL = PORT_OPC_PULLUP_gc | PORT_ISC_BOTHEDGES_gc;
+    PORTA.PIN7CTRL = PORT_OPC_PULLUP_gc | PORT_ISC_BOTHEDGES_gc;
+
+    // TCC5 samples for the filter, it only runs while a change settles.
+    TCC5.CTRLA = TC45_CLKSEL_OFF_gc;
+    TCC5.INTCTRLA = TC45_OVFINTLVL_LO_gc;
+
+    // Changes from here on raise the interrupt, so the state taken by
+    // switches_set_config() can't go stale.
+    PORTA.INTMASK = PIN4_bm | PIN5_bm | PIN6_bm | PIN7_bm;
+    PORTA.INTFLAGS = PIN4_bm | PIN5_bm | PIN6_bm | PIN7_bm;
+    switches_set_config(0, SWITCHES_GC, SWITCHES_FILTER_DEFAULT);
+    PORTA.INTCTRL = PORT_INTLVL_LO_gc;
 }
-
@@ -25,6 +25,7 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 
 #include <avr/io.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 
 #define SWITCHES_R1_A 1
@@ -33,11 +34,46 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #define SWITCHES_R2_B 8
 #define SWITCHES_GC 0xf
 
+// Switches that stop each stepper.
+#define SWITCHES_R1 (SWITCHES_R1_A | SWITCHES_R1_B)
+#define SWITCHES_R2 (SWITCHES_R2_A | SWITCHES_R2_B)
+
+// Steppers a switch currently blocks, see switches_update().
+#define SWITCHES_BLOCKED_1 1
+#define SWITCHES_BLOCKED_2 2
+
+// Filter time in us. From the first edge of a change TCC5 samples the pin
+// SWITCHES_SAMPLES times per filter time, the change counts once the new
+// level was read that many more times than the old one. A clean edge counts
+// one filter time after it, a spike shorter than a sample is dropped. The
+// sampling interrupt takes a few hundred cycles, the minimum keeps a sample
+// at 400 cycles or more.
+#define SWITCHES_FILTER_DEFAULT 100
+#define SWITCHES_FILTER_MIN 50
+#define SWITCHES_FILTER_MAX 16000
+#define SWITCHES_SAMPLES 4
+
+// Only touched through the inline checks outside of switches.c.
+extern volatile uint8_t switches_blocked;
+
+
+// Inline, the stepper ISR checks these before every step. They only read the
+// debounced state the pin change interrupt keeps up to date.
+static inline bool switch_r1a_or_r1b_triggered()
+{
+    return switches_blocked & SWITCHES_BLOCKED_1;
+}
+
+
+static inline bool switch_r2a_or_r2b_triggered()
+{
+    return switches_blocked & SWITCHES_BLOCKED_2;
+}
 
-inline bool switch_r1a_or_r1b_triggered();
-inline bool switch_r2a_or_r2b_triggered();
 
 uint8_t get_switch_status();
+bool switches_set_config(uint8_t invert, uint8_t enable, uint16_t filter);
+bool switches_get_config(uint8_t *invert, uint8_t *enable, uint16_t *filter);
 
 void switches_init();
 
@@ -0,0 +1,137 @@
+/*
+trace.c - Records step edges for timing analysis.
+Copyright (C) 2013 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This file is part of the TwoStep firmware.
+
+Lasershark is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Lasershark is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "trace.h"
+#include "perf.h"
+#include <avr/interrupt.h>
+#include <util/atomic.h>
+
+
+volatile bool trace_on;
+static volatile uint8_t trace_head;
+static volatile uint8_t trace_count;
+static volatile uint16_t trace_dropped;
+static volatile uint16_t trace_wraps; // Step timer wraps not yet in the buffer
+static struct trace_entry trace_buf[TRACE_BUF_LEN];
+
+
+// Only enabled while recording. Counts the wraps of the step timer, the next
+// trace_record() puts them in a TRACE_WRAP entry.
+ISR(TCC4_OVF_vect)
+{
+#ifdef PERF_ISR_BUSY
+    uint16_t start = perf_start();
+#endif
+    // Clear interrupt flag
+    TCC4.INTFLAGS = TC4_OVFIF_bm;
+
+    if (trace_wraps != UINT16_MAX) {
+        trace_wraps++;
+    }
+#ifdef PERF_ISR_BUSY
+    perf_isr_busy(start);
+#endif
+}
+
+
+static bool trace_put(uint16_t time, uint8_t event)
+{
+    uint8_t head;
+
+    if (trace_count < TRACE_BUF_LEN) {
+        head = trace_head;
+        trace_buf[head].time = time;
+        trace_buf[head].event = event;
+        trace_head = (head + 1) & TRACE_BUF_MASK;
+        trace_count++;
+        return true;
+    }
+    if (trace_dropped != UINT16_MAX) {
+        trace_dropped++;
+    }
+    return false;
+}
+
+
+// Records an event from an interrupt while tracing. When the buffer is full
+// the event is only counted as dropped, so what is recorded has no gaps. The
+// step timer stands still while it is stopped, so do the times.
+void trace_add(uint8_t event)
+{
+    uint16_t time = TCC4.CNT;
+
+    if (TCC4.INTFLAGS & TC4_OVFIF_bm) {
+        // Wrapped before the overflow interrupt could count it, read again
+        // so the time is after the wrap.
+        time = TCC4.CNT;
+        TCC4.INTFLAGS = TC4_OVFIF_bm;
+        if (trace_wraps != UINT16_MAX) {
+            trace_wraps++;
+        }
+    }
+    if (trace_wraps && trace_put(trace_wraps, TRACE_WRAP)) {
+        trace_wraps = 0;
+    }
+    trace_put(time, event);
+}
+
+
+// Starts recording into an empty buffer, or stops recording. What was
+// recorded stays readable after it stopped.
+bool trace_set_enable(uint8_t enable)
+{
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (enable) {
+            trace_head = 0;
+            trace_count = 0;
+            trace_dropped = 0;
+            trace_wraps = 0;
+            TCC4.INTFLAGS = TC4_OVFIF_bm;
+            TCC4.INTCTRLA = TC45_OVFINTLVL_LO_gc;
+        } else {
+            TCC4.INTCTRLA = TC45_OVFINTLVL_OFF_gc;
+        }
+        trace_on = enable ? true : false;
+    }
+
+    return true;
+}
+
+
+// Takes up to TRACE_READ_LEN of the oldest entries out of the buffer, n is
+// how many. Dropped counts the events lost to a full buffer since recording
+// started.
+bool trace_read(uint8_t *n, uint16_t *dropped, struct trace_entry *entries)
+{
+    uint8_t tail;
+    uint8_t i;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        *n = (trace_count < TRACE_READ_LEN) ? trace_count : TRACE_READ_LEN;
+        tail = (trace_head - trace_count) & TRACE_BUF_MASK;
+        for (i = 0; i < *n; i++) {
+            entries[i] = trace_buf[(tail + i) & TRACE_BUF_MASK];
+        }
+        trace_count -= *n;
+        *dropped = trace_dropped;
+    }
+
+    return true;
+}
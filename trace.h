@@ -0,0 +1,72 @@
+/*
+trace.h - Records step edges for timing analysis.
+Copyright (C) 2013 Jeffrey Nelson <nelsonjm@macpod.net>
+
+This file is part of the TwoStep firmware.
+
+Lasershark is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 2 of the License, or
+(at your option) any later version.
+
+Lasershark is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+// Entries of the trace buffer, a power of two. Each takes 3 bytes of SRAM.
+// With 32, the static data and the deepest call chain of the main loop with
+// the deepest interrupt on top of it leave about 200 of the 2048 bytes spare.
+// Don't grow it without shrinking something else.
+#define TRACE_BUF_LEN 32
+#define TRACE_BUF_MASK (TRACE_BUF_LEN - 1)
+
+// Events, or'ed with the stepper index.
+#define TRACE_STEP 0x10
+#define TRACE_SWITCH 0x20
+// Comes before the next event when the step timer wrapped since the last
+// one, the time is how many times it wrapped.
+#define TRACE_WRAP 0x40
+
+// Entries returned by one trace_read().
+#define TRACE_READ_LEN 6
+
+struct trace_entry {
+    uint16_t time; // Step timer count, 4 MHz and wraps every 16.4 ms
+    uint8_t event;
+};
+
+// Only touched through trace_record() outside of trace.c.
+extern volatile bool trace_on;
+
+
+void trace_add(uint8_t event);
+
+
+// Called from the stepper interrupts to record an event, see trace_add().
+// Only the check is inline, so it costs little while nothing is recorded.
+static inline void trace_record(uint8_t event)
+{
+    if (trace_on) {
+        trace_add(event);
+    }
+}
+
+bool trace_set_enable(uint8_t enable);
+bool trace_read(uint8_t *n, uint16_t *dropped, struct trace_entry *entries);
+
+
+#endif
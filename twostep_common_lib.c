@@ -76,12 +76,165 @@ uint8_t twostep_cmd_len(uint8_t cmd)
     case TWOSTEP_GET_100US_DELAY:
         res = TWOSTEP_GET_100US_DELAY_CMD_LEN;
         break;
+    case TWOSTEP_SET_ACCEL:
+        res = TWOSTEP_SET_ACCEL_CMD_LEN;
+        break;
+    case TWOSTEP_GET_ACCEL:
+        res = TWOSTEP_GET_ACCEL_CMD_LEN;
+        break;
+    case TWOSTEP_SET_MAX_SPEED:
+        res = TWOSTEP_SET_MAX_SPEED_CMD_LEN;
+        break;
+    case TWOSTEP_GET_MAX_SPEED:
+        res = TWOSTEP_GET_MAX_SPEED_CMD_LEN;
+        break;
+    case TWOSTEP_SET_PROFILE:
+        res = TWOSTEP_SET_PROFILE_CMD_LEN;
+        break;
+    case TWOSTEP_GET_PROFILE:
+        res = TWOSTEP_GET_PROFILE_CMD_LEN;
+        break;
+    case TWOSTEP_SET_JERK:
+        res = TWOSTEP_SET_JERK_CMD_LEN;
+        break;
+    case TWOSTEP_GET_JERK:
+        res = TWOSTEP_GET_JERK_CMD_LEN;
+        break;
+    case TWOSTEP_MOVE_LINEAR:
+        res = TWOSTEP_MOVE_LINEAR_CMD_LEN;
+        break;
+    case TWOSTEP_ENQUEUE_MOVE:
+        res = TWOSTEP_ENQUEUE_MOVE_CMD_LEN;
+        break;
+    case TWOSTEP_GET_QUEUE_DEPTH:
+        res = TWOSTEP_GET_QUEUE_DEPTH_CMD_LEN;
+        break;
+    case TWOSTEP_FLUSH_QUEUE:
+        res = TWOSTEP_FLUSH_QUEUE_CMD_LEN;
+        break;
+    case TWOSTEP_SET_RATE:
+        res = TWOSTEP_SET_RATE_CMD_LEN;
+        break;
+    case TWOSTEP_GET_RATE:
+        res = TWOSTEP_GET_RATE_CMD_LEN;
+        break;
+    case TWOSTEP_SET_POSITION:
+        res = TWOSTEP_SET_POSITION_CMD_LEN;
+        break;
+    case TWOSTEP_GET_POSITION:
+        res = TWOSTEP_GET_POSITION_CMD_LEN;
+        break;
     case TWOSTEP_GET_SWITCH_STATUS:
         res = TWOSTEP_GET_SWITCH_STATUS_CMD_LEN;
         break;
     case TWOSTEP_GET_VERSION:
         res = TWOSTEP_GET_VERSION_CMD_LEN;
         break;
+    case TWOSTEP_MOVE_TO:
+        res = TWOSTEP_MOVE_TO_CMD_LEN;
+        break;
+    case TWOSTEP_MOVE_ARC:
+        res = TWOSTEP_MOVE_ARC_CMD_LEN;
+        break;
+    case TWOSTEP_PLAN_LINE:
+        res = TWOSTEP_PLAN_LINE_CMD_LEN;
+        break;
+    case TWOSTEP_GET_PLANNER_FREE:
+        res = TWOSTEP_GET_PLANNER_FREE_CMD_LEN;
+        break;
+    case TWOSTEP_SET_HOME_CONFIG:
+        res = TWOSTEP_SET_HOME_CONFIG_CMD_LEN;
+        break;
+    case TWOSTEP_GET_HOME_CONFIG:
+        res = TWOSTEP_GET_HOME_CONFIG_CMD_LEN;
+        break;
+    case TWOSTEP_HOME:
+        res = TWOSTEP_HOME_CMD_LEN;
+        break;
+    case TWOSTEP_GET_HOME_STATUS:
+        res = TWOSTEP_GET_HOME_STATUS_CMD_LEN;
+        break;
+    case TWOSTEP_SET_TARGET_VELOCITY:
+        res = TWOSTEP_SET_TARGET_VELOCITY_CMD_LEN;
+        break;
+    case TWOSTEP_GET_VELOCITY:
+        res = TWOSTEP_GET_VELOCITY_CMD_LEN;
+        break;
+    case TWOSTEP_SET_CURRENT_LEVELS:
+        res = TWOSTEP_SET_CURRENT_LEVELS_CMD_LEN;
+        break;
+    case TWOSTEP_GET_CURRENT_LEVELS:
+        res = TWOSTEP_GET_CURRENT_LEVELS_CMD_LEN;
+        break;
+    case TWOSTEP_GET_PERF_STATS:
+        res = TWOSTEP_GET_PERF_STATS_CMD_LEN;
+        break;
+    case TWOSTEP_RESET_PERF_STATS:
+        res = TWOSTEP_RESET_PERF_STATS_CMD_LEN;
+        break;
+    case TWOSTEP_GET_PERF_LATENCY:
+        res = TWOSTEP_GET_PERF_LATENCY_CMD_LEN;
+        break;
+    case TWOSTEP_SET_AUTO_MICROSTEPS:
+        res = TWOSTEP_SET_AUTO_MICROSTEPS_CMD_LEN;
+        break;
+    case TWOSTEP_GET_AUTO_MICROSTEPS:
+        res = TWOSTEP_GET_AUTO_MICROSTEPS_CMD_LEN;
+        break;
+    case TWOSTEP_SET_BACKLASH:
+        res = TWOSTEP_SET_BACKLASH_CMD_LEN;
+        break;
+    case TWOSTEP_GET_BACKLASH:
+        res = TWOSTEP_GET_BACKLASH_CMD_LEN;
+        break;
+    case TWOSTEP_SET_SOFT_LIMITS:
+        res = TWOSTEP_SET_SOFT_LIMITS_CMD_LEN;
+        break;
+    case TWOSTEP_GET_SOFT_LIMITS:
+        res = TWOSTEP_GET_SOFT_LIMITS_CMD_LEN;
+        break;
+    case TWOSTEP_GET_STOP_REASON:
+        res = TWOSTEP_GET_STOP_REASON_CMD_LEN;
+        break;
+    case TWOSTEP_SET_TRACE:
+        res = TWOSTEP_SET_TRACE_CMD_LEN;
+        break;
+    case TWOSTEP_DUMP_TRACE:
+        res = TWOSTEP_DUMP_TRACE_CMD_LEN;
+        break;
+    case TWOSTEP_SET_ACCEL_PRESET:
+        res = TWOSTEP_SET_ACCEL_PRESET_CMD_LEN;
+        break;
+    case TWOSTEP_GET_ACCEL_PRESET:
+        res = TWOSTEP_GET_ACCEL_PRESET_CMD_LEN;
+        break;
+    case TWOSTEP_SET_GEARING:
+        res = TWOSTEP_SET_GEARING_CMD_LEN;
+        break;
+    case TWOSTEP_GET_GEARING:
+        res = TWOSTEP_GET_GEARING_CMD_LEN;
+        break;
+    case TWOSTEP_SET_GANTRY:
+        res = TWOSTEP_SET_GANTRY_CMD_LEN;
+        break;
+    case TWOSTEP_GET_GANTRY:
+        res = TWOSTEP_GET_GANTRY_CMD_LEN;
+        break;
+    case TWOSTEP_SET_PROBE_STEPS:
+        res = TWOSTEP_SET_PROBE_STEPS_CMD_LEN;
+        break;
+    case TWOSTEP_GET_PROBE_RESULT:
+        res = TWOSTEP_GET_PROBE_RESULT_CMD_LEN;
+        break;
+    case TWOSTEP_SET_SWITCH_CONFIG:
+        res = TWOSTEP_SET_SWITCH_CONFIG_CMD_LEN;
+        break;
+    case TWOSTEP_GET_SWITCH_CONFIG:
+        res = TWOSTEP_GET_SWITCH_CONFIG_CMD_LEN;
+        break;
+    case TWOSTEP_DUMP_TRACE_ALL:
+        res = TWOSTEP_DUMP_TRACE_ALL_CMD_LEN;
+        break;
     }
 
     return res;
@@ -140,12 +293,165 @@ uint8_t twostep_resp_len(uint8_t cmd)
     case TWOSTEP_GET_100US_DELAY:
         res = TWOSTEP_GET_100US_DELAY_RESP_LEN;
         break;
+    case TWOSTEP_SET_ACCEL:
+        res = TWOSTEP_SET_ACCEL_RESP_LEN;
+        break;
+    case TWOSTEP_GET_ACCEL:
+        res = TWOSTEP_GET_ACCEL_RESP_LEN;
+        break;
+    case TWOSTEP_SET_MAX_SPEED:
+        res = TWOSTEP_SET_MAX_SPEED_RESP_LEN;
+        break;
+    case TWOSTEP_GET_MAX_SPEED:
+        res = TWOSTEP_GET_MAX_SPEED_RESP_LEN;
+        break;
+    case TWOSTEP_SET_PROFILE:
+        res = TWOSTEP_SET_PROFILE_RESP_LEN;
+        break;
+    case TWOSTEP_GET_PROFILE:
+        res = TWOSTEP_GET_PROFILE_RESP_LEN;
+        break;
+    case TWOSTEP_SET_JERK:
+        res = TWOSTEP_SET_JERK_RESP_LEN;
+        break;
+    case TWOSTEP_GET_JERK:
+        res = TWOSTEP_GET_JERK_RESP_LEN;
+        break;
+    case TWOSTEP_MOVE_LINEAR:
+        res = TWOSTEP_MOVE_LINEAR_RESP_LEN;
+        break;
+    case TWOSTEP_ENQUEUE_MOVE:
+        res = TWOSTEP_ENQUEUE_MOVE_RESP_LEN;
+        break;
+    case TWOSTEP_GET_QUEUE_DEPTH:
+        res = TWOSTEP_GET_QUEUE_DEPTH_RESP_LEN;
+        break;
+    case TWOSTEP_FLUSH_QUEUE:
+        res = TWOSTEP_FLUSH_QUEUE_RESP_LEN;
+        break;
+    case TWOSTEP_SET_RATE:
+        res = TWOSTEP_SET_RATE_RESP_LEN;
+        break;
+    case TWOSTEP_GET_RATE:
+        res = TWOSTEP_GET_RATE_RESP_LEN;
+        break;
+    case TWOSTEP_SET_POSITION:
+        res = TWOSTEP_SET_POSITION_RESP_LEN;
+        break;
+    case TWOSTEP_GET_POSITION:
+        res = TWOSTEP_GET_POSITION_RESP_LEN;
+        break;
     case TWOSTEP_GET_SWITCH_STATUS:
         res = TWOSTEP_GET_SWITCH_STATUS_RESP_LEN;
         break;
     case TWOSTEP_GET_VERSION:
         res = TWOSTEP_GET_VERSION_RESP_LEN;
         break;
+    case TWOSTEP_MOVE_TO:
+        res = TWOSTEP_MOVE_TO_RESP_LEN;
+        break;
+    case TWOSTEP_MOVE_ARC:
+        res = TWOSTEP_MOVE_ARC_RESP_LEN;
+        break;
+    case TWOSTEP_PLAN_LINE:
+        res = TWOSTEP_PLAN_LINE_RESP_LEN;
+        break;
+    case TWOSTEP_GET_PLANNER_FREE:
+        res = TWOSTEP_GET_PLANNER_FREE_RESP_LEN;
+        break;
+    case TWOSTEP_SET_HOME_CONFIG:
+        res = TWOSTEP_SET_HOME_CONFIG_RESP_LEN;
+        break;
+    case TWOSTEP_GET_HOME_CONFIG:
+        res = TWOSTEP_GET_HOME_CONFIG_RESP_LEN;
+        break;
+    case TWOSTEP_HOME:
+        res = TWOSTEP_HOME_RESP_LEN;
+        break;
+    case TWOSTEP_GET_HOME_STATUS:
+        res = TWOSTEP_GET_HOME_STATUS_RESP_LEN;
+        break;
+    case TWOSTEP_SET_TARGET_VELOCITY:
+        res = TWOSTEP_SET_TARGET_VELOCITY_RESP_LEN;
+        break;
+    case TWOSTEP_GET_VELOCITY:
+        res = TWOSTEP_GET_VELOCITY_RESP_LEN;
+        break;
+    case TWOSTEP_SET_CURRENT_LEVELS:
+        res = TWOSTEP_SET_CURRENT_LEVELS_RESP_LEN;
+        break;
+    case TWOSTEP_GET_CURRENT_LEVELS:
+        res = TWOSTEP_GET_CURRENT_LEVELS_RESP_LEN;
+        break;
+    case TWOSTEP_GET_PERF_STATS:
+        res = TWOSTEP_GET_PERF_STATS_RESP_LEN;
+        break;
+    case TWOSTEP_RESET_PERF_STATS:
+        res = TWOSTEP_RESET_PERF_STATS_RESP_LEN;
+        break;
+    case TWOSTEP_GET_PERF_LATENCY:
+        res = TWOSTEP_GET_PERF_LATENCY_RESP_LEN;
+        break;
+    case TWOSTEP_SET_AUTO_MICROSTEPS:
+        res = TWOSTEP_SET_AUTO_MICROSTEPS_RESP_LEN;
+        break;
+    case TWOSTEP_GET_AUTO_MICROSTEPS:
+        res = TWOSTEP_GET_AUTO_MICROSTEPS_RESP_LEN;
+        break;
+    case TWOSTEP_SET_BACKLASH:
+        res = TWOSTEP_SET_BACKLASH_RESP_LEN;
+        break;
+    case TWOSTEP_GET_BACKLASH:
+        res = TWOSTEP_GET_BACKLASH_RESP_LEN;
+        break;
+    case TWOSTEP_SET_SOFT_LIMITS:
+        res = TWOSTEP_SET_SOFT_LIMITS_RESP_LEN;
+        break;
+    case TWOSTEP_GET_SOFT_LIMITS:
+        res = TWOSTEP_GET_SOFT_LIMITS_RESP_LEN;
+        break;
+    case TWOSTEP_GET_STOP_REASON:
+        res = TWOSTEP_GET_STOP_REASON_RESP_LEN;
+        break;
+    case TWOSTEP_SET_TRACE:
+        res = TWOSTEP_SET_TRACE_RESP_LEN;
+        break;
+    case TWOSTEP_DUMP_TRACE:
+        res = TWOSTEP_DUMP_TRACE_RESP_LEN;
+        break;
+    case TWOSTEP_SET_ACCEL_PRESET:
+        res = TWOSTEP_SET_ACCEL_PRESET_RESP_LEN;
+        break;
+    case TWOSTEP_GET_ACCEL_PRESET:
+        res = TWOSTEP_GET_ACCEL_PRESET_RESP_LEN;
+        break;
+    case TWOSTEP_SET_GEARING:
+        res = TWOSTEP_SET_GEARING_RESP_LEN;
+        break;
+    case TWOSTEP_GET_GEARING:
+        res = TWOSTEP_GET_GEARING_RESP_LEN;
+        break;
+    case TWOSTEP_SET_GANTRY:
+        res = TWOSTEP_SET_GANTRY_RESP_LEN;
+        break;
+    case TWOSTEP_GET_GANTRY:
+        res = TWOSTEP_GET_GANTRY_RESP_LEN;
+        break;
+    case TWOSTEP_SET_PROBE_STEPS:
+        res = TWOSTEP_SET_PROBE_STEPS_RESP_LEN;
+        break;
+    case TWOSTEP_GET_PROBE_RESULT:
+        res = TWOSTEP_GET_PROBE_RESULT_RESP_LEN;
+        break;
+    case TWOSTEP_SET_SWITCH_CONFIG:
+        res = TWOSTEP_SET_SWITCH_CONFIG_RESP_LEN;
+        break;
+    case TWOSTEP_GET_SWITCH_CONFIG:
+        res = TWOSTEP_GET_SWITCH_CONFIG_RESP_LEN;
+        break;
+    case TWOSTEP_DUMP_TRACE_ALL:
+        res = TWOSTEP_DUMP_TRACE_ALL_RESP_LEN;
+        break;
     }
 
     return res;
@@ -36,7 +36,7 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #define TWOSTEP_CMD_UNKNOWN 0xff
 
 
-#define TWOSTEP_BUF_SIZE 16
+#define TWOSTEP_BUF_SIZE 26
 
 
 #define TWOSTEP_START_TOKEN '='
@@ -108,6 +108,70 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #define TWOSTEP_GET_100US_DELAY_CMD_LEN 5
 #define TWOSTEP_GET_100US_DELAY_RESP_LEN 7
 
+#define TWOSTEP_SET_ACCEL 0x20
+#define TWOSTEP_SET_ACCEL_CMD_LEN 9
+#define TWOSTEP_SET_ACCEL_RESP_LEN 5
+
+#define TWOSTEP_GET_ACCEL 0x21
+#define TWOSTEP_GET_ACCEL_CMD_LEN 5
+#define TWOSTEP_GET_ACCEL_RESP_LEN 9
+
+#define TWOSTEP_SET_MAX_SPEED 0x22
+#define TWOSTEP_SET_MAX_SPEED_CMD_LEN 7
+#define TWOSTEP_SET_MAX_SPEED_RESP_LEN 5
+
+#define TWOSTEP_GET_MAX_SPEED 0x23
+#define TWOSTEP_GET_MAX_SPEED_CMD_LEN 5
+#define TWOSTEP_GET_MAX_SPEED_RESP_LEN 7
+
+#define TWOSTEP_SET_PROFILE 0x24
+#define TWOSTEP_SET_PROFILE_CMD_LEN 6
+#define TWOSTEP_SET_PROFILE_RESP_LEN 5
+
+#define TWOSTEP_GET_PROFILE 0x25
+#define TWOSTEP_GET_PROFILE_CMD_LEN 5
+#define TWOSTEP_GET_PROFILE_RESP_LEN 6
+
+#define TWOSTEP_SET_JERK 0x26
+#define TWOSTEP_SET_JERK_CMD_LEN 9
+#define TWOSTEP_SET_JERK_RESP_LEN 5
+
+#define TWOSTEP_GET_JERK 0x27
+#define TWOSTEP_GET_JERK_CMD_LEN 5
+#define TWOSTEP_GET_JERK_RESP_LEN 9
+
+#define TWOSTEP_MOVE_LINEAR 0x28
+#define TWOSTEP_MOVE_LINEAR_CMD_LEN 14
+#define TWOSTEP_MOVE_LINEAR_RESP_LEN 5
+
+#define TWOSTEP_ENQUEUE_MOVE 0x29
+#define TWOSTEP_ENQUEUE_MOVE_CMD_LEN 13
+#define TWOSTEP_ENQUEUE_MOVE_RESP_LEN 5
+
+#define TWOSTEP_GET_QUEUE_DEPTH 0x2a
+#define TWOSTEP_GET_QUEUE_DEPTH_CMD_LEN 5
+#define TWOSTEP_GET_QUEUE_DEPTH_RESP_LEN 6
+
+#define TWOSTEP_FLUSH_QUEUE 0x2b
+#define TWOSTEP_FLUSH_QUEUE_CMD_LEN 5
+#define TWOSTEP_FLUSH_QUEUE_RESP_LEN 5
+
+#define TWOSTEP_SET_RATE 0x2c
+#define TWOSTEP_SET_RATE_CMD_LEN 9
+#define TWOSTEP_SET_RATE_RESP_LEN 5
+
+#define TWOSTEP_GET_RATE 0x2d
+#define TWOSTEP_GET_RATE_CMD_LEN 5
+#define TWOSTEP_GET_RATE_RESP_LEN 9
+
+#define TWOSTEP_SET_POSITION 0x2e
+#define TWOSTEP_SET_POSITION_CMD_LEN 9
+#define TWOSTEP_SET_POSITION_RESP_LEN 5
+
+#define TWOSTEP_GET_POSITION 0x2f
+#define TWOSTEP_GET_POSITION_CMD_LEN 5
+#define TWOSTEP_GET_POSITION_RESP_LEN 9
+
 #define TWOSTEP_GET_SWITCH_STATUS 0x30
 #define TWOSTEP_GET_SWITCH_STATUS_CMD_LEN 4
 #define TWOSTEP_GET_SWITCH_STATUS_RESP_LEN 6
@@ -116,6 +180,146 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #define TWOSTEP_GET_VERSION_CMD_LEN 4
 #define TWOSTEP_GET_VERSION_RESP_LEN 6
 
+#define TWOSTEP_MOVE_TO 0x50
+#define TWOSTEP_MOVE_TO_CMD_LEN 9
+#define TWOSTEP_MOVE_TO_RESP_LEN 5
+
+#define TWOSTEP_MOVE_ARC 0x51
+#define TWOSTEP_MOVE_ARC_CMD_LEN 15
+#define TWOSTEP_MOVE_ARC_RESP_LEN 5
+
+#define TWOSTEP_PLAN_LINE 0x52
+#define TWOSTEP_PLAN_LINE_CMD_LEN 14
+#define TWOSTEP_PLAN_LINE_RESP_LEN 5
+
+#define TWOSTEP_GET_PLANNER_FREE 0x53
+#define TWOSTEP_GET_PLANNER_FREE_CMD_LEN 4
+#define TWOSTEP_GET_PLANNER_FREE_RESP_LEN 6
+
+#define TWOSTEP_SET_HOME_CONFIG 0x54
+#define TWOSTEP_SET_HOME_CONFIG_CMD_LEN 14
+#define TWOSTEP_SET_HOME_CONFIG_RESP_LEN 5
+
+#define TWOSTEP_GET_HOME_CONFIG 0x55
+#define TWOSTEP_GET_HOME_CONFIG_CMD_LEN 5
+#define TWOSTEP_GET_HOME_CONFIG_RESP_LEN 14
+
+#define TWOSTEP_HOME 0x56
+#define TWOSTEP_HOME_CMD_LEN 5
+#define TWOSTEP_HOME_RESP_LEN 5
+
+#define TWOSTEP_GET_HOME_STATUS 0x57
+#define TWOSTEP_GET_HOME_STATUS_CMD_LEN 5
+#define TWOSTEP_GET_HOME_STATUS_RESP_LEN 10
+
+#define TWOSTEP_SET_TARGET_VELOCITY 0x58
+#define TWOSTEP_SET_TARGET_VELOCITY_CMD_LEN 9
+#define TWOSTEP_SET_TARGET_VELOCITY_RESP_LEN 5
+
+#define TWOSTEP_GET_VELOCITY 0x59
+#define TWOSTEP_GET_VELOCITY_CMD_LEN 5
+#define TWOSTEP_GET_VELOCITY_RESP_LEN 9
+
+#define TWOSTEP_SET_CURRENT_LEVELS 0x5a
+#define TWOSTEP_SET_CURRENT_LEVELS_CMD_LEN 11
+#define TWOSTEP_SET_CURRENT_LEVELS_RESP_LEN 5
+
+#define TWOSTEP_GET_CURRENT_LEVELS 0x5b
+#define TWOSTEP_GET_CURRENT_LEVELS_CMD_LEN 5
+#define TWOSTEP_GET_CURRENT_LEVELS_RESP_LEN 11
+
+#define TWOSTEP_GET_PERF_STATS 0x5c
+#define TWOSTEP_GET_PERF_STATS_CMD_LEN 4
+#define TWOSTEP_GET_PERF_STATS_RESP_LEN 16
+
+#define TWOSTEP_RESET_PERF_STATS 0x5d
+#define TWOSTEP_RESET_PERF_STATS_CMD_LEN 4
+#define TWOSTEP_RESET_PERF_STATS_RESP_LEN 5
+
+#define TWOSTEP_GET_PERF_LATENCY 0x5e
+#define TWOSTEP_GET_PERF_LATENCY_CMD_LEN 4
+#define TWOSTEP_GET_PERF_LATENCY_RESP_LEN 9
+
+#define TWOSTEP_SET_AUTO_MICROSTEPS 0x5f
+#define TWOSTEP_SET_AUTO_MICROSTEPS_CMD_LEN 7
+#define TWOSTEP_SET_AUTO_MICROSTEPS_RESP_LEN 5
+
+#define TWOSTEP_GET_AUTO_MICROSTEPS 0x60
+#define TWOSTEP_GET_AUTO_MICROSTEPS_CMD_LEN 5
+#define TWOSTEP_GET_AUTO_MICROSTEPS_RESP_LEN 7
+
+#define TWOSTEP_SET_BACKLASH 0x61
+#define TWOSTEP_SET_BACKLASH_CMD_LEN 9
+#define TWOSTEP_SET_BACKLASH_RESP_LEN 5
+
+#define TWOSTEP_GET_BACKLASH 0x62
+#define TWOSTEP_GET_BACKLASH_CMD_LEN 5
+#define TWOSTEP_GET_BACKLASH_RESP_LEN 9
+
+#define TWOSTEP_SET_SOFT_LIMITS 0x63
+#define TWOSTEP_SET_SOFT_LIMITS_CMD_LEN 14
+#define TWOSTEP_SET_SOFT_LIMITS_RESP_LEN 5
+
+#define TWOSTEP_GET_SOFT_LIMITS 0x64
+#define TWOSTEP_GET_SOFT_LIMITS_CMD_LEN 5
+#define TWOSTEP_GET_SOFT_LIMITS_RESP_LEN 14
+
+#define TWOSTEP_GET_STOP_REASON 0x65
+#define TWOSTEP_GET_STOP_REASON_CMD_LEN 5
+#define TWOSTEP_GET_STOP_REASON_RESP_LEN 6
+
+#define TWOSTEP_SET_TRACE 0x66
+#define TWOSTEP_SET_TRACE_CMD_LEN 5
+#define TWOSTEP_SET_TRACE_RESP_LEN 5
+
+#define TWOSTEP_DUMP_TRACE 0x67
+#define TWOSTEP_DUMP_TRACE_CMD_LEN 4
+#define TWOSTEP_DUMP_TRACE_RESP_LEN 26
+
+#define TWOSTEP_SET_ACCEL_PRESET 0x68
+#define TWOSTEP_SET_ACCEL_PRESET_CMD_LEN 6
+#define TWOSTEP_SET_ACCEL_PRESET_RESP_LEN 5
+
+#define TWOSTEP_GET_ACCEL_PRESET 0x69
+#define TWOSTEP_GET_ACCEL_PRESET_CMD_LEN 5
+#define TWOSTEP_GET_ACCEL_PRESET_RESP_LEN 6
+
+#define TWOSTEP_SET_GEARING 0x6a
+#define TWOSTEP_SET_GEARING_CMD_LEN 9
+#define TWOSTEP_SET_GEARING_RESP_LEN 5
+
+#define TWOSTEP_GET_GEARING 0x6b
+#define TWOSTEP_GET_GEARING_CMD_LEN 4
+#define TWOSTEP_GET_GEARING_RESP_LEN 10
+
+#define TWOSTEP_SET_GANTRY 0x6c
+#define TWOSTEP_SET_GANTRY_CMD_LEN 6
+#define TWOSTEP_SET_GANTRY_RESP_LEN 5
+
+#define TWOSTEP_GET_GANTRY 0x6d
+#define TWOSTEP_GET_GANTRY_CMD_LEN 4
+#define TWOSTEP_GET_GANTRY_RESP_LEN 8
+
+#define TWOSTEP_SET_PROBE_STEPS 0x6e
+#define TWOSTEP_SET_PROBE_STEPS_CMD_LEN 10
+#define TWOSTEP_SET_PROBE_STEPS_RESP_LEN 5
+
+#define TWOSTEP_GET_PROBE_RESULT 0x6f
+#define TWOSTEP_GET_PROBE_RESULT_CMD_LEN 5
+#define TWOSTEP_GET_PROBE_RESULT_RESP_LEN 12
+
+#define TWOSTEP_SET_SWITCH_CONFIG 0x70
+#define TWOSTEP_SET_SWITCH_CONFIG_CMD_LEN 8
+#define TWOSTEP_SET_SWITCH_CONFIG_RESP_LEN 5
+
+#define TWOSTEP_GET_SWITCH_CONFIG 0x71
+#define TWOSTEP_GET_SWITCH_CONFIG_CMD_LEN 4
+#define TWOSTEP_GET_SWITCH_CONFIG_RESP_LEN 9
+
+#define TWOSTEP_DUMP_TRACE_ALL 0x72
+#define TWOSTEP_DUMP_TRACE_ALL_CMD_LEN 4
+#define TWOSTEP_DUMP_TRACE_ALL_RESP_LEN 26
+
 #define TWOSTEP_MIN_CMD_LEN 4
 #define TWOSTEP_MIN_RESP_LEN 5
 #define TWOSTEP_BAD_CMD_LEN 0
@@ -150,12 +354,74 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #define TWOSTEP_STEP_100US_DELAY_MIN 1
 #define TWOSTEP_STEP_100US_DELAY_MAX (USHRT_MAX)
 
+#define TWOSTEP_RATE_MIN 0x2800UL
+#define TWOSTEP_RATE_MAX (2850UL << 16)
+
+#define TWOSTEP_ACCEL_DISABLED 0
+#define TWOSTEP_MAX_ACCEL_VAL (USHRT_MAX)
+
+#define TWOSTEP_MAX_SPEED_DEFAULT 1000
+#define TWOSTEP_MAX_SPEED_MIN 1
+#define TWOSTEP_MAX_SPEED_MAX (USHRT_MAX)
+
+#define TWOSTEP_PROFILE_TRAPEZOIDAL 0x00
+#define TWOSTEP_PROFILE_SCURVE 0x01
+
+#define TWOSTEP_JERK_DEFAULT 100000UL
+#define TWOSTEP_MIN_JERK_VAL 1UL
+#define TWOSTEP_MAX_JERK_VAL 50000000UL
+
+#define TWOSTEP_ARC_CW 0x00
+#define TWOSTEP_ARC_CCW 0x01
+
+#define TWOSTEP_MODE_STEPS 0x00
+#define TWOSTEP_MODE_SAFE_STEPS 0x01
+#define TWOSTEP_MODE_UNTIL_SWITCH 0x02
+#define TWOSTEP_MODE_PROBE 0x03
+#define TWOSTEP_MODE_PROBE_CONTINUE 0x04
+
+#define TWOSTEP_JOG_SPEED_MAX 2850L
+
+#define TWOSTEP_HOME_IDLE 0x00
+#define TWOSTEP_HOME_SEEK 0x01
+#define TWOSTEP_HOME_BACKOFF 0x02
+#define TWOSTEP_HOME_RESEEK 0x03
+#define TWOSTEP_HOME_DONE 0x04
+#define TWOSTEP_HOME_FAILED 0x05
+
+#define TWOSTEP_STOP_NONE 0x00
+#define TWOSTEP_STOP_COMMAND 0x01
+#define TWOSTEP_STOP_SWITCH 0x02
+#define TWOSTEP_STOP_LIMIT_MIN 0x03
+#define TWOSTEP_STOP_LIMIT_MAX 0x04
+
+#define TWOSTEP_PROBE_IDLE 0x00
+#define TWOSTEP_PROBE_ARMED 0x01
+#define TWOSTEP_PROBE_TRIPPED 0x02
+
+#define TWOSTEP_QUEUE_LEN 2
+#define TWOSTEP_PLANNER_LEN 6
+#define TWOSTEP_TRACE_READ_LEN 6
+
+#define TWOSTEP_TRACE_STEP 0x10
+#define TWOSTEP_TRACE_SWITCH 0x20
+#define TWOSTEP_TRACE_WRAP 0x40
+// Set in the entry count of DUMP_TRACE_ALL frames that more follow.
+#define TWOSTEP_TRACE_MORE 0x80
+
+#define TWOSTEP_ACCEL_PRESET_NONE 0x00
+#define TWOSTEP_ACCEL_PRESET_NUM 8
+
 #define TWOSTEP_SWITCHS_R1_A 1
 #define TWOSTEP_SWITCHS_R1_B 2
 #define TWOSTEP_SWITCHS_R2_A 4
 #define TWOSTEP_SWITCHS_R2_B 8
 #define TWOSTEP_SWITCHS_GC 0xf
 
+#define TWOSTEP_SWITCH_FILTER_DEFAULT 100
+#define TWOSTEP_SWITCH_FILTER_MIN 50
+#define TWOSTEP_SWITCH_FILTER_MAX 16000
+
 
 uint8_t twostep_cmd_len(uint8_t cmd);
 uint8_t twostep_resp_len(uint8_t cmd);
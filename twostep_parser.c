@@ -22,12 +22,21 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #include "twostep_parser.h"
 #include "uart.h"
 #include "led.h"
+#include "perf.h"
+#include "planner.h"
 #include "stepper.h"
 #include "switches.h"
+#include "trace.h"
 #include "twostep_common_lib.h"
 #include <string.h>
 
 
+// The frame received so far, see twostep_parser_parse().
+static uint8_t twostep_parser_buf[TWOSTEP_BUF_SIZE];
+static uint8_t twostep_parser_pos;
+static uint8_t twostep_parser_len;
+
+
 void twostep_parser_send_resp(uint8_t *buf, uint8_t len)
 {
     uint8_t i;
@@ -52,6 +61,21 @@ void twostep_parser_set_param(uint8_t **dest, const void *src, uint8_t len)
 }
 
 
+// Fills in a DUMP_TRACE or DUMP_TRACE_ALL response, count is the entry
+// count field and n how many entries there are.
+static void twostep_parser_set_trace(uint8_t **dest, uint8_t count, uint16_t dropped, uint8_t n, const struct trace_entry *entries)
+{
+    uint8_t i;
+
+    twostep_parser_set_param(dest, &count, sizeof(uint8_t)); // Entry count
+    twostep_parser_set_param(dest, &dropped, sizeof(uint16_t)); // Dropped entries
+    for (i = 0; i < n; i++) {
+        twostep_parser_set_param(dest, &entries[i].time, sizeof(uint16_t)); // Timestamp
+        twostep_parser_set_param(dest, &entries[i].event, sizeof(uint8_t)); // Event
+    }
+}
+
+
 // It is assumed that the format of the cmd is at least right at this point.
 static bool twostep_parser_handle_cmd(uint8_t *cmd_buf, uint8_t len)
 {
@@ -61,8 +85,19 @@ static bool twostep_parser_handle_cmd(uint8_t *cmd_buf, uint8_t len)
     uint8_t stepper_num = 0;
     uint8_t stepper_bitfield = 0;
     uint8_t uint8_param1 = 0;
+    uint8_t uint8_param2 = 0;
+    uint8_t uint8_param3 = 0;
     uint16_t uint16_param1 = 0;
+    uint16_t uint16_param2 = 0;
+    uint16_t uint16_param3 = 0;
     uint32_t uint32_param1 = 0;
+    int16_t int16_param1 = 0;
+    int16_t int16_param2 = 0;
+    int16_t int16_param3 = 0;
+    int16_t int16_param4 = 0;
+    int32_t int32_param1 = 0;
+    int32_t int32_param2 = 0;
+    struct trace_entry trace_entries[TRACE_READ_LEN];
 
     uint8_t resp_buf[TWOSTEP_BUF_SIZE];
     uint8_t *resp_pos = resp_buf + 3;
@@ -167,6 +202,105 @@ static bool twostep_parser_handle_cmd(uint8_t *cmd_buf, uint8_t len)
             twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Delay val
         }
         break;
+    case TWOSTEP_SET_RATE:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint32_param1, sizeof(uint32_t)); // Rate
+        res = stepper_set_rate(stepper_num, uint32_param1);
+        break;
+    case TWOSTEP_GET_RATE:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_rate(stepper_num, &uint32_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint32_param1, sizeof(uint32_t)); // Rate
+        }
+        break;
+    case TWOSTEP_SET_ACCEL:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Accel val
+        twostep_parser_get_param(&cmd_pos, &uint16_param2, sizeof(uint16_t)); // Decel val
+        res = stepper_set_accel(stepper_num, uint16_param1, uint16_param2);
+        break;
+    case TWOSTEP_GET_ACCEL:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_accel(stepper_num, &uint16_param1, &uint16_param2);
+        if(res) {
+            twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Accel val
+            twostep_parser_set_param(&resp_pos, &uint16_param2, sizeof(uint16_t)); // Decel val
+        }
+        break;
+    case TWOSTEP_SET_MAX_SPEED:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Max speed val
+        res = stepper_set_max_speed(stepper_num, uint16_param1);
+        break;
+    case TWOSTEP_GET_MAX_SPEED:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_max_speed(stepper_num, &uint16_param1);
+        if(res) {
+            twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Max speed val
+        }
+        break;
+    case TWOSTEP_SET_PROFILE:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Profile
+        res = stepper_set_profile(stepper_num, uint8_param1);
+        break;
+    case TWOSTEP_GET_PROFILE:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_profile(stepper_num, &uint8_param1);
+        if(res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Profile
+        }
+        break;
+    case TWOSTEP_SET_JERK:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint32_param1, sizeof(uint32_t)); // Jerk val
+        res = stepper_set_jerk(stepper_num, uint32_param1);
+        break;
+    case TWOSTEP_GET_JERK:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_jerk(stepper_num, &uint32_param1);
+        if(res) {
+            twostep_parser_set_param(&resp_pos, &uint32_param1, sizeof(uint32_t)); // Jerk val
+        }
+        break;
+    case TWOSTEP_MOVE_LINEAR:
+        twostep_parser_get_param(&cmd_pos, &int32_param1, sizeof(int32_t)); // Stepper 1 steps
+        twostep_parser_get_param(&cmd_pos, &int32_param2, sizeof(int32_t)); // Stepper 2 steps
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Path speed
+        res = stepper_move_linear(int32_param1, int32_param2, uint16_param1);
+        break;
+    case TWOSTEP_ENQUEUE_MOVE:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Move mode
+        twostep_parser_get_param(&cmd_pos, &uint8_param2, sizeof(uint8_t)); // Direction
+        twostep_parser_get_param(&cmd_pos, &uint32_param1, sizeof(uint32_t)); // Steps
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Speed
+        res = stepper_enqueue(stepper_num, uint8_param1, uint8_param2, uint32_param1, uint16_param1);
+        break;
+    case TWOSTEP_GET_QUEUE_DEPTH:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_queue_depth(stepper_num, &uint8_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Queued moves
+        }
+        break;
+    case TWOSTEP_FLUSH_QUEUE:
+        twostep_parser_get_param(&cmd_pos, &stepper_bitfield, sizeof(uint8_t)); // Stepper bitfield
+        res = stepper_flush(stepper_bitfield);
+        break;
+    case TWOSTEP_SET_POSITION:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &int32_param1, sizeof(int32_t)); // Position
+        res = stepper_set_position(stepper_num, int32_param1);
+        break;
+    case TWOSTEP_GET_POSITION:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_position(stepper_num, &int32_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &int32_param1, sizeof(int32_t)); // Position
+        }
+        break;
     case TWOSTEP_GET_SWITCH_STATUS:
         uint8_param1 = get_switch_status();
         twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Relay status
@@ -175,6 +309,245 @@ static bool twostep_parser_handle_cmd(uint8_t *cmd_buf, uint8_t len)
         uint8_param1 = TWOSTEP_VERSION;
         twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Version
         break;
+    case TWOSTEP_MOVE_TO:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &int32_param1, sizeof(int32_t)); // Target position
+        res = stepper_move_to(stepper_num, int32_param1);
+        break;
+    case TWOSTEP_MOVE_ARC:
+        twostep_parser_get_param(&cmd_pos, &int16_param1, sizeof(int16_t)); // Center x offset
+        twostep_parser_get_param(&cmd_pos, &int16_param2, sizeof(int16_t)); // Center y offset
+        twostep_parser_get_param(&cmd_pos, &int16_param3, sizeof(int16_t)); // End x offset
+        twostep_parser_get_param(&cmd_pos, &int16_param4, sizeof(int16_t)); // End y offset
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Direction
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Path speed
+        res = stepper_move_arc(int16_param1, int16_param2, int16_param3, int16_param4, uint8_param1, uint16_param1);
+        break;
+    case TWOSTEP_PLAN_LINE:
+        twostep_parser_get_param(&cmd_pos, &int32_param1, sizeof(int32_t)); // Stepper 1 steps
+        twostep_parser_get_param(&cmd_pos, &int32_param2, sizeof(int32_t)); // Stepper 2 steps
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Path speed
+        res = planner_add_line(int32_param1, int32_param2, uint16_param1);
+        break;
+    case TWOSTEP_GET_PLANNER_FREE:
+        res = planner_get_free(&uint8_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Free segments
+        }
+        break;
+    case TWOSTEP_SET_HOME_CONFIG:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Switch direction
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Fast speed
+        twostep_parser_get_param(&cmd_pos, &uint16_param2, sizeof(uint16_t)); // Slow speed
+        twostep_parser_get_param(&cmd_pos, &uint32_param1, sizeof(uint32_t)); // Back-off steps
+        res = stepper_set_home_config(stepper_num, uint8_param1, uint16_param1, uint16_param2, uint32_param1);
+        break;
+    case TWOSTEP_GET_HOME_CONFIG:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_home_config(stepper_num, &uint8_param1, &uint16_param1, &uint16_param2, &uint32_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Switch direction
+            twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Fast speed
+            twostep_parser_set_param(&resp_pos, &uint16_param2, sizeof(uint16_t)); // Slow speed
+            twostep_parser_set_param(&resp_pos, &uint32_param1, sizeof(uint32_t)); // Back-off steps
+        }
+        break;
+    case TWOSTEP_HOME:
+        twostep_parser_get_param(&cmd_pos, &stepper_bitfield, sizeof(uint8_t)); // Stepper bitfield
+        res = stepper_home(stepper_bitfield);
+        break;
+    case TWOSTEP_GET_HOME_STATUS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_home_status(stepper_num, &uint8_param1, &int32_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Homing state
+            twostep_parser_set_param(&resp_pos, &int32_param1, sizeof(int32_t)); // Switch position
+        }
+        break;
+    case TWOSTEP_SET_TARGET_VELOCITY:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &int32_param1, sizeof(int32_t)); // Velocity
+        res = stepper_set_target_velocity(stepper_num, int32_param1);
+        break;
+    case TWOSTEP_GET_VELOCITY:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_velocity(stepper_num, &int32_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &int32_param1, sizeof(int32_t)); // Velocity
+        }
+        break;
+    case TWOSTEP_SET_CURRENT_LEVELS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Hold current
+        twostep_parser_get_param(&cmd_pos, &uint16_param2, sizeof(uint16_t)); // Boost current
+        twostep_parser_get_param(&cmd_pos, &uint16_param3, sizeof(uint16_t)); // Hold timeout
+        res = stepper_set_current_levels(stepper_num, uint16_param1, uint16_param2, uint16_param3);
+        break;
+    case TWOSTEP_GET_CURRENT_LEVELS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_current_levels(stepper_num, &uint16_param1, &uint16_param2, &uint16_param3);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Hold current
+            twostep_parser_set_param(&resp_pos, &uint16_param2, sizeof(uint16_t)); // Boost current
+            twostep_parser_set_param(&resp_pos, &uint16_param3, sizeof(uint16_t)); // Hold timeout
+        }
+        break;
+    case TWOSTEP_GET_PERF_STATS:
+        res = perf_get_stats(&uint16_param1, &uint16_param2, &uint16_param3, &uint32_param1, &uint8_param1);
+        twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Min ISR cycles
+        twostep_parser_set_param(&resp_pos, &uint16_param2, sizeof(uint16_t)); // Max ISR cycles
+        twostep_parser_set_param(&resp_pos, &uint16_param3, sizeof(uint16_t)); // Mean ISR cycles
+        twostep_parser_set_param(&resp_pos, &uint32_param1, sizeof(uint32_t)); // Late steps
+        twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Idle percentage
+        break;
+    case TWOSTEP_RESET_PERF_STATS:
+        res = perf_reset_stats();
+        break;
+    case TWOSTEP_GET_PERF_LATENCY:
+        res = perf_get_latency(&uint16_param1, &uint16_param2);
+        twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Max step ISR latency
+        twostep_parser_set_param(&resp_pos, &uint16_param2, sizeof(uint16_t)); // Max step ISR latency waking up
+        break;
+    case TWOSTEP_SET_AUTO_MICROSTEPS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Switch rate
+        res = stepper_set_auto_microsteps(stepper_num, uint16_param1);
+        break;
+    case TWOSTEP_GET_AUTO_MICROSTEPS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_auto_microsteps(stepper_num, &uint16_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Switch rate
+        }
+        break;
+    case TWOSTEP_SET_BACKLASH:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Backlash steps
+        twostep_parser_get_param(&cmd_pos, &uint16_param2, sizeof(uint16_t)); // Compensation rate
+        res = stepper_set_backlash(stepper_num, uint16_param1, uint16_param2);
+        break;
+    case TWOSTEP_GET_BACKLASH:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_backlash(stepper_num, &uint16_param1, &uint16_param2);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Backlash steps
+            twostep_parser_set_param(&resp_pos, &uint16_param2, sizeof(uint16_t)); // Compensation rate
+        }
+        break;
+    case TWOSTEP_SET_SOFT_LIMITS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Enable
+        twostep_parser_get_param(&cmd_pos, &int32_param1, sizeof(int32_t)); // Min position
+        twostep_parser_get_param(&cmd_pos, &int32_param2, sizeof(int32_t)); // Max position
+        res = stepper_set_soft_limits(stepper_num, uint8_param1, int32_param1, int32_param2);
+        break;
+    case TWOSTEP_GET_SOFT_LIMITS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_soft_limits(stepper_num, &uint8_param1, &int32_param1, &int32_param2);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Enable
+            twostep_parser_set_param(&resp_pos, &int32_param1, sizeof(int32_t)); // Min position
+            twostep_parser_set_param(&resp_pos, &int32_param2, sizeof(int32_t)); // Max position
+        }
+        break;
+    case TWOSTEP_GET_STOP_REASON:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_stop_reason(stepper_num, &uint8_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Stop reason
+        }
+        break;
+    case TWOSTEP_SET_TRACE:
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Enable
+        res = trace_set_enable(uint8_param1);
+        break;
+    case TWOSTEP_DUMP_TRACE:
+        res = trace_read(&uint8_param1, &uint16_param1, trace_entries);
+        twostep_parser_set_trace(&resp_pos, uint8_param1, uint16_param1, uint8_param1, trace_entries);
+        break;
+    case TWOSTEP_DUMP_TRACE_ALL:
+        // Full frames go out back to back with TWOSTEP_TRACE_MORE set in
+        // their count, the one without it ends the dump. At most what the
+        // buffer holds, so a running trace can't keep it going.
+        for (uint8_param2 = TRACE_BUF_LEN / TRACE_READ_LEN; ; uint8_param2--) {
+            res = trace_read(&uint8_param1, &uint16_param1, trace_entries);
+            uint8_param3 = uint8_param1;
+            if (uint8_param1 == TRACE_READ_LEN && uint8_param2) {
+                uint8_param3 |= TWOSTEP_TRACE_MORE;
+            }
+            memset(resp_buf + 3, 0xff, TWOSTEP_BUF_SIZE - 3);
+            resp_pos = resp_buf + 3;
+            twostep_parser_set_trace(&resp_pos, uint8_param3, uint16_param1, uint8_param1, trace_entries);
+            if (!(uint8_param3 & TWOSTEP_TRACE_MORE)) {
+                break;
+            }
+            twostep_insert_resp_end_tokens(resp_buf);
+            twostep_parser_send_resp(resp_buf, twostep_resp_len(resp_buf[1]));
+        }
+        break;
+    case TWOSTEP_SET_ACCEL_PRESET:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Preset
+        res = stepper_set_accel_preset(stepper_num, uint8_param1);
+        break;
+    case TWOSTEP_GET_ACCEL_PRESET:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_accel_preset(stepper_num, &uint8_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Preset
+        }
+        break;
+    case TWOSTEP_SET_GEARING:
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Enable
+        twostep_parser_get_param(&cmd_pos, &int16_param1, sizeof(int16_t)); // Numerator
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Denominator
+        res = stepper_set_gearing(uint8_param1, int16_param1, uint16_param1);
+        break;
+    case TWOSTEP_GET_GEARING:
+        res = stepper_get_gearing(&uint8_param1, &int16_param1, &uint16_param1);
+        twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Enable
+        twostep_parser_set_param(&resp_pos, &int16_param1, sizeof(int16_t)); // Numerator
+        twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Denominator
+        break;
+    case TWOSTEP_SET_GANTRY:
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Enable
+        twostep_parser_get_param(&cmd_pos, &uint8_param2, sizeof(uint8_t)); // Reverse
+        res = stepper_set_gantry(uint8_param1, uint8_param2);
+        break;
+    case TWOSTEP_GET_GANTRY:
+        res = stepper_get_gantry(&uint8_param1, &uint8_param2, &uint8_param3);
+        twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Enable
+        twostep_parser_set_param(&resp_pos, &uint8_param2, sizeof(uint8_t)); // Reverse
+        twostep_parser_set_param(&resp_pos, &uint8_param3, sizeof(uint8_t)); // Locked
+        break;
+    case TWOSTEP_SET_PROBE_STEPS:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        twostep_parser_get_param(&cmd_pos, &uint32_param1, sizeof(uint32_t)); // Step count
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Continue
+        res = stepper_set_probe_steps(stepper_num, uint32_param1, uint8_param1);
+        break;
+    case TWOSTEP_GET_PROBE_RESULT:
+        twostep_parser_get_param(&cmd_pos, &stepper_num, sizeof(uint8_t)); // Stepper num
+        res = stepper_get_probe_result(stepper_num, &uint8_param1, &int32_param1, &uint16_param1);
+        if (res) {
+            twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // State
+            twostep_parser_set_param(&resp_pos, &int32_param1, sizeof(int32_t)); // Position
+            twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Timestamp
+        }
+        break;
+    case TWOSTEP_SET_SWITCH_CONFIG:
+        twostep_parser_get_param(&cmd_pos, &uint8_param1, sizeof(uint8_t)); // Invert mask
+        twostep_parser_get_param(&cmd_pos, &uint8_param2, sizeof(uint8_t)); // Enable mask
+        twostep_parser_get_param(&cmd_pos, &uint16_param1, sizeof(uint16_t)); // Filter time
+        res = switches_set_config(uint8_param1, uint8_param2, uint16_param1);
+        break;
+    case TWOSTEP_GET_SWITCH_CONFIG:
+        res = switches_get_config(&uint8_param1, &uint8_param2, &uint16_param1);
+        twostep_parser_set_param(&resp_pos, &uint8_param1, sizeof(uint8_t)); // Invert mask
+        twostep_parser_set_param(&resp_pos, &uint8_param2, sizeof(uint8_t)); // Enable mask
+        twostep_parser_set_param(&resp_pos, &uint16_param1, sizeof(uint16_t)); // Filter time
+        break;
     default:
         res = false;
         break;
@@ -191,55 +564,40 @@ static bool twostep_parser_handle_cmd(uint8_t *cmd_buf, uint8_t len)
 }
 
 
+// Parses whatever has been received so far and returns without waiting for
+// more. The frame is kept between calls, a broken frame is dropped and the
+// search for the next start token starts over. Returns true once it ran a
+// command, so the main loop gets a turn between back to back frames.
 bool twostep_parser_parse()
 {
-    bool res = true;
-    uint8_t buf[TWOSTEP_BUF_SIZE];
-    uint8_t i = 0;
-    uint8_t len;
-
-    buf[i++] = uart_char_receive_blocking();
-
-    if (!twostep_verify_start_token(buf)) {
-        res = false;
-    }
-
-    if (res) {
-        buf[i++] = uart_char_receive_blocking();
-
-        len = twostep_cmd_len(buf[i-1]);
-        if (len == 0) {
-            res = false;
+    bool res = false;
+    uint8_t c;
+
+    while (!res && uart_char_receive(&c)) {
+        twostep_parser_buf[twostep_parser_pos++] = c;
+
+        if (twostep_parser_pos == 1) {
+            if (!twostep_verify_start_token(twostep_parser_buf)) {
+                twostep_parser_pos = 0;
+            }
+        } else if (twostep_parser_pos == 2) {
+            twostep_parser_len = twostep_cmd_len(c);
+            if (twostep_parser_len == 0) {
+                twostep_parser_pos = 0;
+            }
+        } else if (twostep_parser_pos == twostep_parser_len - 1) {
+            if (c != TWOSTEP_END1_TOKEN) {
+                twostep_parser_pos = 0;
+            }
+        } else if (twostep_parser_pos == twostep_parser_len) {
+            twostep_parser_pos = 0;
+            if (c == TWOSTEP_END2_TOKEN) {
+                led_toggle();
+                twostep_parser_handle_cmd(twostep_parser_buf, twostep_parser_len);
+                res = true;
+            }
         }
     }
 
-    if (res) {
-        while (i < len-2) {
-            buf[i++] = uart_char_receive_blocking();
-        }
-    }
-
-    if (res) {
-        buf[i++] = uart_char_receive_blocking();
-
-        if (buf[i-1] != TWOSTEP_END1_TOKEN) {
-            res = false;
-        }
-    }
-
-    if (res) {
-        buf[i++] = uart_char_receive_blocking();
-
-        if (buf[i-1] != TWOSTEP_END2_TOKEN) {
-            res = false;
-        }
-    }
-
-    if (res) {
-        led_toggle();
-        twostep_parser_handle_cmd(buf, len);
-
-    }
-
     return res;
 }
@@ -19,6 +19,10 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "uart.h"
+#include "perf.h"
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 
 
 #if (F_CPU != 32000000L)
@@ -26,10 +30,69 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 
-inline uint8_t uart_char_receive_blocking()
+static uint8_t uart_rx_buf[UART_RX_BUF_LEN];
+static volatile uint8_t uart_rx_head;
+static volatile uint8_t uart_rx_count;
+
+
+// Moves each character out of the two byte hardware buffer right away, so
+// nothing is lost while the main loop runs a command or sends a response.
+// Characters that don't fit any more are dropped, the parser finds the next
+// start token.
+ISR(USARTD0_RXC_vect)
+{
+#ifdef PERF_ISR_BUSY
+    uint16_t start = perf_start();
+#endif
+    uint8_t c = USARTD0.DATA;
+
+    if (uart_rx_count < UART_RX_BUF_LEN) {
+        uart_rx_buf[(uart_rx_head + uart_rx_count) & UART_RX_BUF_MASK] = c;
+        uart_rx_count++;
+    }
+#ifdef PERF_ISR_BUSY
+    perf_isr_busy(start);
+#endif
+}
+
+
+bool uart_char_received()
+{
+    return uart_rx_count != 0;
+}
+
+
+bool uart_char_receive(uint8_t *c)
 {
-    while (!uart_char_received());
-    return uart_cur_char();
+    bool res = false;
+
+    ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+        if (uart_rx_count) {
+            *c = uart_rx_buf[uart_rx_head];
+            uart_rx_head = (uart_rx_head + 1) & UART_RX_BUF_MASK;
+            uart_rx_count--;
+            res = true;
+        }
+    }
+
+    return res;
+}
+
+
+// Any interrupt wakes the CPU up. Interrupts are only enabled right before
+// sleeping so a character can't slip in between the check and the sleep.
+void uart_wait()
+{
+    cli();
+    if (!uart_rx_count) {
+        perf_sleep();
+        sleep_enable();
+        sei();
+        sleep_cpu();
+        sleep_disable();
+        perf_wake();
+    }
+    sei();
 }
 
 
@@ -78,4 +141,8 @@ void uart_init(enum uart_baud_setting baud_rate)
 
 	USARTD0.CTRLB |= USART_RXEN_bm | USART_TXEN_bm;
 
+    uart_rx_head = 0;
+    uart_rx_count = 0;
+    USARTD0.CTRLA = (USARTD0.CTRLA & ~USART_RXCINTLVL_gm) | USART_RXCINTLVL_LO_gc;
+
 }
@@ -23,6 +23,8 @@ along with Lasershark. If not, see <http://www.gnu.org/licenses/>.
 
 
 #include <avr/io.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 
 enum uart_baud_setting {
@@ -32,15 +34,20 @@ enum uart_baud_setting {
     BAUD_115200
 };
 
+// Received characters wait here until the main loop takes them. Must be a
+// power of two, holds two of the longest commands.
+#define UART_RX_BUF_LEN 32
+#define UART_RX_BUF_MASK (UART_RX_BUF_LEN - 1)
 
-// nonzero if character has been received
-#define uart_char_received() (USARTD0.STATUS & USART_RXCIF_bm)
 
-// current character in UART receive buffer
-#define uart_cur_char() USARTD0.DATA
+// true if a received character is waiting
+bool uart_char_received();
 
-// Receives a character. Blocks if none are present
-inline uint8_t uart_char_receive_blocking();
+// Takes a received character. Returns false if none are waiting
+bool uart_char_receive(uint8_t *c);
+
+// Sleeps until the next interrupt, unless a received character is waiting
+void uart_wait();
 
 // send character
 #define uart_char_send(c) USARTD0.DATA = (c)